@@ -99,6 +99,13 @@ contains( DEFINES, NO_VECTORIAL_RENDER ) {
 	VRender/VRender.h
 
   HEADERS *= $${VRENDER_HEADERS}
+
+  # Scoped markers of the parse, sort, optimize and export stages, recorded by the tracer of the application (src/trace.h).
+  # Its symbols come from the application, so only use it with a static library: qmake QGLVIEWER_STATIC=yes CONFIG+=vrender_trace
+  vrender_trace {
+    DEFINES *= VRENDER_TRACE
+    INCLUDEPATH *= ../src
+  }
 }
 
 
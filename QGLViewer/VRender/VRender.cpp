@@ -63,6 +63,14 @@
 #include "SortMethod.h"
 #include "Optimizer.h"
 
+// Scoped markers of the stages, recorded by the tracer of the application (see src/trace.h and QGLViewer.pro)
+#ifdef VRENDER_TRACE
+#include "trace.h"
+#define VRENDER_TRACE_SCOPE(name) TRACE_SCOPE(name)
+#else
+#define VRENDER_TRACE_SCOPE(name)
+#endif
+
 using namespace vrender ;
 using namespace std ;
 
@@ -125,7 +133,10 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 		vector<PtrPrimitive> primitive_tab ;
 
 		ParserGL parserGL ;
-		parserGL.parseFeedbackBuffer(feedbackBuffer,returned,primitive_tab,vparams) ;
+		{
+			VRENDER_TRACE_SCOPE("VRender parse") ;
+			parserGL.parseFeedbackBuffer(feedbackBuffer,returned,primitive_tab,vparams) ;
+		}
 
 		if(feedbackBuffer != NULL)
 		{
@@ -135,6 +146,7 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 
 		if(vparams.isEnabled(VRenderParams::OptimizeBackFaceCulling))
 		{
+			VRENDER_TRACE_SCOPE("VRender optimize") ;
 			BackFaceCullingOptimizer bfopt ;
 			bfopt.optimize(primitive_tab,vparams) ;
 		}
@@ -160,12 +172,16 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 			throw std::runtime_error("Unknown sorting method.") ;
 		}
 
-		sort_method->sortPrimitives(primitive_tab,vparams) ;
+		{
+			VRENDER_TRACE_SCOPE("VRender sort") ;
+			sort_method->sortPrimitives(primitive_tab,vparams) ;
+		}
 
 		// Lance les optimisations. L'ordre est important.
 
 		if(vparams.isEnabled(VRenderParams::CullHiddenFaces))
 		{
+			VRENDER_TRACE_SCOPE("VRender optimize") ;
 			VisibilityOptimizer vopt ;
 			vopt.optimize(primitive_tab,vparams) ;
 		}
@@ -217,7 +233,10 @@ void vrender::VectorialRender(RenderCB render_callback, void *callback_params, V
 		exporter->setClearBackground(vparams.isEnabled(VRenderParams::AddBackground)) ;
 		exporter->setClearColor(clearColor[0],clearColor[1],clearColor[2]) ;
 
-		exporter->exportToFile(vparams.filename(),primitive_tab,vparams) ;
+		{
+			VRENDER_TRACE_SCOPE("VRender export") ;
+			exporter->exportToFile(vparams.filename(),primitive_tab,vparams) ;
+		}
 
 		// deletes primitives
 
@@ -478,6 +478,9 @@ public:
 	\c PASS_THROUGH tokens are not handled so one can not change point and line size in the middle of
 	a drawing.
 
+	Large images are better saved as \c "PPM": the tiles of the snapshot are then written straight to
+	the file, instead of being gathered in an image of the final size.
+
 	Default value is the first supported among "JPEG, PNG, EPS, PS, PPM, BMP", in that order.
 
 	This value is set using setSnapshotFormat() or with openSnapshotFormatDialog().
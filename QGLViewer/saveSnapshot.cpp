@@ -33,6 +33,7 @@
 # include <QImageWriter>
 
 #include <qfileinfo.h>
+#include <qfile.h>
 #include <qfiledialog.h>
 #include <qmessagebox.h>
 #include <qapplication.h>
@@ -365,14 +366,38 @@ bool QGLViewer::saveImageSnapshot(const QString& fileName)
 			yMin = xMin / newAspectRatio;
 	}
 
-	QImage image(finalSize.width(), finalSize.height(), QImage::Format_ARGB32);
+	// PPM snapshots are written to the file tile by tile, so that the resulting image is never held in
+	// memory and can be much larger than the available RAM. Other formats need the whole image to be encoded.
+	const bool streamed = (snapshotFormat() == "PPM");
+	QImage image;
+	QFile streamedFile(fileName);
+	qint64 streamedHeaderSize = 0;
+	bool streamedOK = true;
 
-	if (image.isNull())
+	if (streamed)
 	{
-		QMessageBox::warning(this, "Image saving error",
-							 "Unable to create resulting image",
-							 QMessageBox::Ok, QMessageBox::NoButton);
-		return false;
+		QByteArray header = "P6\n" + QByteArray::number(finalSize.width()) + " " + QByteArray::number(finalSize.height()) + "\n255\n";
+		streamedHeaderSize = header.size();
+		if (!streamedFile.open(QIODevice::WriteOnly | QIODevice::Truncate) || streamedFile.write(header) != streamedHeaderSize
+			|| !streamedFile.resize(streamedHeaderSize + 3 * qint64(finalSize.width()) * finalSize.height()))
+		{
+			QMessageBox::warning(this, "Image saving error",
+								 "Unable to create resulting image file",
+								 QMessageBox::Ok, QMessageBox::NoButton);
+			return false;
+		}
+	}
+	else
+	{
+		image = QImage(finalSize.width(), finalSize.height(), QImage::Format_ARGB32);
+
+		if (image.isNull())
+		{
+			QMessageBox::warning(this, "Image saving error",
+								 "Unable to create resulting image",
+								 QMessageBox::Ok, QMessageBox::NoButton);
+			return false;
+		}
 	}
 
 	// ProgressDialog disabled since it interfers with the screen grabing mecanism on some platforms. Too bad.
@@ -453,24 +478,55 @@ bool QGLViewer::saveImageSnapshot(const QString& fileName)
 
 			QImage subImage = snapshot.scaled(subSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
 
-			// Copy subImage in image
-			for (int ii=0; ii<subSize.width(); ii++)
+			if (streamed)
 			{
-				int fi = i*subSize.width() + ii;
-				if (fi == image.width())
-					break;
+				// Write the rows of subImage at their place in the file
+				const int rowWidth = qMin(subSize.width(), finalSize.width() - i*subSize.width());
+				QByteArray row(3*rowWidth, 0);
 				for (int jj=0; jj<subSize.height(); jj++)
 				{
 					int fj = j*subSize.height() + jj;
-					if (fj == image.height())
+					if (fj == finalSize.height())
 						break;
-					image.setPixel(fi, fj, subImage.pixel(ii,jj));
+					for (int ii=0; ii<rowWidth; ii++)
+					{
+						const QRgb pixel = subImage.pixel(ii,jj);
+						row[3*ii]   = char(qRed(pixel));
+						row[3*ii+1] = char(qGreen(pixel));
+						row[3*ii+2] = char(qBlue(pixel));
+					}
+					streamedOK = streamedOK && streamedFile.seek(streamedHeaderSize + 3 * (qint64(fj) * finalSize.width() + i*subSize.width()))
+								 && streamedFile.write(row) == row.size();
+				}
+			}
+			else
+			{
+				// Copy subImage in image
+				for (int ii=0; ii<subSize.width(); ii++)
+				{
+					int fi = i*subSize.width() + ii;
+					if (fi == image.width())
+						break;
+					for (int jj=0; jj<subSize.height(); jj++)
+					{
+						int fj = j*subSize.height() + jj;
+						if (fj == image.height())
+							break;
+						image.setPixel(fi, fj, subImage.pixel(ii,jj));
+					}
 				}
 			}
 			count++;
 		}
 
-	bool saveOK = image.save(fileName, snapshotFormat().toLatin1().constData(), snapshotQuality());
+	bool saveOK;
+	if (streamed)
+	{
+		saveOK = streamedOK && streamedFile.flush();
+		streamedFile.close();
+	}
+	else
+		saveOK = image.save(fileName, snapshotFormat().toLatin1().constData(), snapshotQuality());
 
 	// ProgressDialog::hideProgressDialog();
 	// setCursor(QCursor(Qt::ArrowCursor));
@@ -0,0 +1,138 @@
+#include "ShaderProgram_Image.h"
+#include "errorsHandler.hpp"
+#include <cstring>
+
+ShaderProgram_Image::ShaderProgram_Image() :
+    vaoId(0),
+    textureId(0),
+    pboId(0),
+    idOfImage(-1),
+    textureWidth(0),
+    textureHeight(0)
+{
+    // load & compile & link shaders
+    load("image.vert","image.frag");
+
+    getUniformLocations();
+}
+
+void ShaderProgram_Image::createTexture()
+{
+    //the quad has no vertex attribute, but core profiles draw nothing without a VAO
+    glGenVertexArrays(1, &vaoId);
+
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &pboId);
+}
+
+void ShaderProgram_Image::destroyTexture()
+{
+    glDeleteBuffers(1, &pboId);
+    glDeleteTextures(1, &textureId);
+    glDeleteVertexArrays(1, &vaoId);
+    textureWidth=textureHeight=0;
+}
+
+void ShaderProgram_Image::getUniformLocations()
+{
+    idOfImage = glGetUniformLocation(m_programId, "u_image");
+}
+
+void ShaderProgram_Image::uploadImage(const QImage& image, const std::vector<SceneCamera::RenderTile>& tiles)
+{
+    //the pixels of RGB32 images are 0xffRRGGBB words: BGRA, in the fastest format of most drivers
+    QImage bgra = image.format()==QImage::Format_RGB32 ? image : image.convertToFormat(QImage::Format_RGB32);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+
+    std::vector<SceneCamera::RenderTile> wholeImage;
+    const std::vector<SceneCamera::RenderTile> *uploaded=&tiles;
+    if(bgra.width()!=textureWidth || bgra.height()!=textureHeight)
+    {
+        textureWidth=bgra.width();
+        textureHeight=bgra.height();
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, textureWidth, textureHeight, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+        SceneCamera::RenderTile tile;
+        tile.x=tile.y=0;
+        tile.width=textureWidth;
+        tile.height=textureHeight;
+        wholeImage.push_back(tile);
+        uploaded=&wholeImage;
+    }
+
+    size_t size=0;
+    for(size_t i=0; i<uploaded->size(); ++i)
+        size+=(size_t)(*uploaded)[i].width*(*uploaded)[i].height*4;
+
+    if(size>0)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pboId);
+        //a new storage every time: the previous one stays with OpenGL until it is done uploading it
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        unsigned char *pixels=(unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if(pixels==NULL)
+            WARNING("ShaderProgram_Image: can't map the pixel buffer, the image isn't updated");
+        else
+        {
+            //the tiles one after the other, each with rows of its own width
+            size_t offset=0;
+            for(size_t i=0; i<uploaded->size(); ++i)
+            {
+                const SceneCamera::RenderTile& tile=(*uploaded)[i];
+                for(int y=tile.y; y<tile.y+tile.height; ++y)
+                {
+                    std::memcpy(pixels+offset, bgra.constScanLine(y)+tile.x*4, tile.width*4);
+                    offset+=tile.width*4;
+                }
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            offset=0;
+            for(size_t i=0; i<uploaded->size(); ++i)
+            {
+                const SceneCamera::RenderTile& tile=(*uploaded)[i];
+                glTexSubImage2D(GL_TEXTURE_2D, 0, tile.x, tile.y, tile.width, tile.height,
+                                GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, (const GLvoid*)offset);
+                offset+=(size_t)tile.width*tile.height*4;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void ShaderProgram_Image::uploadImage(const QImage& image)
+{
+    //a texture of another size is sent whole
+    textureWidth=textureHeight=0;
+    uploadImage(image, std::vector<SceneCamera::RenderTile>());
+}
+
+void ShaderProgram_Image::drawImage()
+{
+    if(textureWidth==0)
+        return;
+    GLboolean depthTest=glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+
+    startUseProgram();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glUniform1i(idOfImage, 0);
+    glBindVertexArray(vaoId);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    stopUseProgram();
+
+    if(depthTest)
+        glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,58 @@
+#ifndef SHADERPROGRAM_IMAGE_H
+#define SHADERPROGRAM_IMAGE_H
+
+#include <GL/glew.h>
+#include <QImage>
+#include "ShaderProgram.h"
+#include "scenecamera.h"
+#include <vector>
+
+///
+/// \brief The ShaderProgram_Image class draws an image over the whole viewport, e.g. the frames of the PreviewRenderer
+/// or the tiles of a RenderJob. The image is kept in a texture, and only its changed tiles are sent again:
+/// they are copied in a pixel buffer object, from which OpenGL uploads them without stalling the viewer.
+///
+class ShaderProgram_Image: public ShaderProgram
+{
+public:
+
+    ShaderProgram_Image();
+
+    /// Creates the texture, its pixel buffer object, and the empty VertexArrayObject the quad is drawn with
+    /// (its corners come from gl_VertexID)
+    void createTexture();
+
+    /// Destroys the texture, the pixel buffer object and the VertexArrayObject
+    void destroyTexture();
+
+    /// Get the GLSL uniform locations
+    void getUniformLocations();
+
+    ///
+    /// \brief uploadImage sends the given tiles of an image to the texture,
+    /// or the whole image if its size changed since the last upload.
+    /// Images in QImage::Format_RGB32 are copied as they are, the other ones are converted first.
+    ///
+    void uploadImage(const QImage& image, const std::vector<SceneCamera::RenderTile>& tiles);
+
+    /// \brief uploadImage sends a whole image to the texture, e.g. when another image is to be shown.
+    void uploadImage(const QImage& image);
+
+    /// \brief drawImage draws the texture over the viewport, without depth test.
+    void drawImage();
+
+    /// id de VAO
+    GLuint vaoId;
+    /// id of the texture holding the image
+    GLuint textureId;
+    /// id of the pixel buffer object the tiles go through
+    GLuint pboId;
+
+    /// uniform Id for the sampler of the image
+    GLint idOfImage;
+
+    /// size of the texture
+    int textureWidth, textureHeight;
+};
+
+#endif // SHADERPROGRAM_IMAGE_H
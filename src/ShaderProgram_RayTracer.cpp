@@ -16,6 +16,9 @@ void ShaderProgram_RayTracer::createVBO()
 
     //EBO
     glGenBuffers(1, &eboId);
+
+    //VBO of the instance matrices, filled by the instanced objects when they are drawn
+    glGenBuffers(1, &vboInstanceId);
 }
 
 /// Creates the VertexArrayObject that contains the geometry info
@@ -47,6 +50,7 @@ void ShaderProgram_RayTracer::destroyVAOAndVBO()
 {
     glDeleteBuffers(1, &vboPositionId);
     glDeleteBuffers(1, &eboId);
+    glDeleteBuffers(1, &vboInstanceId);
 
     glDeleteVertexArrays(1, &vaoId);
 }
@@ -58,6 +62,9 @@ void ShaderProgram_RayTracer::getUniformLocations()
     idOfProjectionMatrix =  glGetUniformLocation(m_programId, "u_mtxProjection");
     idOfViewMatrix =        glGetUniformLocation(m_programId, "u_mtxView");
     idOfColor =             glGetUniformLocation(m_programId, "u_vColor");
+
+    // and of the per-instance attribute
+    idOfInstanceMatrixAttribute = glGetAttribLocation(m_programId, "vtx_instanceMatrix");
 }
 
 /// Get the GLSL vertex attributes locations
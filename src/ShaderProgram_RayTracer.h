@@ -38,6 +38,8 @@ public:
     GLuint vboPositionId;
     /// id de EBO pour desiner les primitives
     GLuint eboId;
+    /// id de VBO pour les matrices des instances
+    GLuint vboInstanceId;
     /// shader prg
 
     /// uniform Id for projection matrix
@@ -57,6 +59,9 @@ public:
 
     /// vertex attribute Id for positions
     GLuint idOfPositionAttribute;
+
+    /// vertex attribute Id for the instance matrix (first of its 4 columns)
+    GLint idOfInstanceMatrixAttribute;
 };
 
 #endif // SHADERPROGRAM_RAYTRACER_H
@@ -0,0 +1,97 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <glm/glm.hpp>
+#include <limits>
+#include <algorithm>
+
+///
+/// \brief The AABB class is an axis aligned bounding box, used by the acceleration structures
+/// to cull objects a ray can't possibly hit. A default constructed box is empty.
+///
+class AABB
+{
+public:
+    AABB() :
+        pMin( std::numeric_limits<float>::max()),
+        pMax(-std::numeric_limits<float>::max())
+    {}
+
+    AABB(const glm::vec3& min, const glm::vec3& max) :
+        pMin(min),
+        pMax(max)
+    {}
+
+    inline void extend(const glm::vec3& p)      {pMin=glm::min(pMin, p); pMax=glm::max(pMax, p);}
+    inline void extend(const AABB& box)         {pMin=glm::min(pMin, box.pMin); pMax=glm::max(pMax, box.pMax);}
+
+    inline bool isEmpty() const                 {return pMin.x>pMax.x || pMin.y>pMax.y || pMin.z>pMax.z;}
+
+    inline bool overlaps(const AABB& box) const
+    {
+        return !isEmpty() && !box.isEmpty() && glm::all(glm::lessThanEqual(pMin, box.pMax)) && glm::all(glm::lessThanEqual(box.pMin, pMax));
+    }
+
+    inline glm::vec3 center() const             {return (pMin+pMax)*0.5f;}
+    inline glm::vec3 extent() const             {return pMax-pMin;}
+
+    inline float surfaceArea() const
+    {
+        if(isEmpty())
+            return 0.0f;
+        glm::vec3 e=extent();
+        return 2.0f*(e.x*e.y + e.y*e.z + e.z*e.x);
+    }
+
+    inline int largestAxis() const
+    {
+        glm::vec3 e=extent();
+        return (e.x>e.y && e.x>e.z) ? 0 : (e.y>e.z ? 1 : 2);
+    }
+
+    ///
+    /// \brief transformed
+    /// \return the box containing the 8 corners of this box, transformed by the affine matrix m.
+    ///
+    AABB transformed(const glm::mat4& m) const
+    {
+        AABB box;
+        if(!isEmpty())
+        {
+            for(int i=0; i<8; ++i)
+            {
+                glm::vec3 corner((i&1) ? pMax.x : pMin.x,
+                                 (i&2) ? pMax.y : pMin.y,
+                                 (i&4) ? pMax.z : pMin.z);
+                box.extend(glm::vec3(m*glm::vec4(corner, 1.0f)));
+            }
+        }
+        return box;
+    }
+
+    ///
+    /// \brief intersectsRay slab test between the box and a ray.
+    /// \param origin origin of the ray
+    /// \param invDirection component-wise inverse of the ray direction
+    /// \param tMax the box is ignored if it is further than this distance
+    /// \param tNear distance at which the ray enters the box
+    /// \return true if the ray enters the box between 0 and tMax (never for an empty box, which the slabs alone would let through)
+    ///
+    inline bool intersectsRay(const glm::vec3& origin, const glm::vec3& invDirection, float tMax, float& tNear) const
+    {
+        glm::vec3 t0=(pMin-origin)*invDirection;
+        glm::vec3 t1=(pMax-origin)*invDirection;
+        glm::vec3 tSmall=glm::min(t0, t1);
+        glm::vec3 tBig=glm::max(t0, t1);
+
+        tNear=std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, 0.0f));
+        float tFar=std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, tMax));
+        //an empty box has every axis inverted (see AABB()), so checking one is enough
+        return tNear<=tFar && pMin.x<=pMax.x;
+    }
+
+    glm::vec3 pMin;
+    glm::vec3 pMax;
+};
+
+#endif // AABB_H
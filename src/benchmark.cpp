@@ -0,0 +1,344 @@
+#include "benchmark.h"
+#include <QFile>
+#include <QByteArray>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <iomanip>
+
+const double Benchmark::ms_minRunTime=0.05;
+
+Benchmark::Benchmark(SceneManager& manager, unsigned int seed) :
+    m_manager(manager),
+    m_seed(seed),
+    m_results(),
+    m_sink(0.0f)
+{}
+
+template<class Kernel>
+void Benchmark::time(const char *name, size_t operationsPerCall, bool tracesRays, Kernel kernel)
+{
+    typedef std::chrono::steady_clock Clock;
+    Random::genMt19937.seed(m_seed);
+
+    //as many calls as it takes for a run to be long enough, doubled from a single one
+    size_t calls=1;
+    double best=0.0;
+    for(;;)
+    {
+        Clock::time_point start=Clock::now();
+        for(size_t c=0; c<calls; ++c)
+            m_sink+=kernel();
+        best=std::chrono::duration<double>(Clock::now()-start).count();
+        if(best>=ms_minRunTime)
+            break;
+        calls*=2;
+    }
+    for(int run=1; run<ms_runs; ++run)
+    {
+        Clock::time_point start=Clock::now();
+        for(size_t c=0; c<calls; ++c)
+            m_sink+=kernel();
+        best=std::min(best, std::chrono::duration<double>(Clock::now()-start).count());
+    }
+
+    Result_t result;
+    result.name=name;
+    result.operations=calls*operationsPerCall;
+    result.nanosecondsPerOperation=best*1e9/result.operations;
+    result.raysPerSecond=tracesRays ? result.operations/best : 0.0;
+    m_results.push_back(result);
+}
+
+const std::vector<Benchmark::Result_t>& Benchmark::run()
+{
+    m_results.clear();
+    benchmarkFaces();
+    benchmarkCones();
+    benchmarkIntegrals();
+    benchmarkMaterials();
+    benchmarkCamera();
+    benchmarkTraversal();
+    return m_results;
+}
+
+void Benchmark::benchmarkFaces()
+{
+    //a 2x2 face at z=0, and rays which hit it, hit its plane out of it, or go along it
+    SceneFace face(glm::vec3(-1, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), 2, 2);
+    std::mt19937 generator(m_seed);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<Ray> hits(ms_inputCount), misses(ms_inputCount), parallels(ms_inputCount);
+    for(size_t i=0; i<ms_inputCount; ++i)
+    {
+        glm::vec3 origin(unit(generator), unit(generator), 2.0f+unit(generator));
+        glm::vec3 inside(0.9f*unit(generator), 0.9f*unit(generator), 0.0f);
+        glm::vec3 outside(inside.x<0 ? inside.x-2.0f : inside.x+2.0f, inside.y, 0.0f);
+        float turn=(float)M_PI*unit(generator);
+        hits[i]=Ray(origin, glm::normalize(inside-origin));
+        misses[i]=Ray(origin, glm::normalize(outside-origin));
+        parallels[i]=Ray(glm::vec3(origin.x, origin.y, 0.0f), glm::vec3(std::cos(turn), std::sin(turn), 0.0f));
+    }
+
+    const std::vector<Ray> *rays[3]={&hits, &misses, &parallels};
+    const char *names[3]={"face_intersect_hit", "face_intersect_miss", "face_intersect_parallel"};
+    for(int r=0; r<3; ++r)
+    {
+        const std::vector<Ray>& batch=*rays[r];
+        time(names[r], ms_inputCount, true, [&face, &batch]()
+        {
+            float distances=0.0f;
+            for(size_t i=0; i<batch.size(); ++i)
+            {
+                SceneObject::RayHitProperties properties;
+                face.intersectsRay(batch[i], properties);
+                if(properties.occuredHit)
+                    distances+=properties.distanceHit;
+            }
+            return distances;
+        });
+    }
+}
+
+void Benchmark::benchmarkCones()
+{
+    //the reflection cones of mainRendering(), around random axes
+    std::mt19937 generator(m_seed);
+    std::normal_distribution<float> normal;
+    std::vector<glm::vec3> axes(ms_inputCount);
+    for(size_t i=0; i<ms_inputCount; ++i)
+        axes[i]=glm::normalize(glm::vec3(normal(generator), normal(generator), normal(generator)));
+    const float angle=(float)M_PI/8.0f;
+    const glm::vec3 origin(0, 0, 0);
+
+    //a cone set up for a single ray, as a Ray made from a cone does
+    time("ray_cone_single", ms_inputCount, false, [&axes, angle, &origin]()
+    {
+        float sum=0.0f;
+        for(size_t i=0; i<axes.size(); ++i)
+        {
+            Ray::RandomCone cone;
+            cone.direction=axes[i];
+            cone.angle=angle;
+            sum+=Ray(origin, cone).direction().x;
+        }
+        return sum;
+    });
+
+    //cones set up once, sampled by batches of directions
+    const unsigned int batchSize=16;
+    std::vector<Ray::RandomCone> cones(ms_inputCount);
+    for(size_t i=0; i<ms_inputCount; ++i)
+        cones[i].setup(axes[i], angle);
+    time("ray_cone_batch", ms_inputCount*batchSize, false, [&cones, batchSize]()
+    {
+        glm::vec3 directions[batchSize];
+        float sum=0.0f;
+        for(size_t i=0; i<cones.size(); ++i)
+        {
+            cones[i].sample(batchSize, directions);
+            sum+=directions[batchSize-1].x;
+        }
+        return sum;
+    });
+}
+
+void Benchmark::benchmarkIntegrals()
+{
+    //the samples of a light with quality 10, one by one through the integral and by batches
+    SceneFace face(glm::vec3(-1, 2, -1), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), 2, 2);
+    const size_t quality=10;
+    const SceneObject::Integral::Type_t types[3]={SceneObject::Integral::SINGLE_MEAN, SceneObject::Integral::UNIFORM,
+                                                  SceneObject::Integral::UNIFORM_RANDOM};
+    const char *names[3]={"face_integral_single_mean", "face_integral_uniform", "face_integral_uniform_random"};
+    const char *batchNames[3]={"face_samples_single_mean", "face_samples_uniform", "face_samples_uniform_random"};
+    for(int t=0; t<3; ++t)
+    {
+        SceneObject::Integral::Type_t type=types[t];
+        size_t samples=face.beginIntegral(quality, type).actualSize;
+        time(names[t], samples, false, [&face, quality, type]()
+        {
+            glm::vec3 sum(0, 0, 0);
+            SceneObject::Integral end=face.endIntegral(quality, type);
+            for(SceneObject::Integral it=face.beginIntegral(quality, type); it!=end; face.nextIntegral(it))
+                sum+=*it;
+            return sum.x+sum.y+sum.z;
+        });
+
+        //the same samples at once, as the renderings draw them
+        SceneObject::LightSamples batch;
+        face.sampleSurface(quality, type, batch);
+        time(batchNames[t], batch.size(), false, [&face, quality, type, &batch]()
+        {
+            face.sampleSurface(quality, type, batch);
+            return batch.x()[batch.size()-1];
+        });
+    }
+}
+
+void Benchmark::benchmarkMaterials()
+{
+    SceneFace_Prop prop(glm::vec3(-1, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), 2, 2);
+    MaterialProp::MaterialProperties_t material;
+    material.vAmbiant=glm::vec3(0.1f, 0.1f, 0.1f);
+    material.vDiffuse=glm::vec3(0.6f, 0.5f, 0.4f);
+    material.vSpecular=glm::vec3(0.8f, 0.8f, 0.8f);
+    material.fSpecularPower=32.0f;
+    material.fReflectionPower=0.0f;
+    prop.setMaterialProperties(material);
+    SceneFace_Light light(glm::vec3(-1, 2, -1), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), 2, 2);
+    LightSource::LightProperties_t lightProperties;
+    lightProperties.vAmbiant=glm::vec3(0.2f, 0.2f, 0.2f);
+    lightProperties.vDiffuse=glm::vec3(1, 1, 1);
+    lightProperties.vSpecular=glm::vec3(1, 1, 1);
+    light.setLightProperties(lightProperties);
+
+    //directions to the light and to the eye over the hemisphere of the normal, half of the specular terms being 0
+    std::mt19937 generator(m_seed);
+    std::normal_distribution<float> normal;
+    std::vector<glm::vec3> toLights(ms_inputCount), toEyes(ms_inputCount);
+    const glm::vec3 N(0, 0, 1);
+    for(size_t i=0; i<ms_inputCount; ++i)
+    {
+        toLights[i]=glm::normalize(glm::vec3(normal(generator), normal(generator), std::abs(normal(generator))));
+        toEyes[i]=glm::normalize(glm::vec3(normal(generator), normal(generator), std::abs(normal(generator))));
+    }
+
+    time("material_diffuse", ms_inputCount, false, [&prop, &light, &N, &toLights]()
+    {
+        glm::vec3 sum(0, 0, 0);
+        for(size_t i=0; i<toLights.size(); ++i)
+            sum+=prop.colorDiffuse(light, N, toLights[i]);
+        return sum.x+sum.y+sum.z;
+    });
+    time("material_specular", ms_inputCount, false, [&prop, &light, &N, &toLights, &toEyes]()
+    {
+        glm::vec3 sum(0, 0, 0);
+        for(size_t i=0; i<toLights.size(); ++i)
+            sum+=prop.colorSpecular(light, N, toLights[i], toEyes[i]);
+        return sum.x+sum.y+sum.z;
+    });
+}
+
+void Benchmark::benchmarkCamera()
+{
+    SceneCamera& camera=m_manager.sceneCamera();
+    camera.setupView(camera.currentView());
+    const SceneCamera::Rays& rays=camera.rays();
+    std::mt19937 generator(m_seed);
+    std::vector<int> xs(ms_inputCount), ys(ms_inputCount);
+    for(size_t i=0; i<ms_inputCount; ++i)
+    {
+        xs[i]=std::uniform_int_distribution<int>(0, rays.width()-1)(generator);
+        ys[i]=std::uniform_int_distribution<int>(0, rays.height()-1)(generator);
+    }
+
+    time("camera_cast_ray", ms_inputCount, true, [&camera, &xs, &ys]()
+    {
+        float sum=0.0f;
+        for(size_t i=0; i<xs.size(); ++i)
+            sum+=camera.castRayFromPixel(xs[i], ys[i]).direction().x;
+        return sum;
+    });
+}
+
+void Benchmark::benchmarkTraversal()
+{
+    //closest hits in the scene: camera rays through a grid spread over the image, which go to close places,
+    //and rays from the camera in random directions, which don't
+    m_manager.updateAccelerationStructure();
+    SceneCamera& camera=m_manager.sceneCamera();
+    camera.setupView(camera.currentView());
+    const SceneCamera::Rays& cameraRays=camera.rays();
+    const int gridSize=32;
+    std::vector<Ray> coherent, incoherent;
+    coherent.reserve(gridSize*gridSize);
+    for(int j=0; j<gridSize; ++j)
+        for(int i=0; i<gridSize; ++i)
+            coherent.push_back(cameraRays.castRay((i+0.5f)*cameraRays.width()/gridSize, (j+0.5f)*cameraRays.height()/gridSize));
+    std::mt19937 generator(m_seed);
+    std::normal_distribution<float> normal;
+    incoherent.reserve(ms_inputCount);
+    for(size_t i=0; i<ms_inputCount; ++i)
+        incoherent.push_back(Ray(cameraRays.position(),
+                                 glm::normalize(glm::vec3(normal(generator), normal(generator), normal(generator)))));
+
+    SceneManager::AccelerationBackend_t backend=m_manager.accelerationBackend();
+    const SceneManager::AccelerationBackend_t backends[2]={SceneManager::BINARY_BVH, SceneManager::WIDE_BVH};
+    const char *names[2][2]={{"bvh_camera_rays", "bvh_random_rays"}, {"bvh4_camera_rays", "bvh4_random_rays"}};
+    for(int b=0; b<2; ++b)
+    {
+        m_manager.setAccelerationBackend(backends[b]);
+        m_manager.updateAccelerationStructure();
+        const std::vector<Ray> *batches[2]={&coherent, &incoherent};
+        for(int r=0; r<2; ++r)
+        {
+            const std::vector<Ray>& batch=*batches[r];
+            const SceneManager& manager=m_manager;
+            time(names[b][r], batch.size(), true, [&manager, &batch]()
+            {
+                float distances=0.0f;
+                for(size_t i=0; i<batch.size(); ++i)
+                {
+                    SceneObject::RayHitProperties properties;
+                    manager.intersectsRay(batch[i], properties);
+                    if(properties.occuredHit)
+                        distances+=properties.distanceHit;
+                }
+                return distances;
+            });
+        }
+    }
+    m_manager.setAccelerationBackend(backend);
+}
+
+void Benchmark::print(std::ostream& stream) const
+{
+    stream << std::left << std::setw(32) << "kernel" << std::right << std::setw(14) << "ns/op"
+           << std::setw(16) << "rays/s" << std::endl;
+    for(size_t r=0; r<m_results.size(); ++r)
+    {
+        const Result_t& result=m_results[r];
+        stream << std::left << std::setw(32) << result.name << std::right << std::fixed << std::setprecision(2)
+               << std::setw(14) << result.nanosecondsPerOperation << std::setprecision(0) << std::setw(16);
+        if(result.raysPerSecond>0.0)
+            stream << result.raysPerSecond;
+        else
+            stream << "-";
+        stream << std::endl;
+    }
+    stream << std::defaultfloat;
+}
+
+bool Benchmark::write(const QString& path) const
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("Benchmark: couldn't create %s", qPrintable(path));
+        return false;
+    }
+
+#ifdef RENDER_STATS
+    const char *renderStats="true";
+#else
+    const char *renderStats="false";
+#endif
+    char line[256];
+    int size=std::snprintf(line, sizeof(line), "{\"seed\":%u,\"render_stats\":%s,\"results\":[\n", m_seed, renderStats);
+    bool written=file.write(line, size)==size;
+    for(size_t r=0; r<m_results.size() && written; ++r)
+    {
+        const Result_t& result=m_results[r];
+        size=std::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"operations\":%lu,\"ns_per_op\":%.4f,\"rays_per_second\":%.1f}%s\n",
+                           result.name, (unsigned long)result.operations, result.nanosecondsPerOperation, result.raysPerSecond,
+                           r+1<m_results.size() ? "," : "");
+        written=file.write(line, size)==size;
+    }
+    QByteArray footer("]}\n");
+    written=written && file.write(footer)==footer.size() && file.flush();
+    file.close();
+    if(!written)
+        qWarning("Benchmark: couldn't write in %s", qPrintable(path));
+    return written;
+}
@@ -0,0 +1,77 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "scenemanager.h"
+#include <QString>
+#include <ostream>
+#include <vector>
+
+///
+/// \brief The Benchmark class times the kernels of the ray tracer one by one: intersections of faces, reflection cones,
+/// integrals of faces, Phong terms, camera rays and traversals of the acceleration structure of the scene.
+/// Each kernel runs over inputs drawn from a fixed seed, as is Random::genMt19937 before each kernel, so that two versions
+/// of the renderer time the same work: the results are written as JSON to be compared across versions.
+///
+class Benchmark
+{
+public:
+
+    typedef struct
+    {
+        const char  *name;
+        size_t      operations;                 //timed in the fastest run
+        double      nanosecondsPerOperation;    //of the fastest run
+        double      raysPerSecond;              //0 for kernels which don't trace rays
+    } Result_t;
+
+    ///
+    /// \brief Benchmark benchmarks the kernels on the scene of the manager, whose camera gives the camera rays.
+    /// \param seed seed of the inputs and of the random draws of the kernels
+    ///
+    explicit Benchmark(SceneManager& manager, unsigned int seed=ms_defaultSeed);
+
+    ///
+    /// \brief run times every kernel. Each one runs until a run lasts long enough to be timed,
+    /// then keeps the fastest of a few runs, the least disturbed by the rest of the system.
+    ///
+    const std::vector<Result_t>& run();
+
+    inline const std::vector<Result_t>& results() const    {return m_results;}
+
+    /// \brief print prints the results as a table.
+    void print(std::ostream& stream) const;
+
+    ///
+    /// \brief write writes the results to a JSON file.
+    /// \return false if the file couldn't be written, in which case a warning tells why.
+    ///
+    bool write(const QString& path) const;
+
+private:
+
+    ///
+    /// \brief time times a kernel. Each call of kernel() does operationsPerCall operations,
+    /// and returns something computed from them, so that they aren't optimized out.
+    ///
+    template<class Kernel>
+    void time(const char *name, size_t operationsPerCall, bool tracesRays, Kernel kernel);
+
+    void benchmarkFaces();
+    void benchmarkCones();
+    void benchmarkIntegrals();
+    void benchmarkMaterials();
+    void benchmarkCamera();
+    void benchmarkTraversal();
+
+    SceneManager            &m_manager;
+    unsigned int            m_seed;
+    std::vector<Result_t>   m_results;
+    float                   m_sink;             //what the kernels returned
+
+    static const unsigned int   ms_defaultSeed=20160501;
+    static const size_t         ms_inputCount=1024;     //rays, directions, ... each kernel goes through
+    static const int            ms_runs=5;
+    static const double         ms_minRunTime;          //in seconds
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,493 @@
+#include "bvh.h"
+#include <chrono>
+
+const unsigned int BVH::ms_maxLeafSize;
+const unsigned int BVH::ms_stackSize;
+const unsigned int BVH::ms_noNode;
+const unsigned int BVH::ms_maxSubtreeRebuildSize;
+const unsigned int BVH::ms_maxSAHLeafSize;
+const unsigned int BVH::ms_binCount;
+const unsigned int BVH::ms_parallelBuildThreshold;
+const unsigned int BVH::ms_maxSAHDepth;
+const unsigned int BVH::ms_maxDepth;
+
+const float BVH::ms_traversalCost=1.0f;
+const float BVH::ms_intersectionCost=1.0f;
+const float BVH::ms_subtreeRebuildThreshold=2.0f;
+const float BVH::ms_rebuildThreshold=1.5f;
+
+BVH::BVH() :
+    m_nodes(),
+    m_indices(),
+    m_parents(),
+    m_leafOfPrimitive(),
+    m_builtAreas(),
+    m_weightedArea(0),
+    m_buildCost(0),
+    m_unusedNodes(0),
+    m_buildTime(0),
+    m_builder(BINNED_SAH)
+{
+}
+
+void BVH::clear()
+{
+    m_nodes.clear();
+    m_indices.clear();
+    m_parents.clear();
+    m_leafOfPrimitive.clear();
+    m_builtAreas.clear();
+    m_weightedArea=0;
+    m_buildCost=0;
+    m_unusedNodes=0;
+    m_buildTime=0;
+}
+
+void BVH::map(const Node* nodes, size_t nodeCount, const unsigned int* indices, size_t indexCount,
+              float buildCost, const std::shared_ptr<const void>& owner)
+{
+    clear();
+    m_nodes.map(nodes, nodeCount, owner);
+    m_indices.map(indices, indexCount, owner);
+    m_buildCost=buildCost;
+    m_weightedArea= m_nodes.empty() ? 0.0 : (double)buildCost*m_nodes[0].bounds.surfaceArea();
+}
+
+//build
+
+///
+/// \brief The BVH::Builder class splits the nodes of a BVH being built. Nodes are allocated by pairs from an atomic counter
+/// inside an array sized for the worst case, so that subtrees can be built concurrently on the task pool:
+/// each of them works on its own range of primitive indices and its own nodes.
+///
+class BVH::Builder
+{
+public:
+    Builder(BVH& bvh, const std::vector<AABB>& primitiveBounds, Builder_t method, TaskPool *pool) :
+        m_bvh(bvh),
+        m_primitiveBounds(primitiveBounds),
+        m_method(method),
+        m_pool(pool),
+        m_nodeCount(0)
+    {}
+
+    ///
+    /// \brief setFirstFreeNode tells where the nodes can be allocated from.
+    ///
+    inline void setFirstFreeNode(unsigned int index) {m_nodeCount=index;}
+
+    ///
+    /// \brief subdivide splits the node and its children until they are leaves.
+    /// Big children are handed to the pool as tasks of the group, the others are split right away.
+    ///
+    void subdivide(unsigned int nodeIndex, TaskPool::Group *group, unsigned int depth=0);
+
+    inline unsigned int nodeCount() const {return m_nodeCount;}
+
+private:
+
+    /// \brief chooses the SAH split of the primitives of [first, first+count) and partitions them around it.
+    /// \return the number of primitives on the left, or 0 if the node should stay a leaf.
+    unsigned int splitBinnedSAH(unsigned int first, unsigned int count, const AABB& bounds, const AABB& centroidBounds);
+
+    /// \brief partitions [first, first+count) around its median along the widest axis of the centroids.
+    unsigned int splitMedian(unsigned int first, unsigned int count, const AABB& centroidBounds);
+
+    BVH&                        m_bvh;
+    const std::vector<AABB>&    m_primitiveBounds;
+    Builder_t                   m_method;
+    TaskPool                    *m_pool;
+    std::atomic<unsigned int>   m_nodeCount;
+};
+
+void BVH::Builder::subdivide(unsigned int nodeIndex, TaskPool::Group *group, unsigned int depth)
+{
+    unsigned int *indices=&m_bvh.m_indices.mutableAt(0);
+
+    //compute the node bounds, and the bounds of the centroids to choose the split axis
+    unsigned int first=m_bvh.m_nodes[nodeIndex].leftFirst;
+    unsigned int count=m_bvh.m_nodes[nodeIndex].count;
+    AABB bounds, centroidBounds;
+    for(unsigned int i=first; i<first+count; ++i)
+    {
+        bounds.extend(m_primitiveBounds[indices[i]]);
+        centroidBounds.extend(m_primitiveBounds[indices[i]].center());
+    }
+    m_bvh.m_nodes.mutableAt(nodeIndex).bounds=bounds;
+
+    if(count<=ms_maxLeafSize)
+        return;
+
+    //past some depth, only median splits are used so that the traversal stack can't overflow
+    unsigned int leftCount = (m_method==BINNED_SAH && depth<ms_maxSAHDepth) ? splitBinnedSAH(first, count, bounds, centroidBounds)
+                                                                            : splitMedian(first, count, centroidBounds);
+    if(leftCount==0)
+        return;
+
+    unsigned int leftIndex=m_nodeCount.fetch_add(2);
+    Node& left=m_bvh.m_nodes.mutableAt(leftIndex);
+    Node& right=m_bvh.m_nodes.mutableAt(leftIndex+1);
+    left.leftFirst=first;
+    left.count=leftCount;
+    right.leftFirst=first+leftCount;
+    right.count=count-leftCount;
+
+    m_bvh.m_nodes.mutableAt(nodeIndex).leftFirst=leftIndex;
+    m_bvh.m_nodes.mutableAt(nodeIndex).count=0;
+
+    //small nodes aren't worth a task
+    if(m_pool!=NULL && group!=NULL && count>=ms_parallelBuildThreshold)
+    {
+        m_pool->run(*group, [this, leftIndex, group, depth]() {subdivide(leftIndex, group, depth+1);});
+        subdivide(leftIndex+1, group, depth+1);
+    }
+    else
+    {
+        subdivide(leftIndex, group, depth+1);
+        subdivide(leftIndex+1, group, depth+1);
+    }
+}
+
+unsigned int BVH::Builder::splitMedian(unsigned int first, unsigned int count, const AABB& centroidBounds)
+{
+    unsigned int *indices=&m_bvh.m_indices.mutableAt(0);
+    const std::vector<AABB>& primitiveBounds=m_primitiveBounds;
+
+    int axis=centroidBounds.largestAxis();
+    unsigned int half=count/2;
+    std::nth_element(indices+first, indices+first+half, indices+first+count,
+                     [&primitiveBounds, axis](unsigned int a, unsigned int b)
+                        {return primitiveBounds[a].center()[axis] < primitiveBounds[b].center()[axis];});
+    return half;
+}
+
+unsigned int BVH::Builder::splitBinnedSAH(unsigned int first, unsigned int count, const AABB& bounds, const AABB& centroidBounds)
+{
+    unsigned int *indices=&m_bvh.m_indices.mutableAt(0);
+
+    //every centroid at the same place: no plane can split them, cut the list in two instead
+    glm::vec3 centroidExtent=centroidBounds.extent();
+    if(glm::max(centroidExtent.x, glm::max(centroidExtent.y, centroidExtent.z)) <= 0.0f)
+        return count>ms_maxSAHLeafSize ? count/2 : 0;
+
+    class Bin
+    {
+    public:
+        Bin() : count(0) {}
+        AABB            bounds;
+        unsigned int    count;
+    };
+
+    float bestCost=std::numeric_limits<float>::max();
+    int bestAxis=-1;
+    unsigned int bestSplit=0;
+
+    for(int axis=0; axis<3; ++axis)
+    {
+        if(centroidExtent[axis] <= 0.0f)
+            continue;
+
+        //put every centroid in its bin
+        Bin bins[ms_binCount];
+        float scale=ms_binCount/centroidExtent[axis];
+        for(unsigned int i=first; i<first+count; ++i)
+        {
+            const AABB& box=m_primitiveBounds[indices[i]];
+            unsigned int b=std::min(ms_binCount-1, (unsigned int)((box.center()[axis]-centroidBounds.pMin[axis])*scale));
+            bins[b].bounds.extend(box);
+            ++bins[b].count;
+        }
+
+        //sweep from the right to know what is on the right of each plane, then from the left to evaluate the planes
+        float rightAreas[ms_binCount];
+        AABB rightBounds;
+        for(unsigned int b=ms_binCount-1; b>0; --b)
+        {
+            rightBounds.extend(bins[b].bounds);
+            rightAreas[b]=rightBounds.surfaceArea();
+        }
+
+        AABB leftBounds;
+        unsigned int leftCount=0;
+        for(unsigned int b=0; b<ms_binCount-1; ++b)
+        {
+            leftBounds.extend(bins[b].bounds);
+            leftCount+=bins[b].count;
+            unsigned int rightCount=count-leftCount;
+            if(leftCount==0 || rightCount==0)
+                continue;
+
+            float cost=leftBounds.surfaceArea()*leftCount + rightAreas[b+1]*rightCount;
+            if(cost<bestCost)
+            {
+                bestCost=cost;
+                bestAxis=axis;
+                bestSplit=b+1;
+            }
+        }
+    }
+
+    if(bestAxis<0)
+        return count/2;
+
+    //compare with the cost of keeping a leaf (same formula as BVH::cost)
+    float splitCost=ms_traversalCost + ms_intersectionCost*bestCost/bounds.surfaceArea();
+    float leafCost=ms_intersectionCost*count;
+    if(splitCost>=leafCost && count<=ms_maxSAHLeafSize)
+        return 0;
+
+    float scale=ms_binCount/centroidExtent[bestAxis];
+    float minCentroid=centroidBounds.pMin[bestAxis];
+    const std::vector<AABB>& primitiveBounds=m_primitiveBounds;
+    unsigned int *middle=
+            std::partition(indices+first, indices+first+count,
+                           [&primitiveBounds, bestAxis, bestSplit, scale, minCentroid](unsigned int i)
+                                {
+                                    unsigned int b=std::min(ms_binCount-1,
+                                                            (unsigned int)((primitiveBounds[i].center()[bestAxis]-minCentroid)*scale));
+                                    return b<bestSplit;
+                                });
+    return middle-(indices+first);
+}
+
+void BVH::build(const std::vector<AABB>& primitiveBounds, Builder_t builder, TaskPool *pool)
+{
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+
+    clear();
+    m_builder=builder;
+
+    for(unsigned int i=0; i<primitiveBounds.size(); ++i)
+    {
+        if(!primitiveBounds[i].isEmpty())
+            m_indices.push_back(i);
+    }
+
+    if(!m_indices.empty())
+    {
+        //a binary tree with n leaves has 2n-1 nodes, so this is the worst case
+        m_nodes.resize(2*m_indices.size()-1);
+        m_nodes.mutableAt(0).leftFirst=0;
+        m_nodes.mutableAt(0).count=m_indices.size();
+
+        Builder nodeBuilder(*this, primitiveBounds, builder, pool);
+        nodeBuilder.setFirstFreeNode(1);
+        TaskPool::Group group;
+        nodeBuilder.subdivide(0, &group);
+        if(pool!=NULL)
+            pool->wait(group);
+        m_nodes.resize(nodeBuilder.nodeCount());
+    }
+
+    finalize(primitiveBounds.size());
+
+    m_buildTime=std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+//refit
+
+void BVH::finalize(unsigned int primitiveCount)
+{
+    m_parents.assign(m_nodes.size(), ms_noNode);
+    m_leafOfPrimitive.assign(primitiveCount, ms_noNode);
+    m_builtAreas.assign(m_nodes.size(), 0.0f);
+    m_weightedArea=0;
+    if(!m_nodes.empty())
+        linkSubtree(0);
+    m_buildCost=cost();
+}
+
+void BVH::linkSubtree(unsigned int nodeIndex)
+{
+    m_parents.resize(m_nodes.size(), ms_noNode);
+    m_builtAreas.resize(m_nodes.size(), 0.0f);
+
+    unsigned int stack[ms_stackSize];
+    unsigned int stackSize=0;
+    stack[stackSize++]=nodeIndex;
+    while(stackSize>0)
+    {
+        unsigned int index=stack[--stackSize];
+        const Node& node=m_nodes[index];
+
+        m_builtAreas[index]=node.bounds.surfaceArea();
+        m_weightedArea+=m_builtAreas[index]*nodeWeight(node);
+
+        if(node.isLeaf())
+        {
+            for(unsigned int i=node.leftFirst; i<node.leftFirst+node.count; ++i)
+                m_leafOfPrimitive[m_indices[i]]=index;
+        }
+        else
+        {
+            m_parents[node.leftFirst]=index;
+            m_parents[node.leftFirst+1]=index;
+            stack[stackSize++]=node.leftFirst;
+            stack[stackSize++]=node.leftFirst+1;
+        }
+    }
+}
+
+double BVH::weightedArea(unsigned int nodeIndex) const
+{
+    double area=0;
+    unsigned int stack[ms_stackSize];
+    unsigned int stackSize=0;
+    stack[stackSize++]=nodeIndex;
+    while(stackSize>0)
+    {
+        const Node& node=m_nodes[stack[--stackSize]];
+        area+=node.bounds.surfaceArea()*nodeWeight(node);
+        if(!node.isLeaf())
+        {
+            stack[stackSize++]=node.leftFirst;
+            stack[stackSize++]=node.leftFirst+1;
+        }
+    }
+    return area;
+}
+
+unsigned int BVH::descendantCount(unsigned int nodeIndex) const
+{
+    unsigned int count=0;
+    unsigned int stack[ms_stackSize];
+    unsigned int stackSize=0;
+    stack[stackSize++]=nodeIndex;
+    while(stackSize>0)
+    {
+        const Node& node=m_nodes[stack[--stackSize]];
+        if(!node.isLeaf())
+        {
+            count+=2;
+            stack[stackSize++]=node.leftFirst;
+            stack[stackSize++]=node.leftFirst+1;
+        }
+    }
+    return count;
+}
+
+void BVH::primitiveRange(unsigned int nodeIndex, unsigned int& first, unsigned int& count) const
+{
+    //the primitives of a subtree go from those of its leftmost leaf to those of its rightmost leaf
+    unsigned int left=nodeIndex, right=nodeIndex;
+    while(!m_nodes[left].isLeaf())
+        left=m_nodes[left].leftFirst;
+    while(!m_nodes[right].isLeaf())
+        right=m_nodes[right].leftFirst+1;
+    first=m_nodes[left].leftFirst;
+    count=m_nodes[right].leftFirst+m_nodes[right].count-first;
+}
+
+void BVH::rebuildSubtree(unsigned int nodeIndex, const std::vector<AABB>& primitiveBounds)
+{
+    unsigned int first, count;
+    primitiveRange(nodeIndex, first, count);
+
+    m_weightedArea-=weightedArea(nodeIndex);
+    m_unusedNodes+=descendantCount(nodeIndex);
+
+    m_nodes.mutableAt(nodeIndex).leftFirst=first;
+    m_nodes.mutableAt(nodeIndex).count=count;
+
+    //the new nodes go after the current ones, the old nodes of the subtree are left unused until the next full build
+    unsigned int firstFreeNode=m_nodes.size();
+    m_nodes.resize(firstFreeNode+2*count);
+    Builder nodeBuilder(*this, primitiveBounds, m_builder, NULL);
+    nodeBuilder.setFirstFreeNode(firstFreeNode);
+    unsigned int depth=0;
+    for(unsigned int i=nodeIndex; m_parents[i]!=ms_noNode; i=m_parents[i])
+        ++depth;
+    nodeBuilder.subdivide(nodeIndex, NULL, depth);
+    m_nodes.resize(nodeBuilder.nodeCount());
+
+    linkSubtree(nodeIndex);
+}
+
+float BVH::cost() const
+{
+    if(m_nodes.empty())
+        return 0.0f;
+    float rootArea=m_nodes[0].bounds.surfaceArea();
+    return rootArea>0 ? float(m_weightedArea/rootArea) : 0.0f;
+}
+
+void BVH::refit(const std::vector<AABB>& primitiveBounds)
+{
+    if(m_nodes.empty())
+        return;
+
+    //children are always stored after their parent, so going backward visits them first
+    for(unsigned int i=m_nodes.size(); i-->0; )
+    {
+        Node& node=m_nodes.mutableAt(i);
+        node.bounds=AABB();
+        if(node.isLeaf())
+        {
+            for(unsigned int j=node.leftFirst; j<node.leftFirst+node.count; ++j)
+                node.bounds.extend(primitiveBounds[m_indices[j]]);
+        }
+        else
+        {
+            node.bounds.extend(m_nodes[node.leftFirst].bounds);
+            node.bounds.extend(m_nodes[node.leftFirst+1].bounds);
+        }
+    }
+
+    //nodes left unused by subtree rebuilds don't count
+    m_weightedArea=weightedArea(0);
+}
+
+void BVH::refit(const std::vector<AABB>& primitiveBounds, const std::vector<unsigned int>& movedPrimitives)
+{
+    //a mapped hierarchy doesn't come with its refit datas
+    if(m_parents.size()!=m_nodes.size())
+        finalize(primitiveBounds.size());
+
+    unsigned int degradedNode=ms_noNode;
+    unsigned int degradedCount=0;
+
+    for(std::vector<unsigned int>::const_iterator it=movedPrimitives.begin(); it!=movedPrimitives.end(); ++it)
+    {
+        if(*it>=m_leafOfPrimitive.size() || m_leafOfPrimitive[*it]==ms_noNode)
+            continue;
+
+        //walk up to the root, and stop as soon as the bounds don't change anymore
+        unsigned int index=m_leafOfPrimitive[*it];
+        while(index!=ms_noNode)
+        {
+            Node& node=m_nodes.mutableAt(index);
+            AABB bounds;
+            if(node.isLeaf())
+            {
+                for(unsigned int j=node.leftFirst; j<node.leftFirst+node.count; ++j)
+                    bounds.extend(primitiveBounds[m_indices[j]]);
+            }
+            else
+            {
+                bounds.extend(m_nodes[node.leftFirst].bounds);
+                bounds.extend(m_nodes[node.leftFirst+1].bounds);
+            }
+            if(bounds.pMin==node.bounds.pMin && bounds.pMax==node.bounds.pMax)
+                break;
+
+            m_weightedArea+=(bounds.surfaceArea()-node.bounds.surfaceArea())*nodeWeight(node);
+            node.bounds=bounds;
+
+            //keep the biggest subtree that grew too much and is still cheap to rebuild
+            if(!node.isLeaf() && bounds.surfaceArea() > ms_subtreeRebuildThreshold*m_builtAreas[index])
+            {
+                unsigned int first, count;
+                primitiveRange(index, first, count);
+                if(count<=ms_maxSubtreeRebuildSize && count>degradedCount)
+                {
+                    degradedNode=index;
+                    degradedCount=count;
+                }
+            }
+            index=m_parents[index];
+        }
+    }
+
+    if(degradedNode!=ms_noNode)
+        rebuildSubtree(degradedNode, primitiveBounds);
+}
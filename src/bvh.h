@@ -0,0 +1,230 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "aabb.h"
+#include "mappedarray.h"
+#include "sceneobject.h"
+#include "taskpool.h"
+#include "renderstats.h"
+
+///
+/// \brief The BVH class is a binary bounding volume hierarchy over a set of primitives only known by their bounds.
+/// It doesn't know what the primitives are: the owner keeps them in an array, and the traversal hands
+/// their index in this array to an intersector whenever a leaf is reached.
+/// Nodes are stored in a flat array without any pointer, the first node being the root.
+///
+class BVH
+{
+public:
+
+    class Node
+    {
+    public:
+        AABB            bounds;
+        unsigned int    leftFirst;  //index of the left child (right child is leftFirst+1), or first primitive of a leaf
+        unsigned int    count;      //number of primitives of a leaf, 0 for inner nodes
+
+        inline bool isLeaf() const {return count>0;}
+    };
+
+    ///
+    /// MEDIAN_SPLIT cuts every node in two halves, which is fast but gives poor trees on uneven scenes.
+    /// BINNED_SAH sorts the centroids in bins and picks the split with the lowest SAH cost,
+    /// which is slower to build but faster to traverse.
+    ///
+    typedef enum {MEDIAN_SPLIT, BINNED_SAH} Builder_t;
+
+    /// \brief deepest a node can be below the root: past ms_maxSAHDepth, median splits add at most 32 levels
+    static const unsigned int ms_maxDepth=126;
+
+    BVH();
+
+    ///
+    /// \brief build (re)builds the hierarchy.
+    /// \param primitiveBounds bounds of every primitive. Primitives with an empty box are left out of the hierarchy.
+    /// \param builder how nodes are split
+    /// \param pool the big subtrees are built in parallel on this pool (NULL to build on the calling thread only)
+    ///
+    void build(const std::vector<AABB>& primitiveBounds, Builder_t builder=BINNED_SAH,
+               TaskPool *pool=&TaskPool::globalInstance());
+
+    void clear();
+
+    ///
+    /// \brief map uses nodes and indices stored somewhere else, typically in a file mapped in memory (see SceneCache),
+    /// without copying them. They must come from a previous build. Refitting the hierarchy copies them first.
+    /// \param buildCost the SAH cost of the hierarchy when it was built
+    /// \param owner keeps the memory of the nodes and indices alive
+    ///
+    void map(const Node* nodes, size_t nodeCount, const unsigned int* indices, size_t indexCount,
+             float buildCost, const std::shared_ptr<const void>& owner);
+
+    ///
+    /// \brief refit recomputes the bounds of every node bottom-up, keeping the topology of the hierarchy.
+    ///
+    void refit(const std::vector<AABB>& primitiveBounds);
+
+    ///
+    /// \brief refit only updates the bounds of the given primitives' leaves and their ancestors.
+    /// Where this made a small subtree lose too much quality, the subtree is rebuilt on the spot.
+    /// A primitive whose box becomes empty (e.g. a removed object) is skipped by the traversals until the next build
+    /// leaves it out. A primitive which had an empty box at build time isn't in the hierarchy: it must keep it until then.
+    /// \param primitiveBounds bounds of every primitive
+    /// \param movedPrimitives indices of the primitives whose bounds changed
+    ///
+    void refit(const std::vector<AABB>& primitiveBounds, const std::vector<unsigned int>& movedPrimitives);
+
+    ///
+    /// \brief cost
+    /// \return the SAH cost of the hierarchy, i.e. the expected cost of a ray traversing it.
+    ///
+    float cost() const;
+
+    ///
+    /// \brief degradation
+    /// \return the ratio between the current SAH cost and the cost right after the last build.
+    ///
+    inline float degradation() const                           {return m_buildCost>0 ? cost()/m_buildCost : 1.0f;}
+
+    ///
+    /// \brief needsRebuild
+    /// \return true if refitting degraded the traversal cost enough for a full rebuild to be worth it,
+    /// or if the subtrees it rebuilt left more unused nodes than there are nodes in use (only a full build compacts them).
+    ///
+    inline bool needsRebuild() const
+        {return degradation()>ms_rebuildThreshold || m_unusedNodes>m_nodes.size()-m_unusedNodes;}
+
+    /// \brief nodes left unused by the subtrees rebuilt since the last build
+    inline size_t unusedNodes() const                           {return m_unusedNodes;}
+
+    /// \brief SAH cost right after the last build
+    inline float buildCost() const                              {return m_buildCost;}
+
+    /// \brief duration of the last build, in milliseconds
+    inline double buildTime() const                             {return m_buildTime;}
+
+    inline Builder_t builder() const                            {return m_builder;}
+
+    inline bool empty() const                                   {return m_nodes.empty();}
+    inline const AABB& bounds() const                           {return m_nodes[0].bounds;}
+
+    inline const MappedArray<Node>& nodes() const               {return m_nodes;}
+    inline const MappedArray<unsigned int>& indices() const     {return m_indices;}
+
+    /// \brief bytes taken by the nodes and primitive indices
+    inline size_t memoryFootprint() const                       {return m_nodes.size()*sizeof(Node) + m_indices.size()*sizeof(unsigned int);}
+
+    ///
+    /// \brief intersectsRay traverses the hierarchy, closest child first, and calls intersectPrimitive(index, ray, properties)
+    /// for every primitive of the leaves the ray reaches. The intersector is expected to only register closer hits,
+    /// like SceneObject::intersectsRay does.
+    ///
+    template<class Intersector>
+    void intersectsRay(const Ray& ray, SceneObject::RayHitProperties& properties, Intersector intersectPrimitive) const;
+
+private:
+
+    class Builder;
+    friend class Builder;
+
+    /// \brief computes everything refit needs once the nodes of a build are known.
+    void finalize(unsigned int primitiveCount);
+
+    /// \brief registers the parents, leaves and areas of a subtree, and adds it to the SAH cost.
+    void linkSubtree(unsigned int nodeIndex);
+
+    /// \brief sum of the areas of the nodes of a subtree, weighted by their cost.
+    double weightedArea(unsigned int nodeIndex) const;
+
+    /// \brief rebuilds a subtree from scratch, with the same primitives. Its old nodes are left unused, and counted in m_unusedNodes.
+    void rebuildSubtree(unsigned int nodeIndex, const std::vector<AABB>& primitiveBounds);
+
+    /// \brief number of nodes below a node.
+    unsigned int descendantCount(unsigned int nodeIndex) const;
+
+    /// \brief number of primitives below a node, which are contiguous in m_indices.
+    void primitiveRange(unsigned int nodeIndex, unsigned int& first, unsigned int& count) const;
+
+    inline float nodeWeight(const Node& node) const
+        {return node.isLeaf() ? node.count*ms_intersectionCost : ms_traversalCost;}
+
+    MappedArray<Node>           m_nodes;
+    MappedArray<unsigned int>   m_indices;
+
+    //refit datas, computed on the first refit of a mapped hierarchy
+
+    std::vector<unsigned int>   m_parents;              //parent of each node
+    std::vector<unsigned int>   m_leafOfPrimitive;      //leaf holding each primitive
+    std::vector<float>          m_builtAreas;           //surface area of each node when it was built
+    double                      m_weightedArea;         //sum of the areas of the nodes weighted by their cost
+    float                       m_buildCost;
+    size_t                      m_unusedNodes;          //left by subtree rebuilds, until the next build
+
+    double                      m_buildTime;
+    Builder_t                   m_builder;
+
+    static const unsigned int   ms_maxLeafSize=2;         //nodes this small are never split
+    static const unsigned int   ms_maxSAHLeafSize=8;      //nodes up to this size are kept as leaves if the SAH says so
+    static const unsigned int   ms_binCount=16;
+    static const unsigned int   ms_parallelBuildThreshold=4096;
+    static const unsigned int   ms_stackSize=ms_maxDepth+2;     //a node pushes at most 1 more node than it pops
+    static const unsigned int   ms_maxSAHDepth=ms_maxDepth-32;
+    static const unsigned int   ms_noNode=~0u;
+
+    static const float          ms_traversalCost;
+    static const float          ms_intersectionCost;
+
+    static const float          ms_subtreeRebuildThreshold; //growth of the area of a subtree triggering its rebuild
+    static const unsigned int   ms_maxSubtreeRebuildSize=4096;
+    static const float          ms_rebuildThreshold;        //degradation of the cost after which a full rebuild is advised
+};
+
+template<class Intersector>
+void BVH::intersectsRay(const Ray& ray, SceneObject::RayHitProperties& properties, Intersector intersectPrimitive) const
+{
+    if(m_nodes.empty())
+        return;
+
+    const glm::vec3 invDirection=1.0f/ray.direction();
+    unsigned int stack[ms_stackSize];
+    unsigned int stackSize=0;
+    float tNear;
+
+    if(!m_nodes[0].bounds.intersectsRay(ray.origin(), invDirection, std::numeric_limits<float>::max(), tNear))
+        return;
+    stack[stackSize++]=0;
+
+    while(stackSize>0)
+    {
+        const Node& node=m_nodes[stack[--stackSize]];
+        RENDER_STATS_ADD(nodesVisited, 1);
+        float tMax = properties.occuredHit ? properties.distanceHit : std::numeric_limits<float>::max();
+
+        if(node.isLeaf())
+        {
+            for(unsigned int i=node.leftFirst; i<node.leftFirst+node.count; ++i)
+                intersectPrimitive(m_indices[i], ray, properties);
+        }
+        else
+        {
+            float tLeft, tRight;
+            bool hitLeft=m_nodes[node.leftFirst].bounds.intersectsRay(ray.origin(), invDirection, tMax, tLeft);
+            bool hitRight=m_nodes[node.leftFirst+1].bounds.intersectsRay(ray.origin(), invDirection, tMax, tRight);
+
+            //push the furthest child first so that the closest one is visited first
+            if(hitLeft && hitRight)
+            {
+                bool leftFirst = tLeft<=tRight;
+                stack[stackSize++]=node.leftFirst + (leftFirst ? 1 : 0);
+                stack[stackSize++]=node.leftFirst + (leftFirst ? 0 : 1);
+            }
+            else if(hitLeft)
+                stack[stackSize++]=node.leftFirst;
+            else if(hitRight)
+                stack[stackSize++]=node.leftFirst+1;
+        }
+    }
+}
+
+#endif // BVH_H
@@ -0,0 +1,123 @@
+#include "bvh4.h"
+#include <cmath>
+
+static_assert(sizeof(BVH4::Node)==64, "BVH4 nodes are meant to fit in a cache line");
+
+const unsigned int BVH4::ms_stackSize;
+
+BVH4::BVH4() :
+    m_nodes(),
+    m_indices()
+{
+}
+
+void BVH4::clear()
+{
+    m_nodes.clear();
+    m_indices.clear();
+}
+
+void BVH4::build(const BVH& bvh)
+{
+    clear();
+    if(bvh.empty())
+        return;
+
+    //the leaves keep the primitive ranges of the binary leaves
+    m_indices.assign(bvh.indices().begin(), bvh.indices().end());
+    m_nodes.reserve(bvh.nodes().size()/3+1);
+    collapse(bvh, 0);
+}
+
+unsigned int BVH4::collapse(const BVH& bvh, unsigned int binaryNodeIndex)
+{
+    const MappedArray<BVH::Node>& binaryNodes=bvh.nodes();
+
+    //gather up to 4 children by opening the biggest inner child until there are enough of them
+    unsigned int children[4];
+    unsigned int childCount=0;
+    if(binaryNodes[binaryNodeIndex].isLeaf())
+        children[childCount++]=binaryNodeIndex;
+    else
+    {
+        children[childCount++]=binaryNodes[binaryNodeIndex].leftFirst;
+        children[childCount++]=binaryNodes[binaryNodeIndex].leftFirst+1;
+    }
+    while(childCount<4)
+    {
+        int biggest=-1;
+        float biggestArea=-1.0f;
+        for(unsigned int i=0; i<childCount; ++i)
+        {
+            const BVH::Node& child=binaryNodes[children[i]];
+            if(!child.isLeaf() && child.bounds.surfaceArea()>biggestArea)
+            {
+                biggest=i;
+                biggestArea=child.bounds.surfaceArea();
+            }
+        }
+        if(biggest<0)
+            break;
+        unsigned int opened=children[biggest];
+        children[biggest]=binaryNodes[opened].leftFirst;
+        children[childCount++]=binaryNodes[opened].leftFirst+1;
+    }
+
+    unsigned int nodeIndex=m_nodes.size();
+    m_nodes.push_back(Node());
+
+    Node node;
+    std::memset(&node, 0, sizeof(Node));
+    const AABB& bounds=binaryNodes[binaryNodeIndex].bounds;
+    for(int axis=0; axis<3; ++axis)
+    {
+        //the smallest power of 2 step which covers the box in 254 steps, leaving some room for rounding errors
+        float extent=bounds.pMax[axis]-bounds.pMin[axis];
+        int exponent=-126;
+        if(extent>0.0f)
+            std::frexp(extent/254.0f, &exponent);
+        exponent=std::max(-126, std::min(127, exponent));
+
+        node.origin[axis]=bounds.pMin[axis];
+        node.exponent[axis]=(signed char)exponent;
+    }
+
+    for(unsigned int i=0; i<childCount; ++i)
+    {
+        const BVH::Node& child=binaryNodes[children[i]];
+        for(int axis=0; axis<3; ++axis)
+        {
+            //round outward, so that the quantized box always contains the real one
+            float step=quantizationStep(node.exponent[axis]);
+            float qMin=std::floor((child.bounds.pMin[axis]-node.origin[axis])/step);
+            float qMax=std::ceil((child.bounds.pMax[axis]-node.origin[axis])/step);
+            qMin=std::max(0.0f, std::min(255.0f, qMin));
+            qMax=std::max(0.0f, std::min(255.0f, qMax));
+            while(qMin>0.0f && node.origin[axis]+qMin*step > child.bounds.pMin[axis])
+                qMin-=1.0f;
+            while(qMax<255.0f && node.origin[axis]+qMax*step < child.bounds.pMax[axis])
+                qMax+=1.0f;
+            node.qMin[axis][i]=(unsigned char)qMin;
+            node.qMax[axis][i]=(unsigned char)qMax;
+        }
+        //children emptied by a refit (removed primitives) are never entered
+        if(child.bounds.isEmpty())
+            continue;
+        node.validMask|=1<<i;
+        if(child.isLeaf())
+        {
+            if(child.count>255)
+                ERROR("BVH4: leaves of the binary BVH can't hold more than 255 primitives");
+            node.child[i]=child.leftFirst;
+            node.count[i]=child.count;
+        }
+        else
+        {
+            node.child[i]=collapse(bvh, children[i]);
+            node.count[i]=0;
+        }
+    }
+
+    m_nodes[nodeIndex]=node;
+    return nodeIndex;
+}
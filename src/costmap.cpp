@@ -0,0 +1,146 @@
+#include "costmap.h"
+#include "tiledimagewriter.h"
+#include <algorithm>
+
+const float CostMap::ms_percentile=0.99f;
+const float CostMap::ms_overlayOpacity=0.7f;
+
+CostMap::Probe::Probe(CostMap *map) :
+    m_map(map),
+    m_counters(),
+    m_start()
+{
+    if(m_map!=NULL)
+    {
+        m_counters=RenderStats::local();
+        m_start=Clock::now();
+    }
+}
+
+void CostMap::Probe::addTo(int x, int y) const
+{
+    if(m_map==NULL)
+        return;
+    uint64_t nanoseconds=std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()-m_start).count();
+    const RenderStats::Counters_t& counters=RenderStats::local();
+    PixelCost_t& cost=m_map->m_pixels[(size_t)y*m_map->m_width+x];
+    cost.intersectionTests  += counters.intersectionTests - m_counters.intersectionTests;
+    cost.rays               += (counters.primaryRays - m_counters.primaryRays)
+                             + (counters.shadowRays - m_counters.shadowRays)
+                             + (counters.reflectionRays - m_counters.reflectionRays);
+    cost.samples            += counters.lightSamples - m_counters.lightSamples;
+    cost.nanoseconds        += nanoseconds;
+}
+
+CostMap::CostMap() :
+    m_width(0),
+    m_height(0),
+    m_pixels()
+{}
+
+void CostMap::resize(int width, int height)
+{
+    m_width=width;
+    m_height=height;
+    m_pixels.assign((size_t)width*height, PixelCost_t());
+}
+
+void CostMap::clearRect(int x, int y, int width, int height)
+{
+    int xEnd=std::min(x+width, m_width), yEnd=std::min(y+height, m_height);
+    for(int j=std::max(y, 0); j<yEnd; ++j)
+        for(int i=std::max(x, 0); i<xEnd; ++i)
+            m_pixels[(size_t)j*m_width+i]=PixelCost_t();
+}
+
+uint32_t CostMap::value(const PixelCost_t& cost, Channel_t channel)
+{
+    switch(channel)
+    {
+    case INTERSECTION_TESTS:
+        return cost.intersectionTests;
+    case RAYS:
+        return cost.rays;
+    case SAMPLES:
+        return cost.samples;
+    default: //time
+        return cost.nanoseconds;
+    }
+}
+
+const char *CostMap::channelName(Channel_t channel)
+{
+    static const char *names[CHANNEL_COUNT]={"tests", "rays", "samples", "time"};
+    return channel<CHANNEL_COUNT ? names[channel] : "";
+}
+
+void CostMap::heatColor(float t, unsigned char *rgb)
+{
+    static const float stops[5][3]={{0.0f, 0.0f, 0.0f}, {0.5f, 0.0f, 0.6f}, {0.9f, 0.1f, 0.1f}, {1.0f, 0.85f, 0.0f}, {1.0f, 1.0f, 1.0f}};
+    t=std::min(std::max(t, 0.0f), 1.0f)*4.0f;
+    int stop=std::min((int)t, 3);
+    float f=t-stop;
+    for(int c=0; c<3; ++c)
+        rgb[c]=(unsigned char)(255.0f*(stops[stop][c] + (stops[stop+1][c]-stops[stop][c])*f) + 0.5f);
+}
+
+QImage CostMap::heatmap(Channel_t channel) const
+{
+    QImage image(m_width, m_height, QImage::Format_RGB888);
+    if(m_pixels.empty())
+        return image;
+
+    std::vector<uint32_t> values(m_pixels.size());
+    for(size_t p=0; p<m_pixels.size(); ++p)
+        values[p]=value(m_pixels[p], channel);
+    std::vector<uint32_t> sorted(values);
+    std::vector<uint32_t>::iterator percentile=sorted.begin() + (size_t)(ms_percentile*(sorted.size()-1));
+    std::nth_element(sorted.begin(), percentile, sorted.end());
+    float scale = *percentile>0 ? 1.0f/(*percentile) : 0.0f;
+
+    unsigned char rgb[3];
+    for(int y=0; y<m_height; ++y)
+        for(int x=0; x<m_width; ++x)
+        {
+            heatColor(values[(size_t)y*m_width+x]*scale, rgb);
+            image.setPixel(x, y, qRgb(rgb[0], rgb[1], rgb[2]));
+        }
+    return image;
+}
+
+QImage CostMap::overlay(const QImage& image, Channel_t channel) const
+{
+    QImage heat=heatmap(channel);
+    if(image.width()!=m_width || image.height()!=m_height)
+        return heat;
+    for(int y=0; y<m_height; ++y)
+        for(int x=0; x<m_width; ++x)
+        {
+            QRgb color=image.pixel(x, y), h=heat.pixel(x, y);
+            float luminance=(1.0f-ms_overlayOpacity)*(0.2126f*qRed(color) + 0.7152f*qGreen(color) + 0.0722f*qBlue(color));
+            heat.setPixel(x, y, qRgb((int)(luminance + ms_overlayOpacity*qRed(h)),
+                                     (int)(luminance + ms_overlayOpacity*qGreen(h)),
+                                     (int)(luminance + ms_overlayOpacity*qBlue(h))));
+        }
+    return heat;
+}
+
+bool CostMap::write(const QString& path, Channel_t channel) const
+{
+    QImage heat=heatmap(channel);
+    std::vector<unsigned char> rgb((size_t)m_width*m_height*3);
+    for(int y=0; y<m_height; ++y)
+        for(int x=0; x<m_width; ++x)
+        {
+            QRgb color=heat.pixel(x, y);
+            unsigned char *pixel=&rgb[((size_t)y*m_width+x)*3];
+            pixel[0]=qRed(color);
+            pixel[1]=qGreen(color);
+            pixel[2]=qBlue(color);
+        }
+    TiledImageWriter writer;
+    if(!writer.open(path, m_width, m_height))
+        return false;
+    bool written=writer.writeTile(0, 0, m_width, m_height, rgb.data());
+    return writer.close() && written;
+}
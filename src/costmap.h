@@ -0,0 +1,97 @@
+#ifndef COSTMAP_H
+#define COSTMAP_H
+
+#include "renderstats.h"
+#include <QImage>
+#include <QString>
+#include <vector>
+#include <chrono>
+
+///
+/// \brief The CostMap class records what each pixel of a rendering cost: the intersection tests, the rays and the light
+/// samples of the rays cast for it, and the time spent on it. It is an output of the renderer next to the image,
+/// shown in false colors to tell which parts of the image take the time (glossy reflections, penumbrae, dense geometry).
+/// The counts come from the counters of RenderStats, so they are only recorded in builds with RENDER_STATS:
+/// the other builds only record the times.
+///
+class CostMap
+{
+public:
+
+    typedef enum {INTERSECTION_TESTS=0, RAYS, SAMPLES, TIME, CHANNEL_COUNT} Channel_t;
+
+    typedef struct
+    {
+        uint32_t    intersectionTests;
+        uint32_t    rays;                   //primary, shadow and reflection rays
+        uint32_t    samples;                //light samples
+        uint32_t    nanoseconds;
+    } PixelCost_t;
+
+    ///
+    /// \brief The Probe class measures what the calling thread does for a pixel, from its construction to addTo().
+    /// A probe of no map (NULL) measures nothing, so that renderings without a cost map only pay for a test.
+    ///
+    class Probe
+    {
+    public:
+        explicit Probe(CostMap *map);
+
+        /// \brief addTo adds what was done since the construction of the probe to the cost of pixel (x,y).
+        void addTo(int x, int y) const;
+
+    private:
+        typedef std::chrono::steady_clock   Clock;
+
+        CostMap                 *m_map;
+        RenderStats::Counters_t m_counters;
+        Clock::time_point       m_start;
+    };
+
+    CostMap();
+
+    /// \brief resize sets the size of the map, whose pixels cost nothing yet.
+    void resize(int width, int height);
+
+    /// \brief clearRect sets the costs of the pixels of a rectangle back to 0, before they are rendered again.
+    void clearRect(int x, int y, int width, int height);
+
+    inline int width() const                                {return m_width;}
+    inline int height() const                               {return m_height;}
+    inline bool isEmpty() const                             {return m_pixels.empty();}
+    inline const PixelCost_t& pixel(int x, int y) const     {return m_pixels[(size_t)y*m_width+x];}
+
+    static uint32_t value(const PixelCost_t& cost, Channel_t channel);
+
+    /// \brief channelName is a short name of the channel, for files and menus.
+    static const char *channelName(Channel_t channel);
+
+    ///
+    /// \brief heatmap is the channel in false colors, from black to purple, red, yellow and white.
+    /// The colors are scaled to the 99th percentile of the channel, so that a few outliers don't turn the rest black.
+    ///
+    QImage heatmap(Channel_t channel) const;
+
+    /// \brief overlay is the heatmap of the channel blended over the luminance of the rendered image.
+    QImage overlay(const QImage& image, Channel_t channel) const;
+
+    ///
+    /// \brief write writes the heatmap of the channel to a binary PPM file.
+    /// \return false if the file couldn't be written, in which case a warning tells why.
+    ///
+    bool write(const QString& path, Channel_t channel) const;
+
+private:
+
+    /// \brief heatColor is the false color of t in [0,1].
+    static void heatColor(float t, unsigned char *rgb);
+
+    int                         m_width;
+    int                         m_height;
+    std::vector<PixelCost_t>    m_pixels;
+
+    static const float          ms_percentile;      //of the values the heatmaps are scaled to
+    static const float          ms_overlayOpacity;
+};
+
+#endif // COSTMAP_H
@@ -6,6 +6,7 @@ Dialog_RenderedImage::Dialog_RenderedImage(QWidget *parent) :
     ui(new Ui::Dialog_RenderedImage)
 {
     ui->setupUi(this);
+    ui->comboBox_layer->hide();
 }
 
 Dialog_RenderedImage::~Dialog_RenderedImage()
@@ -15,5 +16,30 @@ Dialog_RenderedImage::~Dialog_RenderedImage()
 
 void Dialog_RenderedImage::setImage(const QImage *image)
 {
-    ui->label_image->setPixmap(QPixmap::fromImage(*image));
+    m_image=QPixmap::fromImage(*image);
+    if(ui->comboBox_layer->currentIndex()>0)
+        ui->comboBox_layer->setCurrentIndex(0);
+    ui->label_image->setPixmap(m_image);
+}
+
+void Dialog_RenderedImage::setOverlays(const QStringList& names, const std::vector<QImage>& overlays)
+{
+    m_overlays.clear();
+    for(std::vector<QImage>::const_iterator it=overlays.begin(); it!=overlays.end(); ++it)
+        m_overlays.push_back(QPixmap::fromImage(*it));
+    ui->comboBox_layer->blockSignals(true);
+    ui->comboBox_layer->clear();
+    ui->comboBox_layer->addItem(tr("Image"));
+    ui->comboBox_layer->addItems(names);
+    ui->comboBox_layer->blockSignals(false);
+    ui->comboBox_layer->setVisible(!m_overlays.empty());
+    ui->label_image->setPixmap(m_image);
+}
+
+void Dialog_RenderedImage::on_comboBox_layer_currentIndexChanged(int index)
+{
+    if(index>0 && index<=(int)m_overlays.size())
+        ui->label_image->setPixmap(m_overlays[index-1]);
+    else
+        ui->label_image->setPixmap(m_image);
 }
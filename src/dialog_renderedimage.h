@@ -2,6 +2,9 @@
 #define DIALOG_RENDEREDIMAGE_H
 
 #include <QDialog>
+#include <QPixmap>
+#include <QStringList>
+#include <vector>
 
 namespace Ui {
 class Dialog_RenderedImage;
@@ -17,8 +20,19 @@ public:
 
     void setImage(const QImage *image);
 
+    ///
+    /// \brief setOverlays gives images to show instead of the rendered one (e.g. the heatmaps of a CostMap),
+    /// picked by their name in a list above the image. The list is hidden when there are none.
+    ///
+    void setOverlays(const QStringList& names, const std::vector<QImage>& overlays);
+
+private slots:
+    void on_comboBox_layer_currentIndexChanged(int index);
+
 private:
     Ui::Dialog_RenderedImage *ui;
+    QPixmap                     m_image;
+    std::vector<QPixmap>        m_overlays;
 };
 
 #endif // DIALOG_RENDEREDIMAGE_H
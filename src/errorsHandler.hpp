@@ -5,8 +5,9 @@
 #include <random>
 
 namespace Random {
-static std::random_device rd;
-static std::mt19937 genMt19937(rd());
+//one generator per thread, renderings run on several threads (defined in ray.cpp).
+//A thread seeds its own with genMt19937.seed() to replay the same draws, as the benchmarks do.
+extern thread_local std::mt19937 genMt19937;
 }
 
 #define ERROR_UNKNOWN do {qFatal("An unknown critical error occured.");} while(0)
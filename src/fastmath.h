@@ -0,0 +1,101 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+///
+/// \brief The ExactMath struct gives the functions of the shading kernels through the standard library.
+///
+struct ExactMath
+{
+    static inline float inverseSqrt(float x)            {return 1.0f/std::sqrt(x);}
+    static inline float pow(float x, float y)           {return std::pow(x, y);}
+};
+
+///
+/// \brief The FastMath struct gives approximations of the functions of the shading kernels (see SceneManager::setFastMath()).
+/// The error bounds below were measured over the ranges the kernels use them on.
+///
+struct FastMath
+{
+    ///
+    /// \brief inverseSqrt is the bit trick estimate of 1/sqrt(x) refined by two Newton steps, for x>0.
+    /// Relative error below 5e-6: a direction normalized with it keeps its direction exactly, its length is within 5e-6 of 1.
+    /// A single step leaves 1.8e-3, which the specular powers raise to visible errors (10 levels of 255 for a power of 300).
+    ///
+    static inline float inverseSqrt(float x)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(float));
+        bits=0x5f3759dfu - (bits>>1);
+        float y;
+        std::memcpy(&y, &bits, sizeof(float));
+        y=y*(1.5f - 0.5f*x*y*y);
+        return y*(1.5f - 0.5f*x*y*y);
+    }
+
+    ///
+    /// \brief log2 splits x>0 (not denormal) into its exponent and a mantissa 1+u, u in [0,1[, whose logarithm is
+    /// u times a polynomial of degree 6 fitted on [0,1[. Absolute error below 5e-7.
+    ///
+    static inline float log2(float x)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(float));
+        float exponent=(float)((int)(bits>>23) - 127);
+        bits=(bits & 0x007FFFFFu) | 0x3F800000u;
+        float u;
+        std::memcpy(&u, &bits, sizeof(float));
+        u-=1.0f;
+        return exponent + u*(1.44266783f + u*(-0.720585521f + u*(0.473553727f + u*(-0.32590287f
+                            + u*(0.194295618f + u*(-0.0795586581f + u*0.0155301779f))))));
+    }
+
+    ///
+    /// \brief exp2 splits x into its floor, put in the exponent, and f in [0,1[, whose power is a polynomial
+    /// of degree 5 fitted on [0,1[. Relative error below 2e-7 over [-125,128[, x being clamped to it
+    /// (results below 2^-125 are not denormal, they are off by the clamp).
+    ///
+    static inline float exp2(float x)
+    {
+        x=std::min(std::max(x, -125.0f), 127.999f);
+        int floor=(int)(x+128.0f)-128;                      //rounds towards 0, which is the floor for positive numbers
+        float f=x-(float)floor;
+        float p=0.999999925f + f*(0.693153073f + f*(0.240153617f + f*(0.0558263192f + f*(0.00898933875f + f*0.00187757723f))));
+        uint32_t bits=(uint32_t)(floor+127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(float));
+        return p*scale;
+    }
+
+    ///
+    /// \brief polynomialPow is exp2(y*log2(x)) for x>=0, the specular terms being powers of cosines.
+    /// The absolute error of log2 is multiplied by y: the relative error is below 2e-4 for exponents up to 300,
+    /// over results above 1e-30.
+    ///
+    static inline float polynomialPow(float x, float y)
+    {
+        if(x<=0.0f)
+            return y==0.0f ? 1.0f : 0.0f;
+        return exp2(y*log2(x));
+    }
+
+    ///
+    /// \brief pow is the power of the shading kernels: polynomialPow(), but for the libraries whose powf is faster.
+    /// The powf of glibc 2.28 and later (tables and a polynomial in double precision, correctly rounded in most cases)
+    /// takes 7 to 8 ns against 12 to 13 for polynomialPow() on x86-64, whose latency is its two dependent polynomials.
+    ///
+    static inline float pow(float x, float y)
+    {
+#if defined(__GLIBC__) && (__GLIBC__>2 || (__GLIBC__==2 && __GLIBC_MINOR__>=28))
+        return std::pow(x, y);
+#else
+        return polynomialPow(x, y);
+#endif
+    }
+};
+
+#endif // FASTMATH_H
@@ -0,0 +1,13 @@
+#version 330
+
+uniform sampler2D u_image;
+
+in vec2 frag_texCoord;
+
+out vec4 out_fragColor;
+
+
+void main()
+{
+     out_fragColor=vec4(texture(u_image, frag_texCoord).rgb, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330
+
+//a quad over the whole viewport, without any vertex attribute: its corners come from the vertex index
+
+out vec2 frag_texCoord;
+
+void main()
+{
+        vec2 corner = vec2(gl_VertexID & 1, (gl_VertexID >> 1) & 1);
+        //the rows of the image go from the top to the bottom
+        frag_texCoord = vec2(corner.x, 1.0 - corner.y);
+        gl_Position = vec4(corner*2.0 - 1.0, 0.0, 1.0);
+}
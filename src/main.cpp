@@ -1,10 +1,14 @@
 #include <QApplication>
 #include "errorsHandler.hpp"
+#include "trace.h"
 
 #ifdef USE_QGLVIEWER
 #include "viewer.h"
 #else
 #include "scenemanager.h"
+#include "sceneloader.h"
+#include "benchmark.h"
+#include <iostream>
 #endif
 
 
@@ -12,6 +16,18 @@ int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    //--trace <file> records a timeline of the renderings, tiles, tasks and frames, written to file as a Chrome trace on exit (see Trace).
+    QStringList arguments=a.arguments();
+    QString tracePath;
+    int traceIndex=arguments.indexOf("--trace");
+    if(traceIndex>0 && traceIndex+1<arguments.size())
+    {
+        tracePath=arguments[traceIndex+1];
+        arguments.removeAt(traceIndex+1);
+        arguments.removeAt(traceIndex);
+        Trace::setEnabled(true);
+    }
+
 #ifdef USE_QGLVIEWER
     QGLFormat glFormat;
     glFormat.setVersion( 3, 3 );
@@ -26,15 +42,93 @@ int main(int argc, char *argv[])
     qglviewer_fake::Camera camera;
     SceneManager manager(camera, 0, 0, 0, 0);
 
-    manager.setup();
+    //a scene (.json) or a mesh (.obj) can be given as first argument, the default scene is used otherwise.
+    //The rendered image is streamed to the PPM file given as second argument, if any, instead of being shown.
+    //A third argument gives a time budget in seconds, which the rendering picks its number of samples for.
+    SceneLoader loader;
+    loader.setCacheEnabled(true);
+    //--fast-math renders with the approximations of FastMath, --compare-fast-math compares the image they give with the exact one.
+    //--cost-map records the cost of each pixel, and writes its heatmaps next to the image (see CostMap).
+    //--benchmark <file> times the kernels of the ray tracer on the scene instead of rendering it, and writes the results
+    //to file as JSON (see Benchmark).
+    bool fastMath=arguments.removeAll("--fast-math")>0;
+    bool compareFastMath=arguments.removeAll("--compare-fast-math")>0;
+    manager.setFastMath(fastMath);
+    manager.setCostMap(arguments.removeAll("--cost-map")>0);
+    QString benchmarkPath;
+    int benchmarkIndex=arguments.indexOf("--benchmark");
+    if(benchmarkIndex>0 && benchmarkIndex+1<arguments.size())
+    {
+        benchmarkPath=arguments[benchmarkIndex+1];
+        arguments.removeAt(benchmarkIndex+1);
+        arguments.removeAt(benchmarkIndex);
+    }
+    if(arguments.size()>1 && loader.load(arguments[1], manager))
+        loader.setupCamera(camera);
+    else
+        manager.setup();
+
+    if(arguments.size()>2)
+        manager.sceneCamera().setOutputFile(arguments[2]);
 
     //manager.myFirstRendering();
-    manager.mainRendering(10, SceneObject::Integral::UNIFORM_RANDOM, M_PI/8.0f, 5);
+    if(!benchmarkPath.isEmpty())
+    {
+        Benchmark benchmark(manager);
+        benchmark.run();
+        benchmark.print(std::cout);
+        bool written=benchmark.write(benchmarkPath);
+        if(!tracePath.isEmpty())
+            Trace::write(tracePath);
+        return written ? 0 : 1;
+    }
+    else if(compareFastMath)
+    {
+        SceneManager::FastMathReport_t report=manager.compareFastMath(10, 5);
+        std::cout << "fast math: rendered in " << report.fastTime << "s instead of " << report.exactTime << "s, "
+                  << report.differingPixels << " pixels differ, by " << report.maxError << " at most and "
+                  << report.meanError << " on average (PSNR " << report.psnr << " dB)" << std::endl;
+    }
+    else if(arguments.size()>3)
+    {
+        SceneManager::BudgetReport_t report=manager.budgetedRendering(arguments[3].toDouble(), M_PI/8.0f, 10, 5);
+        std::cout << "rendered in " << report.renderTime << "s (pilot " << report.pilotTime << "s): "
+                  << report.passes << " passes, " << report.samplesPerPixel << " samples per pixel, "
+                  << report.lightSamplesPerPixel << " light samples per pixel, last pass with quality "
+                  << report.quality << " and " << report.reflectionQuality << " reflection rays" << std::endl;
+    }
+    else
+    {
+        //the edges get 4 more rays per pixel, and the camera rays are rasterized
+        manager.setAntialiasing(4);
+        manager.setPrimaryVisibility(SceneManager::RASTERIZED_VISIBILITY);
+        SceneManager::RenderStats_t stats=manager.mainRendering(10, SceneObject::Integral::UNIFORM_RANDOM, M_PI/8.0f, 5);
+        std::cout << "rendered in " << stats.totalTime << "s: acceleration structure " << stats.accelerationTime
+                  << "s, rasterization " << stats.visibilityTime << "s, shading " << stats.shadingTime
+                  << "s, output " << stats.outputTime << "s" << std::endl;
+#ifdef RENDER_STATS
+        const RenderStats::Counters_t& counters=stats.counters;
+        std::cout << counters.primaryRays << " primary rays, " << counters.shadowRays << " shadow rays ("
+                  << (counters.shadowRays>0 ? 100.0*counters.occludedShadowRays/counters.shadowRays : 0.0) << "% occluded), "
+                  << counters.reflectionRays << " reflection rays, " << counters.lightSamples << " light samples, "
+                  << counters.intersectionTests << " intersection tests, " << counters.nodesVisited << " nodes visited" << std::endl;
+#endif
+    }
+
+    if(arguments.size()>2)
+    {
+        if(!tracePath.isEmpty())
+            Trace::write(tracePath);
+        return 0;
+    }
 
 #endif
 
 
 
-    return a.exec();
+    int result=a.exec();
+    if(!tracePath.isEmpty())
+        Trace::write(tracePath);
+    return result;
 
 }
@@ -0,0 +1,99 @@
+#ifndef MAPPEDARRAY_H
+#define MAPPEDARRAY_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+///
+/// \brief The MappedArray class is an array of plain datas which either owns its elements, like a std::vector,
+/// or reads them from memory it doesn't own, typically a file mapped in memory (see SceneCache).
+/// Mapped elements are never copied unless the array is modified, in which case they are copied first.
+/// The memory is kept alive by a shared owner, so that arrays can outlive whoever mapped them.
+/// Elements must be plain datas without any pointer.
+///
+template<class T>
+class MappedArray
+{
+public:
+
+    typedef T value_type;
+    typedef const T* const_iterator;
+
+    MappedArray() :
+        m_owned(), m_mapped(), m_data(NULL), m_size(0)
+    {}
+
+    MappedArray(const MappedArray& other) :
+        m_owned(other.m_owned), m_mapped(other.m_mapped), m_data(NULL), m_size(other.m_size)
+    {
+        m_data = m_mapped ? other.m_data : m_owned.data();
+    }
+
+    MappedArray& operator=(const MappedArray& other)
+    {
+        m_owned=other.m_owned;
+        m_mapped=other.m_mapped;
+        m_size=other.m_size;
+        m_data = m_mapped ? other.m_data : m_owned.data();
+        return *this;
+    }
+
+    ///
+    /// \brief map reads the elements from data, which stays valid as long as owner lives.
+    ///
+    void map(const T* data, size_t size, const std::shared_ptr<const void>& owner)
+    {
+        m_owned.clear();
+        m_owned.shrink_to_fit();
+        m_mapped=owner;
+        m_data=const_cast<T*>(data);
+        m_size=size;
+    }
+
+    inline bool isMapped() const                        {return (bool)m_mapped;}
+
+    //read access, from wherever the elements are
+
+    inline size_t size() const                          {return m_size;}
+    inline bool empty() const                           {return m_size==0;}
+    inline const T& operator[](size_t i) const          {return m_data[i];}
+    inline const T& back() const                        {return m_data[m_size-1];}
+    inline const T* data() const                        {return m_data;}
+    inline const_iterator begin() const                 {return m_data;}
+    inline const_iterator end() const                   {return m_data+m_size;}
+
+    //write access, which first brings mapped elements into the array: named apart from the read access,
+    //so that reading through a non-const array never copies it (nor races with another reader doing so)
+
+    inline T& mutableAt(size_t i)                       {detach(); return m_data[i];}
+    inline T& mutableBack()                             {detach(); return m_data[m_size-1];}
+
+    void push_back(const T& value)                      {detach(); m_owned.push_back(value); sync();}
+    void resize(size_t size)                            {detach(); m_owned.resize(size); sync();}
+    void resize(size_t size, const T& value)            {detach(); m_owned.resize(size, value); sync();}
+    void assign(size_t size, const T& value)            {m_mapped.reset(); m_owned.assign(size, value); sync();}
+    void reserve(size_t size)                           {detach(); m_owned.reserve(size); sync();}
+    void clear()                                        {m_mapped.reset(); m_owned.clear(); sync();}
+
+private:
+
+    inline void detach()
+    {
+        if(m_mapped)
+        {
+            m_owned.assign(m_data, m_data+m_size);
+            m_mapped.reset();
+            sync();
+        }
+    }
+
+    inline void sync()                                  {m_data=m_owned.data(); m_size=m_owned.size();}
+
+    std::vector<T>                  m_owned;
+    std::shared_ptr<const void>     m_mapped;   //keeps the mapped memory alive, empty if the elements are owned
+    T                               *m_data;    //elements, owned or mapped
+    size_t                          m_size;
+};
+
+#endif // MAPPEDARRAY_H
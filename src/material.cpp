@@ -0,0 +1,28 @@
+#include "material.h"
+#include <algorithm>
+#include <cmath>
+
+glm::vec3 MaterialProp::colorAmbiant(const LightSource &light) const
+{
+    return light.lightProperties().vAmbiant * m_materialProperties.vAmbiant;
+}
+
+glm::vec3 MaterialProp::colorDiffuse(const LightSource &light, const glm::vec3 &N, const glm::vec3 &L) const
+{
+    // calculation as for Lambertian reflection
+    float NdotL = glm::dot(N , L);
+    float diffuseTerm = std::max(0.0f, NdotL); //0 <= diffuseTerm <= 1
+
+    return light.lightProperties().vDiffuse * diffuseTerm * m_materialProperties.vDiffuse;
+}
+
+glm::vec3 MaterialProp::colorSpecular(const LightSource &light, const glm::vec3 &N, const glm::vec3 &L, const glm::vec3 &vToEye) const
+{
+    //get light reflected from the surface
+    glm::vec3 reflectedL = glm::reflect(-L , N);
+
+    float specularTerm = std::pow( std::max(0.0f, glm::dot(reflectedL, vToEye)), m_materialProperties.fSpecularPower );
+    //0 <= specularTerm <= 1
+
+    return m_materialProperties.vSpecular * specularTerm * light.lightProperties().vSpecular;
+}
@@ -0,0 +1,62 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glm/glm.hpp>
+
+class LightSource;
+
+///
+/// \brief The MaterialProp class gives phong material properties to a scene object for advanced rendering.
+/// It is meant to be inherited along with SceneObject (see SceneFace_Prop).
+///
+class MaterialProp
+{
+public:
+
+    typedef struct
+    {
+        glm::vec3   vAmbiant;
+        glm::vec3   vDiffuse;
+        glm::vec3   vSpecular;
+        float       fSpecularPower;
+        float       fReflectionPower;
+    } MaterialProperties_t;
+
+    virtual ~MaterialProp() {}
+
+    inline void setMaterialProperties(const MaterialProperties_t& properties)   {m_materialProperties=properties;}
+    inline const MaterialProperties_t& materialProperties() const               {return m_materialProperties;}
+
+    glm::vec3 colorAmbiant(const LightSource &light) const;
+    glm::vec3 colorDiffuse(const LightSource &light, const glm::vec3 &N, const glm::vec3 &L) const;
+    glm::vec3 colorSpecular(const LightSource &light, const glm::vec3 &N, const glm::vec3 &L, const glm::vec3 &vToEye) const;
+
+protected:
+    MaterialProperties_t                m_materialProperties;       //properties of material in the scene
+};
+
+///
+/// \brief The LightSource class gives phong light properties to a scene object for advanced rendering.
+/// It is meant to be inherited along with SceneObject (see SceneFace_Light), whose integral gives the sample positions on the light.
+///
+class LightSource
+{
+public:
+
+    typedef struct
+    {
+        glm::vec3   vAmbiant;
+        glm::vec3   vDiffuse;
+        glm::vec3   vSpecular;
+    } LightProperties_t;
+
+    virtual ~LightSource() {}
+
+    inline void setLightProperties(const LightProperties_t& properties)     {m_lightProperties=properties;}
+    inline const LightProperties_t& lightProperties() const                 {return m_lightProperties;}
+
+protected:
+    LightProperties_t                   m_lightProperties;          //properties of light source in the scene
+};
+
+#endif // MATERIAL_H
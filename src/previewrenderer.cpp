@@ -0,0 +1,384 @@
+#include "previewrenderer.h"
+#include "taskpool.h"
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+const int PreviewRenderer::ms_tileSize=64;
+const int PreviewRenderer::ms_coarsestBlock=8;
+const unsigned char PreviewRenderer::ms_noFootprint=0xff;
+
+PreviewRenderer::PreviewRenderer(SceneManager& manager) :
+    m_manager(manager),
+    m_maxSamples(64),
+    m_mutex(),
+    m_wakeUp(),
+    m_idle(),
+    m_requestedView(),
+    m_requestedSettings(),
+    m_hasView(false),
+    m_version(0),
+    m_paused(false),
+    m_stopping(false),
+    m_rendering(false),
+    m_frameCallback(),
+    m_renderedVersion(0),
+    m_settings(),
+    m_view(),
+    m_rays(),
+    m_viewValid(false),
+    m_level(0),
+    m_passSamples(0),
+    m_frameMutex(),
+    m_frame(),
+    m_changedTiles(),
+    m_frameChanged(false),
+    m_frameSamples(0)
+{
+    //one light sample and one reflection ray, which is enough to see where things are going
+    m_requestedSettings.firstRendering=false;
+    m_requestedSettings.quality=1;
+    m_requestedSettings.typeIntegral=SceneObject::Integral::UNIFORM_RANDOM;
+    m_requestedSettings.reflectionAngle=M_PI/8.0f;
+    m_requestedSettings.reflectionQuality=1;
+
+    m_thread=std::thread(&PreviewRenderer::work, this);
+}
+
+PreviewRenderer::~PreviewRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping=true;
+    }
+    m_wakeUp.notify_all();
+    m_thread.join();
+}
+
+void PreviewRenderer::setView(const SceneCamera::View& view)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requestedView=view;
+        m_hasView=true;
+        ++m_version;
+    }
+    m_wakeUp.notify_all();
+}
+
+void PreviewRenderer::setSettings(const SceneManager::RenderSettings_t& settings)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requestedSettings=settings;
+}
+
+SceneManager::RenderSettings_t PreviewRenderer::settings()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_requestedSettings;
+}
+
+void PreviewRenderer::setMaxSamples(unsigned int samples)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_maxSamples=std::max(samples, 1u);
+    }
+    m_wakeUp.notify_all();
+}
+
+void PreviewRenderer::pause()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_paused=true;
+    m_idle.wait(lock, [this]{return !m_rendering;});
+}
+
+void PreviewRenderer::resume()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_paused=false;
+        //the scene may have changed, nothing rendered so far can be kept
+        m_viewValid=false;
+        ++m_version;
+    }
+    m_wakeUp.notify_all();
+}
+
+void PreviewRenderer::setFrameCallback(const std::function<void()>& callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frameCallback=callback;
+}
+
+bool PreviewRenderer::takeFrame(QImage& frame, std::vector<SceneCamera::RenderTile>& changedTiles)
+{
+    std::lock_guard<std::mutex> lock(m_frameMutex);
+    changedTiles.clear();
+    if(!m_frameChanged)
+        return false;
+
+    bool resized = frame.width()!=m_frame.width() || frame.height()!=m_frame.height() || frame.format()!=m_frame.format();
+    if(resized)
+        frame=m_frame.copy();
+    for(size_t i=0; i<m_changedTiles.size(); ++i)
+    {
+        if(!m_changedTiles[i])
+            continue;
+        SceneCamera::RenderTile tile=SceneCamera::tile(i, m_frame.width(), m_frame.height(), ms_tileSize);
+        changedTiles.push_back(tile);
+        //only the changed tiles are copied, the frame is not shared with the rendering thread
+        if(!resized)
+        {
+            for(int y=tile.y; y<tile.y+tile.height; ++y)
+                std::memcpy(frame.scanLine(y)+tile.x*4, m_frame.constScanLine(y)+tile.x*4, tile.width*4);
+        }
+    }
+    std::fill(m_changedTiles.begin(), m_changedTiles.end(), false);
+    m_frameChanged=false;
+    return true;
+}
+
+void PreviewRenderer::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;)
+    {
+        m_wakeUp.wait(lock, [this]
+        {
+            bool converged = m_level==0 && m_passSamples>=m_maxSamples;
+            return m_stopping || (!m_paused && m_hasView && (m_version!=m_renderedVersion || !converged));
+        });
+        if(m_stopping)
+            return;
+
+        bool restart=m_version!=m_renderedVersion;
+        SceneCamera::View view=m_requestedView;
+        if(restart)
+        {
+            m_renderedVersion=m_version;
+            m_settings=m_requestedSettings;
+        }
+        m_rendering=true;
+        lock.unlock();
+
+        if(restart)
+            startView(view);
+        else if(m_level>0)
+        {
+            if(renderLevel(m_level))
+            {
+                m_level/=2;
+                if(m_level==0)
+                    m_frameSamples=m_passSamples=1;
+            }
+        }
+        else if(refine())
+            m_frameSamples=++m_passSamples;
+
+        lock.lock();
+        m_rendering=false;
+        m_idle.notify_all();
+    }
+}
+
+int PreviewRenderer::blockSize(int x, int y)
+{
+    for(int size=ms_coarsestBlock; size>1; size/=2)
+    {
+        if(x%size==0 && y%size==0)
+            return size;
+    }
+    return 1;
+}
+
+void PreviewRenderer::startView(const SceneCamera::View& view)
+{
+    SceneCamera::Rays rays(view);
+    int w=std::max(view.width, 0);
+    int h=std::max(view.height, 0);
+    size_t pixelCount=(size_t)w*h;
+    std::vector<glm::vec3> colors(pixelCount, glm::vec3(0.0f));
+    std::vector<unsigned char> footprints(pixelCount, ms_noFootprint);
+
+    if(m_viewValid)
+    {
+        //every ray cast for the previous view is splatted over the pixels its block covered, seen from the new view:
+        //finer blocks win over coarser ones, and nearer points over farther ones
+        std::vector<unsigned char> splats(pixelCount, ms_noFootprint);
+        std::vector<float> depths(pixelCount, std::numeric_limits<float>::max());
+        for(int y=0; y<m_view.height; ++y)
+        {
+            for(int x=0; x<m_view.width; ++x)
+            {
+                size_t k=(size_t)y*m_view.width+x;
+                if(m_positions[k].w==0.0f)
+                    continue;
+                glm::vec3 position(m_positions[k]);
+                float px, py;
+                if(!rays.project(position, px, py))
+                    continue;
+                int size=blockSize(x, y);
+                float depth=glm::distance(position, view.position);
+                int x0=(int)std::floor(px - size*0.5f + 0.5f);
+                int y0=(int)std::floor(py - size*0.5f + 0.5f);
+                for(int j=std::max(y0, 0); j<std::min(y0+size, h); ++j)
+                {
+                    for(int i=std::max(x0, 0); i<std::min(x0+size, w); ++i)
+                    {
+                        size_t l=(size_t)j*w+i;
+                        if(size<splats[l] || (size==splats[l] && depth<depths[l]))
+                        {
+                            splats[l]=size;
+                            depths[l]=depth;
+                            colors[l]=m_colors[k];
+                            footprints[l]=std::max(size, 2);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    m_view=view;
+    m_rays=rays;
+    m_viewValid=true;
+    m_colors.swap(colors);
+    m_footprints.swap(footprints);
+    m_sums.assign(pixelCount, glm::vec3(0.0f));
+    m_counts.assign(pixelCount, 0);
+    m_positions.assign(pixelCount, glm::vec4(0.0f));
+    m_level=ms_coarsestBlock;
+    m_passSamples=0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        if(m_frame.width()!=w || m_frame.height()!=h)
+            m_frame=QImage(w, h, QImage::Format_RGB32);
+        m_changedTiles.assign(SceneCamera::tileCount(w, h, ms_tileSize), false);
+    }
+    publish(0, h);
+}
+
+bool PreviewRenderer::renderLevel(int size)
+{
+    int w=m_view.width;
+    int h=m_view.height;
+    for(int band=0; band<h; band+=ms_tileSize)
+    {
+        if(interrupted())
+            return false;
+        int bandEnd=std::min(band+ms_tileSize, h);
+        size_t blockRows=(bandEnd-band+size-1)/size;
+        {
+            QReadLocker locker(&m_manager.renderLock());
+            TaskPool::globalInstance().parallelFor(0, blockRows, 1, [this, w, h, band, size](size_t first, size_t last)
+            {
+                for(size_t row=first; row<last && !interrupted(); ++row)
+                {
+                    int y=band+(int)row*size;
+                    for(int x=0; x<w; x+=size)
+                    {
+                        size_t k=(size_t)y*w+x;
+                        //the rays of the coarser levels are already cast, their blocks are only refined
+                        if(blockSize(x, y)==size)
+                        {
+                            SceneObject::RayHitProperties hit;
+                            glm::vec3 color=m_manager.renderRay(m_rays.castRay(x+0.5f, y+0.5f), m_settings, &hit);
+                            m_sums[k]=color;
+                            m_counts[k]=1;
+                            m_colors[k]=color;
+                            m_footprints[k]=1;
+                            m_positions[k]=hit.occuredHit ? glm::vec4(hit.positionHit, 1.0f) : glm::vec4(0.0f);
+                        }
+                        for(int j=y; j<std::min(y+size, h); ++j)
+                        {
+                            for(int i=x; i<std::min(x+size, w); ++i)
+                            {
+                                size_t l=(size_t)j*w+i;
+                                if(m_footprints[l]>size)
+                                {
+                                    m_footprints[l]=size;
+                                    m_colors[l]=m_sums[k];
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+        }
+        if(interrupted())
+            return false;
+        publish(band, bandEnd);
+    }
+    return true;
+}
+
+bool PreviewRenderer::refine()
+{
+    int w=m_view.width;
+    int h=m_view.height;
+    for(int band=0; band<h; band+=ms_tileSize)
+    {
+        if(interrupted())
+            return false;
+        int bandEnd=std::min(band+ms_tileSize, h);
+        {
+            QReadLocker locker(&m_manager.renderLock());
+            TaskPool::globalInstance().parallelFor(band, bandEnd, 1, [this, w](size_t first, size_t last)
+            {
+                std::uniform_real_distribution<float> randomGen(0.0f, 1.0f);
+                for(size_t y=first; y<last && !interrupted(); ++y)
+                {
+                    for(int x=0; x<w; ++x)
+                    {
+                        size_t k=y*w+x;
+                        float dx=randomGen(Random::genMt19937);
+                        float dy=randomGen(Random::genMt19937);
+                        m_sums[k]+=m_manager.renderRay(m_rays.castRay(x+dx, y+dy), m_settings);
+                        ++m_counts[k];
+                        m_colors[k]=m_sums[k]/(float)m_counts[k];
+                    }
+                }
+            });
+        }
+        if(interrupted())
+            return false;
+        publish(band, bandEnd);
+    }
+    return true;
+}
+
+void PreviewRenderer::publish(int first, int last)
+{
+    int w=m_view.width;
+    {
+        std::lock_guard<std::mutex> lock(m_frameMutex);
+        for(int y=first; y<last; ++y)
+        {
+            for(int x=0; x<w; ++x)
+            {
+                glm::vec3 color=glm::clamp(m_colors[(size_t)y*w+x], glm::vec3(0.0f), glm::vec3(1.0f));
+                m_frame.setPixel(x, y, qRgb(int(color.r*255), int(color.g*255), int(color.b*255)));
+            }
+        }
+        int columns=(w+ms_tileSize-1)/ms_tileSize;
+        for(int row=first/ms_tileSize; row*ms_tileSize<last; ++row)
+        {
+            for(int column=0; column<columns; ++column)
+                m_changedTiles[row*columns+column]=true;
+        }
+        m_frameChanged=true;
+        //the rows of the pass being rendered have one more sample than the other ones
+        m_frameSamples = m_level==0 ? m_passSamples : 0;
+    }
+
+    std::function<void()> callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        callback=m_frameCallback;
+    }
+    if(callback)
+        callback();
+}
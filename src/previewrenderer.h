@@ -0,0 +1,137 @@
+#ifndef PREVIEWRENDERER_H
+#define PREVIEWRENDERER_H
+
+#include <QImage>
+#include "scenemanager.h"
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+///
+/// \brief The PreviewRenderer class renders the scene continuously, on its own thread, as the camera of the viewer sees it.
+/// A new view is first rendered coarse to fine: one ray per block of 8x8 pixels, then 4x4, 2x2, and every pixel,
+/// each level only casting the rays the previous ones didn't. Once the view stops changing, jittered samples are
+/// accumulated until every pixel has maxSamples() of them, and the thread sleeps.
+/// When the view changes, the points seen by the previous view are reprojected in the new one, so that the image
+/// doesn't go blocky more than where it has to: they are shown until the level of 2x2 blocks replaces them,
+/// but never count as samples.
+///
+/// The previews use cheap settings (one light sample, one reflection ray) and the TaskPool.
+/// Like the render jobs, they read the scene under its render lock: the scene must not be edited while
+/// the renderer isn't paused (see pause()).
+///
+class PreviewRenderer
+{
+public:
+    explicit PreviewRenderer(SceneManager& manager);
+
+    /// \brief the destructor waits for the rendering thread to stop.
+    ~PreviewRenderer();
+
+    ///
+    /// \brief setView starts rendering a view, from the thread of the camera (see SceneCamera::currentView()).
+    /// The current level is dropped at the end of the row being rendered.
+    ///
+    void setView(const SceneCamera::View& view);
+
+    /// \brief setSettings sets how the previews are rendered, from the next view on.
+    void setSettings(const SceneManager::RenderSettings_t& settings);
+    SceneManager::RenderSettings_t settings();
+
+    /// \brief setMaxSamples sets the number of samples per pixel a still view is refined to (64 by default).
+    void setMaxSamples(unsigned int samples);
+    inline unsigned int maxSamples() const                          {return m_maxSamples;}
+
+    ///
+    /// \brief pause stops rendering, and blocks until the rendering thread doesn't read the scene anymore:
+    /// the scene can then be edited, until resume() restarts the rendering of the current view from scratch.
+    ///
+    void pause();
+    void resume();
+
+    ///
+    /// \brief setFrameCallback sets a function called from the rendering thread whenever a new frame can be taken,
+    /// which should only ask the thread of the viewer to take it (e.g. a queued call to update()).
+    ///
+    void setFrameCallback(const std::function<void()>& callback);
+
+    ///
+    /// \brief takeFrame updates a copy of the last frame (QImage::Format_RGB32), if it changed since it was taken last.
+    /// Only the changed tiles are copied, unless the frame isn't the size of the view anymore.
+    /// \param changedTiles receives the tiles which changed since then
+    /// \return false if the frame didn't change
+    ///
+    bool takeFrame(QImage& frame, std::vector<SceneCamera::RenderTile>& changedTiles);
+
+    /// \brief samples per pixel of the last frame, 0 while it is still coarse.
+    inline unsigned int samples() const                             {return m_frameSamples;}
+
+private:
+    void work();
+
+    /// \brief startView resets the buffers for a new view, warm started by reprojecting the previous one.
+    void startView(const SceneCamera::View& view);
+
+    /// \brief renderLevel renders the pixels of a coarse level (blocks of size pixels wide), false if it was interrupted.
+    bool renderLevel(int size);
+
+    /// \brief refine adds one jittered sample to every pixel, false if it was interrupted.
+    bool refine();
+
+    /// \brief publish copies rows [first, last) of the image in the frame, and calls the callback.
+    void publish(int first, int last);
+
+    /// \brief interrupted tells if the rendering should stop (new view, pause, or destruction).
+    inline bool interrupted() const {return m_version!=m_renderedVersion || m_paused || m_stopping;}
+
+    /// \brief blockSize is the size of the coarsest block whose ray goes through pixel (x,y).
+    static int blockSize(int x, int y);
+
+    static const int            ms_tileSize;        //rows are rendered and shown by bands of tiles
+    static const int            ms_coarsestBlock;
+    static const unsigned char  ms_noFootprint;
+
+    SceneManager                    &m_manager;
+    std::atomic<unsigned int>       m_maxSamples;
+
+    //requests, from the thread of the viewer
+    std::mutex                      m_mutex;
+    std::condition_variable         m_wakeUp;
+    std::condition_variable         m_idle;
+    SceneCamera::View               m_requestedView;
+    SceneManager::RenderSettings_t  m_requestedSettings;
+    bool                            m_hasView;
+    std::atomic<unsigned int>       m_version;
+    std::atomic<bool>               m_paused;
+    std::atomic<bool>               m_stopping;
+    bool                            m_rendering;        //true while the thread reads the scene
+    std::function<void()>           m_frameCallback;
+
+    //state of the rendering thread
+    unsigned int                    m_renderedVersion;
+    SceneManager::RenderSettings_t  m_settings;
+    SceneCamera::View               m_view;
+    SceneCamera::Rays               m_rays;
+    bool                            m_viewValid;
+    std::vector<glm::vec3>          m_colors;           //displayed color of each pixel
+    std::vector<glm::vec3>          m_sums;             //sum of the samples of each pixel
+    std::vector<unsigned int>       m_counts;           //number of samples of each pixel
+    std::vector<unsigned char>      m_footprints;       //size of the block whose sample is displayed (0xff: nothing yet)
+    std::vector<glm::vec4>          m_positions;        //point hit by the ray of each pixel, w=0 if none
+    int                             m_level;            //size of the blocks of the next coarse level, 0 once they are done
+    unsigned int                    m_passSamples;      //samples of every pixel, once the coarse levels are done
+
+    //last frame, for the thread of the viewer
+    std::mutex                      m_frameMutex;
+    QImage                          m_frame;
+    std::vector<bool>               m_changedTiles;
+    bool                            m_frameChanged;
+    std::atomic<unsigned int>       m_frameSamples;
+
+    std::thread                     m_thread;           //last, started once everything else is ready
+};
+
+#endif // PREVIEWRENDERER_H
@@ -5,7 +5,7 @@
 #--------------------------
 
 QMAKE_CXXFLAGS += -std=c++11
-CONFIG += c++11
+CONFIG += c++11 thread
 
 QT += core gui opengl xml widgets
 TARGET = project
@@ -19,6 +19,11 @@ DESTDIR = ../bin/
 
 QMAKE_CXXFLAGS += -DSHADERPATH=$$_PRO_FILE_PWD_
 
+#counters of the renderings (see renderstats.h), compiled out unless qmake is run with CONFIG+=render_stats
+render_stats {
+        DEFINES += RENDER_STATS
+}
+
 # Linux
 unix:!macx {
         #QMAKE_LFLAGS += -Wl,-rpath,$$_PRO_FILE_PWD_/../QGLViewer
@@ -53,29 +58,70 @@ SOURCES += main.cpp \
         Shader.cpp \
         ShaderProgram.cpp \
         ShaderProgram_RayTracer.cpp \
+        ShaderProgram_Image.cpp \
         sceneobject.cpp \
         sceneface.cpp \
         ray.cpp \
         scenemanager.cpp \
         scenecamera.cpp \
-        dialog_renderedimage.cpp
+        dialog_renderedimage.cpp \
+        bvh.cpp \
+        bvh4.cpp \
+        sceneinstance.cpp \
+        taskpool.cpp \
+        material.cpp \
+        sceneprimitives.cpp \
+        sceneloader.cpp \
+        scenecache.cpp \
+        tiledimagewriter.cpp \
+        renderjob.cpp \
+        previewrenderer.cpp \
+        visibilitybuffer.cpp \
+        raysorter.cpp \
+        renderstats.cpp \
+        costmap.cpp \
+        trace.cpp \
+        benchmark.cpp
 
 #HEADERS  += viewer.h
 HEADERS  += ShaderProgram.h \
             Shader.h \
             errorsHandler.hpp \
             ShaderProgram_RayTracer.h \
+            ShaderProgram_Image.h \
             sceneobject.h \
             sceneface.h \
             ray.h \
             scenemanager.h \
             scenecamera.h \
-            dialog_renderedimage.h
+            dialog_renderedimage.h \
+            aabb.h \
+            bvh.h \
+            bvh4.h \
+            sceneinstance.h \
+            taskpool.h \
+            material.h \
+            sceneprimitives.h \
+            sceneloader.h \
+            scenecache.h \
+            mappedarray.h \
+            tiledimagewriter.h \
+            renderjob.h \
+            previewrenderer.h \
+            visibilitybuffer.h \
+            raysorter.h \
+            fastmath.h \
+            renderstats.h \
+            costmap.h \
+            trace.h \
+            benchmark.h
 
 OTHER_FILES += \
     shader.frag \
     shader.vert \
     shader.geom \
+    image.vert \
+    image.frag \
 
 FORMS += \
     dialog_renderedimage.ui
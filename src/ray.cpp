@@ -1,4 +1,8 @@
 #include "ray.h"
+#include <algorithm>
+#include <cmath>
+
+thread_local std::mt19937 Random::genMt19937(std::random_device{}());
 
 Ray::Ray():
     m_origin(0,0,0),
@@ -16,33 +20,71 @@ Ray::Ray(const glm::vec3& origin, RandomCone &cone):
     m_origin(origin)
 {
     if(!cone.set)
+        cone.setup(cone.direction, cone.angle);
+    cone.sample(1, &m_direction);
+}
+
+unsigned int Ray::RandomCone::greatestCommonDivisor(unsigned int a, unsigned int b)
+{
+    while(b!=0)
     {
-        if(cone.angle <= -M_PI || cone.angle >= M_PI)
-            ERROR("Ray: Unable to create a random cone with an angle > or equal to Pi");
-        //find an orthogonal vector
-        cone.rightVector = glm::cross(glm::vec3(1,0,0), m_direction);
-        if(glm::length(cone.rightVector) < EPSILON)
-        {
-            //that's really unfortunate
-            cone.rightVector = glm::cross(glm::vec3(0,1,0), m_direction);
-        }
-        cone.upVector = glm::cross(cone.direction, cone.rightVector);
-
-        //find the distance to some circle center with r=1. Simple trigonometry
-        float distanceToCenter= 1 / std::tan(cone.angle);
-
-        cone.circleCenter = origin + cone.direction * distanceToCenter;
+        unsigned int remainder=a%b;
+        a=b;
+        b=remainder;
     }
+    return a;
+}
+
+void Ray::RandomCone::sinCosTurn(float turn, float& sine, float& cosine)
+{
+    float x=turn<0.5f ? turn : turn-1.0f;                  //[-0.5,0.5)
+    float y=x*(8.0f-16.0f*std::abs(x));
+    sine=y + 0.225f*y*(std::abs(y)-1.0f);
+    x+=0.25f;                                               //cos(a)=sin(a+pi/2)
+    x = x<0.5f ? x : x-1.0f;
+    y=x*(8.0f-16.0f*std::abs(x));
+    cosine=y + 0.225f*y*(std::abs(y)-1.0f);
+}
 
-    //pick a point inside the created circle
-    std::uniform_real_distribution<float> randomGen(0.0f, 1.0f);
+void Ray::RandomCone::setup(const glm::vec3& axis, float halfAngle)
+{
+    if(halfAngle <= -M_PI || halfAngle >= M_PI)
+        ERROR("Ray: Unable to create a random cone with an angle > or equal to Pi");
+    direction=axis;
+    angle=halfAngle;
+    //an orthogonal vector, from the canonical axis the furthest from the cone's
+    glm::vec3 other = std::abs(axis.x)<0.9f ? glm::vec3(1,0,0) : glm::vec3(0,1,0);
+    rightVector=glm::normalize(glm::cross(other, axis));
+    upVector=glm::normalize(glm::cross(axis, rightVector));
+    radius=std::tan(halfAngle);
+    set=true;
+}
 
-    float angle2d = randomGen(Random::genMt19937)*2*M_PI;
-    float rand2 = randomGen(Random::genMt19937)+randomGen(Random::genMt19937);
-    float r = rand2 > 1.0f ? 2.0f-rand2 : rand2;
+void Ray::RandomCone::sample(unsigned int count, glm::vec3 *directions) const
+{
+    if(count==0)
+        return;
+    //the ring of sector i is i*stride modulo count, which is a permutation for a stride coprime with count
+    unsigned int stride=std::max(1u, (unsigned int)(count*0.618f+0.5f));
+    while(greatestCommonDivisor(stride, count)!=1)
+        ++stride;
 
-    glm::vec3 pickedPoint = cone.circleCenter +
-            r*std::cos(angle2d)*cone.rightVector +
-            r*std::sin(angle2d)*cone.upVector;
-    m_direction = glm::normalize(pickedPoint - m_origin);
+    //the sectors turn by a random angle, without which each sector would always go with the same ring
+    float inverseCount=1.0f/count;
+    float rotation=(float)((unsigned int)Random::genMt19937() >> 8)*(1.0f/16777216.0f);
+    for(unsigned int i=0; i<count; ++i)
+    {
+        //both jitters come from a single draw
+        unsigned int bits=(unsigned int)Random::genMt19937();
+        float u1=(float)(bits & 0xFFFFu)*(1.0f/65536.0f);
+        float u2=(float)(bits >> 16)*(1.0f/65536.0f);
+
+        float sine, cosine;
+        float turn=((float)i+u1)*inverseCount + rotation;
+        sinCosTurn(turn<1.0f ? turn : turn-1.0f, sine, cosine);
+        //uniform over the area: the square of the distance to the center is uniform
+        unsigned int ring=(unsigned int)(((unsigned long long)i*stride)%count);
+        float r=radius*std::sqrt(((float)ring+u2)*inverseCount);
+        directions[i]=glm::normalize(direction + (r*cosine)*rightVector + (r*sine)*upVector);
+    }
 }
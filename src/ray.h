@@ -10,21 +10,54 @@ class Ray
 
 public:
 
+    ///
+    /// \brief The RandomCone class samples directions around an axis, inside a cone of a given half angle
+    /// (a glossy reflection lobe). The directions go through a disk at distance 1 along the axis, of radius tan(angle),
+    /// uniformly over its area. The basis of the disk is computed once by setup(), for every direction drawn afterwards.
+    ///
     class RandomCone
     {
     public:
-        RandomCone(): set(false){}
+        RandomCone(): set(false), angle(0.0f), radius(0.0f){}
+
+        ///
+        /// \brief setup computes the basis of the cone. Without it, the first ray made from the cone
+        /// computes it from direction and angle.
+        ///
+        void setup(const glm::vec3& axis, float halfAngle);
+
+        ///
+        /// \brief sample draws count directions stratified over the disk of the cone: the i-th one is in the i-th
+        /// sector of the disk, randomly turned, and the rings of the sectors are spread over the disk by a permutation,
+        /// so that a handful of rays already covers the whole lobe. Each direction is uniform over the disk.
+        /// \param directions receives count normalized directions
+        ///
+        void sample(unsigned int count, glm::vec3 *directions) const;
 
         bool set;
         float angle;
         glm::vec3 direction;
-        glm::vec3 rightVector;
-        glm::vec3 upVector;
-        glm::vec3 circleCenter;
+        glm::vec3 rightVector;      //normalized
+        glm::vec3 upVector;         //normalized
+        float radius;               //of the disk, at distance 1 from the origin
+
+    private:
+
+        static unsigned int greatestCommonDivisor(unsigned int a, unsigned int b);
+
+        ///
+        /// \brief sinCosTurn computes the sine and cosine of 2*pi*turn for turn in [0,1), within 0.001:
+        /// a parabola through the extrema and zeros, corrected by a second one. Enough to place a direction on the disk.
+        ///
+        static inline void sinCosTurn(float turn, float& sine, float& cosine);
     };
 
     Ray();
     Ray(const glm::vec3& origin, const glm::vec3& direction);
+    ///
+    /// \brief Ray casts a ray in a random direction of a cone, which is set up if it isn't already.
+    /// Use RandomCone::sample() for several rays of the same cone.
+    ///
     Ray(const glm::vec3& origin, RandomCone& cone);
 
     inline const glm::vec3& origin() const        {return m_origin;}
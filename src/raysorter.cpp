@@ -0,0 +1,81 @@
+#include "raysorter.h"
+#include <algorithm>
+
+RaySorter::RaySorter() :
+    m_keys(),
+    m_sortedKeys(),
+    m_sortedOrder(),
+    m_histogram()
+{}
+
+unsigned int RaySorter::spreadBits(unsigned int coordinate)
+{
+    coordinate&=(1u<<ms_cellBits)-1;
+    coordinate=(coordinate | (coordinate<<16)) & 0x030000FFu;
+    coordinate=(coordinate | (coordinate<<8)) & 0x0300F00Fu;
+    coordinate=(coordinate | (coordinate<<4)) & 0x030C30C3u;
+    coordinate=(coordinate | (coordinate<<2)) & 0x09249249u;
+    return coordinate;
+}
+
+unsigned int RaySorter::key(const Ray& ray, const glm::vec3& origin, const glm::vec3& scale)
+{
+    const glm::vec3& direction=ray.direction();
+    unsigned int octant=(direction.x<0 ? 1u : 0u) | (direction.y<0 ? 2u : 0u) | (direction.z<0 ? 4u : 0u);
+
+    float maxCell=(float)((1u<<ms_cellBits)-1);
+    glm::vec3 cell=glm::clamp((ray.origin()-origin)*scale, glm::vec3(0.0f), glm::vec3(maxCell));
+    unsigned int morton=spreadBits((unsigned int)cell.x) | (spreadBits((unsigned int)cell.y)<<1) | (spreadBits((unsigned int)cell.z)<<2);
+    return (octant<<(3*ms_cellBits)) | morton;
+}
+
+void RaySorter::sort(const std::vector<Ray>& rays, const AABB& bounds, std::vector<unsigned int>& order)
+{
+    size_t count=rays.size();
+    order.resize(count);
+    for(size_t i=0; i<count; ++i)
+        order[i]=i;
+    if(count<2 || bounds.isEmpty())
+        return;
+
+    //cells per unit of the scene along each axis, flat axes having a single cell
+    glm::vec3 extent=bounds.extent();
+    glm::vec3 scale;
+    for(int axis=0; axis<3; ++axis)
+        scale[axis] = extent[axis]>0.0f ? (float)(1u<<ms_cellBits)/extent[axis] : 0.0f;
+
+    m_keys.resize(count);
+    for(size_t i=0; i<count; ++i)
+        m_keys[i]=key(rays[i], bounds.pMin, scale);
+
+    //least significant digit first: each pass is stable, so the previous digits stay sorted
+    const unsigned int keyBits=3*ms_cellBits+3;
+    const unsigned int buckets=1u<<ms_digitBits;
+    m_sortedKeys.resize(count);
+    m_sortedOrder.resize(count);
+    for(unsigned int shift=0; shift<keyBits; shift+=ms_digitBits)
+    {
+        m_histogram.assign(buckets, 0);
+        for(size_t i=0; i<count; ++i)
+            ++m_histogram[(m_keys[i]>>shift) & (buckets-1)];
+        //a digit shared by every key doesn't change the order
+        if(std::find(m_histogram.begin(), m_histogram.end(), count)!=m_histogram.end())
+            continue;
+
+        unsigned int offset=0;
+        for(unsigned int b=0; b<buckets; ++b)
+        {
+            unsigned int bucketSize=m_histogram[b];
+            m_histogram[b]=offset;
+            offset+=bucketSize;
+        }
+        for(size_t i=0; i<count; ++i)
+        {
+            unsigned int destination=m_histogram[(m_keys[i]>>shift) & (buckets-1)]++;
+            m_sortedKeys[destination]=m_keys[i];
+            m_sortedOrder[destination]=order[i];
+        }
+        m_keys.swap(m_sortedKeys);
+        order.swap(m_sortedOrder);
+    }
+}
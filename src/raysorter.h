@@ -0,0 +1,45 @@
+#ifndef RAYSORTER_H
+#define RAYSORTER_H
+
+#include "ray.h"
+#include "aabb.h"
+#include <vector>
+
+///
+/// \brief The RaySorter class orders a batch of rays so that consecutive rays go the same way from close origins.
+/// The rays are binned by the octant of their direction, then by the cell of a 512x512x512 grid over the scene
+/// their origin is in, the cells following the Morton order so that neighbour cells stay close.
+/// The keys are sorted with a radix sort. Traced in this order, incoherent rays (glossy reflections,
+/// shadow rays of points spread over the scene) traverse the same nodes of the acceleration structures
+/// one after the other, while these are still in the cache.
+///
+class RaySorter
+{
+public:
+    RaySorter();
+
+    ///
+    /// \brief sort fills order with the indices of the rays, sorted by octant and origin cell.
+    /// Rays of the same bin keep their order.
+    /// \param bounds box of the scene, origins outside of it are brought back on its border
+    ///
+    void sort(const std::vector<Ray>& rays, const AABB& bounds, std::vector<unsigned int>& order);
+
+    /// \brief key is the bin of a ray: octant of its direction in the 3 high bits, Morton code of its origin cell below.
+    static unsigned int key(const Ray& ray, const glm::vec3& origin, const glm::vec3& scale);
+
+private:
+
+    /// \brief spreadBits inserts two zero bits between each of the ms_cellBits low bits of a coordinate.
+    static inline unsigned int spreadBits(unsigned int coordinate);
+
+    std::vector<unsigned int>   m_keys;             //scratch buffers, kept between batches
+    std::vector<unsigned int>   m_sortedKeys;
+    std::vector<unsigned int>   m_sortedOrder;
+    std::vector<unsigned int>   m_histogram;
+
+    static const unsigned int   ms_cellBits=9;      //per axis
+    static const unsigned int   ms_digitBits=11;    //sorted per pass, 3 passes for 30 bits of key
+};
+
+#endif // RAYSORTER_H
@@ -0,0 +1,123 @@
+#include "renderjob.h"
+
+RenderJob::RenderJob(const SceneManager::RenderSettings_t& settings, const SceneCamera::View& view) :
+    QObject(),
+    m_settings(settings),
+    m_view(view),
+    m_image(),
+    m_cancelled(false),
+    m_tilesDone(0),
+    m_tileCount(0),
+    m_promise(),
+    m_done(m_promise.get_future().share())
+{}
+
+void RenderJob::run(SceneManager& manager)
+{
+    if(!m_cancelled)
+    {
+        manager.updateAccelerationStructure();
+        SceneCamera::Rays rays(m_view);
+        int tileSize=manager.sceneCamera().tileSize();
+        m_image=QImage(m_view.width, m_view.height, QImage::Format_RGB888);
+        m_tileCount=SceneCamera::tileCount(m_view.width, m_view.height, tileSize);
+        SceneCamera::PixelOrder_t order=manager.sceneCamera().pixelOrder();
+        std::vector<SceneCamera::TilePixel> pixels;
+        SceneCamera::RenderTile pixelsSize={0, 0, 0, 0};
+
+        for(int i=0; i<m_tileCount && !m_cancelled; ++i)
+        {
+            SceneCamera::RenderTile tile=SceneCamera::tile(i, m_view.width, m_view.height, tileSize);
+            if(tile.width!=pixelsSize.width || tile.height!=pixelsSize.height)
+            {
+                SceneCamera::tilePixels(tile.width, tile.height, order, pixels);
+                pixelsSize=tile;
+            }
+            QReadLocker locker(&manager.renderLock());
+            QImage tileImage(tile.width, tile.height, QImage::Format_RGB888);
+            for(std::vector<SceneCamera::TilePixel>::const_iterator it=pixels.begin(); it!=pixels.end(); ++it)
+            {
+                int x=tile.x+it->x, y=tile.y+it->y;
+                glm::vec3 color=manager.renderRay(rays.castRay(x+0.5f, y+0.5f), m_settings);
+                QRgb rgb=qRgb(int(color.r*255), int(color.g*255), int(color.b*255));
+                tileImage.setPixel(it->x, it->y, rgb);
+                m_image.setPixel(x, y, rgb);
+            }
+            ++m_tilesDone;
+            emit tileRendered(tileImage, tile.x, tile.y);
+            emit progress(m_tilesDone, m_tileCount);
+        }
+    }
+    emit finished(m_image, m_cancelled);
+    m_promise.set_value();
+}
+
+RenderQueue::RenderQueue(SceneManager& manager) :
+    m_manager(manager),
+    m_jobs(),
+    m_current(),
+    m_stopping(false),
+    m_thread(&RenderQueue::work, this)
+{}
+
+RenderQueue::~RenderQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping=true;
+        for(size_t i=0; i<m_jobs.size(); ++i)
+            m_jobs[i]->cancel();
+        if(m_current)
+            m_current->cancel();
+    }
+    m_jobAvailable.notify_all();
+    m_thread.join();
+}
+
+void RenderQueue::submit(const std::shared_ptr<RenderJob>& job, bool urgent)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(urgent)
+            m_jobs.push_front(job);
+        else
+            m_jobs.push_back(job);
+    }
+    m_jobAvailable.notify_one();
+}
+
+void RenderQueue::cancelAll()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(size_t i=0; i<m_jobs.size(); ++i)
+        m_jobs[i]->cancel();
+    if(m_current)
+        m_current->cancel();
+}
+
+void RenderQueue::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]{return m_jobs.empty() && !m_current;});
+}
+
+void RenderQueue::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;)
+    {
+        m_jobAvailable.wait(lock, [this]{return m_stopping || !m_jobs.empty();});
+        //the jobs left when the queue stops are cancelled, they still run to report it
+        if(m_stopping && m_jobs.empty())
+            return;
+
+        m_current=m_jobs.front();
+        m_jobs.pop_front();
+        lock.unlock();
+        m_current->run(m_manager);
+        lock.lock();
+        m_current.reset();
+        if(m_jobs.empty())
+            m_idle.notify_all();
+    }
+}
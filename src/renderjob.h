@@ -0,0 +1,115 @@
+#ifndef RENDERJOB_H
+#define RENDERJOB_H
+
+#include <QObject>
+#include <QImage>
+#include "scenemanager.h"
+#include <memory>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+///
+/// \brief The RenderJob class is a rendering which runs in the background (see RenderQueue), and its handle.
+/// The job renders tile by tile into its own image. Its signals are emitted from the thread of the queue:
+/// connected to objects of the GUI thread, they are queued, and received by the event loop of the GUI.
+/// Cancelling is cooperative: the job stops at the end of the tile it is rendering.
+///
+class RenderJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    ///
+    /// \param view copied from the camera when the job is created (SceneCamera::currentView()),
+    /// so that moving the camera doesn't change the rendering
+    ///
+    RenderJob(const SceneManager::RenderSettings_t& settings, const SceneCamera::View& view);
+
+    /// \brief cancel stops the job at the end of its current tile, or before it starts.
+    inline void cancel()                                            {m_cancelled=true;}
+    inline bool isCancelled() const                                 {return m_cancelled;}
+    inline bool isFinished() const                                  {return m_done.wait_for(std::chrono::seconds(0))==std::future_status::ready;}
+
+    /// \brief wait blocks until the job finished, or stopped after being cancelled.
+    inline void wait() const                                        {m_done.wait();}
+
+    inline int tilesDone() const                                    {return m_tilesDone;}
+    inline int tileCount() const                                    {return m_tileCount;}
+
+    inline const SceneManager::RenderSettings_t& settings() const   {return m_settings;}
+    inline const SceneCamera::View& view() const                    {return m_view;}
+
+    /// \brief image the rendered image, to be read once the job is finished (partial if it was cancelled).
+    inline const QImage& image() const                              {return m_image;}
+
+signals:
+    void progress(int tilesDone, int tileCount);
+
+    /// \brief tileRendered gives the pixels of a new tile, whose top left pixel is (x,y).
+    void tileRendered(const QImage& tile, int x, int y);
+
+    void finished(const QImage& image, bool cancelled);
+
+private:
+    friend class RenderQueue;
+
+    /// \brief run renders the job, from the thread of the queue.
+    void run(SceneManager& manager);
+
+    SceneManager::RenderSettings_t  m_settings;
+    SceneCamera::View               m_view;
+    QImage                          m_image;
+
+    std::atomic<bool>               m_cancelled;
+    std::atomic<int>                m_tilesDone;
+    std::atomic<int>                m_tileCount;
+
+    std::promise<void>              m_promise;
+    std::shared_future<void>        m_done;
+};
+
+///
+/// \brief The RenderQueue class runs render jobs one after the other, on its own thread.
+/// The jobs read the scene while they run: the scene must not be edited unless the queue is idle (see waitIdle()),
+/// and the camera of the manager must not render synchronously in the meantime. The jobs hold the render lock
+/// of the manager (SceneManager::renderLock()) while they render a tile.
+///
+class RenderQueue
+{
+public:
+    explicit RenderQueue(SceneManager& manager);
+
+    /// \brief the running and waiting jobs are cancelled, and the destructor waits for the running one to stop.
+    ~RenderQueue();
+
+    ///
+    /// \brief submit queues a job, whose signals should be connected beforehand.
+    /// \param urgent runs the job before the other waiting ones (e.g. an interactive preview)
+    ///
+    void submit(const std::shared_ptr<RenderJob>& job, bool urgent=false);
+
+    void cancelAll();
+
+    /// \brief waitIdle blocks until no job runs nor waits.
+    void waitIdle();
+
+private:
+    void work();
+
+    SceneManager                                &m_manager;
+
+    std::deque<std::shared_ptr<RenderJob> >     m_jobs;
+    std::shared_ptr<RenderJob>                  m_current;
+    bool                                        m_stopping;
+    std::mutex                                  m_mutex;
+    std::condition_variable                     m_jobAvailable;
+    std::condition_variable                     m_idle;
+
+    std::thread                                 m_thread;   //last, started once everything else is ready
+};
+
+#endif // RENDERJOB_H
@@ -0,0 +1,58 @@
+#include "renderstats.h"
+
+thread_local RenderStats::ThreadCounters RenderStats::ms_local;
+std::mutex RenderStats::ms_mutex;
+RenderStats::ThreadCounters *RenderStats::ms_threads=NULL;
+RenderStats::Counters_t RenderStats::ms_endedThreads=RenderStats::Counters_t();
+
+RenderStats::ThreadCounters::ThreadCounters() :
+    counters(),
+    previous(NULL),
+    next(NULL)
+{
+    std::lock_guard<std::mutex> lock(ms_mutex);
+    next=ms_threads;
+    if(next!=NULL)
+        next->previous=this;
+    ms_threads=this;
+}
+
+RenderStats::ThreadCounters::~ThreadCounters()
+{
+    std::lock_guard<std::mutex> lock(ms_mutex);
+    add(ms_endedThreads, counters);
+    if(previous!=NULL)
+        previous->next=next;
+    else
+        ms_threads=next;
+    if(next!=NULL)
+        next->previous=previous;
+}
+
+void RenderStats::add(Counters_t& sum, const Counters_t& counters)
+{
+    sum.primaryRays         += counters.primaryRays;
+    sum.shadowRays          += counters.shadowRays;
+    sum.occludedShadowRays  += counters.occludedShadowRays;
+    sum.reflectionRays      += counters.reflectionRays;
+    sum.lightSamples        += counters.lightSamples;
+    sum.intersectionTests   += counters.intersectionTests;
+    sum.nodesVisited        += counters.nodesVisited;
+}
+
+void RenderStats::reset()
+{
+    std::lock_guard<std::mutex> lock(ms_mutex);
+    ms_endedThreads=Counters_t();
+    for(ThreadCounters *thread=ms_threads; thread!=NULL; thread=thread->next)
+        thread->counters=Counters_t();
+}
+
+RenderStats::Counters_t RenderStats::collect()
+{
+    std::lock_guard<std::mutex> lock(ms_mutex);
+    Counters_t sum=ms_endedThreads;
+    for(ThreadCounters *thread=ms_threads; thread!=NULL; thread=thread->next)
+        add(sum, thread->counters);
+    return sum;
+}
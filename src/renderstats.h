@@ -0,0 +1,73 @@
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+#include <mutex>
+#include <stdint.h>
+
+///
+/// \brief The RenderStats class counts the work done in the hot paths of the ray tracer: rays by kind, light samples,
+/// intersection tests and nodes of the acceleration structures visited.
+/// Each thread increments its own counters, with no synchronization, and collect() sums those of every thread.
+/// The counters are only compiled in with RENDER_STATS defined (qmake CONFIG+=render_stats):
+/// RENDER_STATS_ADD is empty otherwise, so that the renderings don't pay for them.
+///
+class RenderStats
+{
+public:
+
+    typedef struct
+    {
+        uint64_t    primaryRays;            //camera rays, rasterized ones included (see SceneManager::setPrimaryVisibility())
+        uint64_t    shadowRays;
+        uint64_t    occludedShadowRays;     //shadow rays which hit something before the light
+        uint64_t    reflectionRays;
+        uint64_t    lightSamples;           //points sampled on the lights
+        uint64_t    intersectionTests;      //of faces and primitives
+        uint64_t    nodesVisited;           //of every BVH and BVH4, those of groups and registries included
+    } Counters_t;
+
+    /// \brief local gives the counters of the calling thread.
+    static inline Counters_t& local() {return ms_local.counters;}
+
+    /// \brief reset sets the counters of every thread back to 0.
+    static void reset();
+
+    ///
+    /// \brief collect sums the counters of every thread, ended threads included, since the last reset().
+    /// The counts of threads still rendering (e.g. a PreviewRenderer) may be a little behind.
+    ///
+    static Counters_t collect();
+
+private:
+
+    ///
+    /// \brief The ThreadCounters class registers the counters of a thread in the list of every thread's,
+    /// and adds them to those of the ended threads when its thread ends.
+    ///
+    class ThreadCounters
+    {
+    public:
+        ThreadCounters();
+        ~ThreadCounters();
+
+        Counters_t      counters;
+        ThreadCounters  *previous;
+        ThreadCounters  *next;
+    };
+
+    static void add(Counters_t& sum, const Counters_t& counters);
+
+    static thread_local ThreadCounters  ms_local;
+    //plain pointers and sums, so that the threads ending after the static objects were destroyed still find them
+    static std::mutex                   ms_mutex;
+    static ThreadCounters               *ms_threads;
+    static Counters_t                   ms_endedThreads;
+};
+
+#ifdef RENDER_STATS
+#define RENDER_STATS_ADD(counter, n) (RenderStats::local().counter+=(n))
+#else
+#define RENDER_STATS_ADD(counter, n) ((void)0)
+#endif
+
+#endif // RENDERSTATS_H
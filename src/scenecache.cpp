@@ -0,0 +1,395 @@
+#include "scenecache.h"
+#include "sceneface.h"
+#include "sceneprimitives.h"
+#include <QFile>
+#include <QByteArray>
+#include <cstring>
+
+const char SceneCache::ms_magic[8]={'V', 'S', 'S', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t SceneCache::ms_version;
+const uint64_t SceneCache::ms_alignment;
+
+class SceneCache::MappedFile
+{
+public:
+    MappedFile(const QString& path) :
+        m_file(path),
+        m_data(NULL),
+        m_size(0)
+    {
+        if(m_file.open(QIODevice::ReadOnly) && m_file.size()>0)
+        {
+            m_size=m_file.size();
+            m_data=m_file.map(0, m_size);
+        }
+    }
+
+    ~MappedFile()
+    {
+        if(m_data!=NULL)
+            m_file.unmap(m_data);
+    }
+
+    QFile       m_file;
+    uchar       *m_data;
+    uint64_t    m_size;
+};
+
+//hashing
+
+uint64_t SceneCache::hashFile(const QString& path)
+{
+    MappedFile file(path);
+    if(file.m_data==NULL)
+        return file.m_file.isOpen() ? 1 : 0;    //an empty file still differs from a missing one
+
+    //a multiplicative hash over 8 bytes words, enough to tell a file was edited, and as fast as reading it
+    const uint64_t prime=0x9E3779B97F4A7C15ull;
+    uint64_t hash=0xCBF29CE484222325ull ^ file.m_size;
+    uint64_t wordCount=file.m_size/8;
+    for(uint64_t i=0; i<wordCount; ++i)
+    {
+        uint64_t word;
+        std::memcpy(&word, file.m_data+i*8, 8);
+        hash=(hash ^ word)*prime;
+        hash^=hash>>32;
+    }
+    for(uint64_t i=wordCount*8; i<file.m_size; ++i)
+        hash=(hash ^ file.m_data[i])*prime;
+    return hash!=0 ? hash : 1;
+}
+
+uint32_t SceneCache::layoutSignature()
+{
+    const uint64_t sizes[]={sizeof(Header), sizeof(ObjectRecord), sizeof(SourceRecord),
+                            sizeof(ScenePrimitives::Sphere), sizeof(ScenePrimitives::Disk),
+                            sizeof(ScenePrimitives::Triangle), sizeof(ScenePrimitives::Quad),
+                            sizeof(BVH::Node), sizeof(glm::vec3), sizeof(double)};
+    uint32_t signature=2166136261u;
+    for(size_t i=0; i<sizeof(sizes)/sizeof(uint64_t); ++i)
+        signature=(signature ^ (uint32_t)sizes[i])*16777619u;
+    return signature;
+}
+
+//reading
+
+bool SceneCache::readHeader(const uchar *data, uint64_t size, const Header*& header, const QString& cachePath)
+{
+    header=(const Header*)data;
+    if(data==NULL || size<sizeof(Header) || std::memcmp(header->magic, ms_magic, sizeof(ms_magic))!=0)
+    {
+        qWarning("SceneCache: %s is not a scene cache", qPrintable(cachePath));
+        return false;
+    }
+    if(header->version!=ms_version || header->layout!=layoutSignature())
+    {
+        qWarning("SceneCache: %s was written by another version", qPrintable(cachePath));
+        return false;
+    }
+    if(header->objectsOffset+(uint64_t)header->objectCount*sizeof(ObjectRecord)>size
+            || header->sourcesOffset+(uint64_t)header->sourceCount*sizeof(SourceRecord)>size)
+    {
+        qWarning("SceneCache: %s is truncated", qPrintable(cachePath));
+        return false;
+    }
+    return true;
+}
+
+bool SceneCache::isValid(const QString& cachePath)
+{
+    if(!QFile::exists(cachePath))
+        return false;
+
+    MappedFile file(cachePath);
+    const Header *header;
+    if(!readHeader(file.m_data, file.m_size, header, cachePath))
+        return false;
+
+    const SourceRecord *sources=(const SourceRecord*)(file.m_data+header->sourcesOffset);
+    for(uint32_t i=0; i<header->sourceCount; ++i)
+    {
+        if(sources[i].pathOffset+sources[i].pathSize>file.m_size)
+            return false;
+        QString path=QString::fromUtf8((const char*)file.m_data+sources[i].pathOffset, (int)sources[i].pathSize);
+        if(hashFile(path)!=sources[i].hash)
+            return false;
+    }
+    return true;
+}
+
+bool SceneCache::read(const QString& cachePath, SceneManager& manager, SceneLoader::CameraDescription_t& camera)
+{
+    std::shared_ptr<MappedFile> file=std::make_shared<MappedFile>(cachePath);
+    const Header *header;
+    if(!readHeader(file->m_data, file->m_size, header, cachePath))
+        return false;
+
+    const size_t elementSizes[SECTION_COUNT]={sizeof(ScenePrimitives::Sphere), sizeof(ScenePrimitives::Disk),
+                                              sizeof(ScenePrimitives::Triangle), sizeof(ScenePrimitives::Quad),
+                                              sizeof(unsigned int), sizeof(double), sizeof(BVH::Node), sizeof(unsigned int)};
+
+    //every record is checked first, so that a broken cache doesn't leave half a scene in the manager
+    const ObjectRecord *records=(const ObjectRecord*)(file->m_data+header->objectsOffset);
+    for(uint32_t i=0; i<header->objectCount; ++i)
+    {
+        if(records[i].kind>PRIMITIVES_LIGHT)
+        {
+            qWarning("SceneCache: %s has an unknown object", qPrintable(cachePath));
+            return false;
+        }
+        for(int s=0; s<SECTION_COUNT; ++s)
+        {
+            if(records[i].sectionOffset[s]%ms_alignment!=0
+                    || records[i].sectionOffset[s]+records[i].sectionCount[s]*elementSizes[s]>file->m_size)
+            {
+                qWarning("SceneCache: %s is truncated", qPrintable(cachePath));
+                return false;
+            }
+        }
+    }
+
+    const CameraRecord& cameraRecord=header->camera;
+    camera.defined=cameraRecord.defined!=0;
+    camera.position=glm::vec3(cameraRecord.position[0], cameraRecord.position[1], cameraRecord.position[2]);
+    camera.viewDirection=glm::vec3(cameraRecord.viewDirection[0], cameraRecord.viewDirection[1], cameraRecord.viewDirection[2]);
+    camera.upVector=glm::vec3(cameraRecord.upVector[0], cameraRecord.upVector[1], cameraRecord.upVector[2]);
+    camera.fieldOfView=cameraRecord.fieldOfView;
+    camera.width=cameraRecord.width;
+    camera.height=cameraRecord.height;
+
+    std::shared_ptr<const void> owner=file;
+    for(uint32_t i=0; i<header->objectCount; ++i)
+    {
+        const ObjectRecord& record=records[i];
+        const float *p=record.properties;
+        MaterialProp::MaterialProperties_t material;
+        material.vAmbiant=glm::vec3(p[0], p[1], p[2]);
+        material.vDiffuse=glm::vec3(p[3], p[4], p[5]);
+        material.vSpecular=glm::vec3(p[6], p[7], p[8]);
+        material.fSpecularPower=p[9];
+        material.fReflectionPower=p[10];
+        LightSource::LightProperties_t light;
+        light.vAmbiant=material.vAmbiant;
+        light.vDiffuse=material.vDiffuse;
+        light.vSpecular=material.vSpecular;
+
+        SceneObject *object;
+        if(record.kind==FACE_PROP || record.kind==FACE_LIGHT)
+        {
+            const float *f=record.face;
+            glm::vec3 position(f[0], f[1], f[2]), axisW(f[3], f[4], f[5]), axisH(f[6], f[7], f[8]);
+            if(record.kind==FACE_PROP)
+            {
+                SceneFace_Prop *face=new SceneFace_Prop(position, axisW, axisH, f[9], f[10]);
+                face->setMaterialProperties(material);
+                object=face;
+            }
+            else
+            {
+                SceneFace_Light *face=new SceneFace_Light(position, axisW, axisH, f[9], f[10]);
+                face->setLightProperties(light);
+                object=face;
+            }
+        }
+        else
+        {
+            ScenePrimitives *primitives;
+            if(record.kind==PRIMITIVES_PROP)
+            {
+                ScenePrimitives_Prop *primitivesProp=new ScenePrimitives_Prop();
+                primitivesProp->setMaterialProperties(material);
+                primitives=primitivesProp;
+            }
+            else
+            {
+                ScenePrimitives_Light *primitivesLight=new ScenePrimitives_Light();
+                primitivesLight->setLightProperties(light);
+                primitives=primitivesLight;
+            }
+
+            const uchar *data=file->m_data;
+            const uint64_t *offset=record.sectionOffset;
+            const uint64_t *count=record.sectionCount;
+            primitives->m_spheres.map((const ScenePrimitives::Sphere*)(data+offset[SPHERES]), count[SPHERES], owner);
+            primitives->m_disks.map((const ScenePrimitives::Disk*)(data+offset[DISKS]), count[DISKS], owner);
+            primitives->m_triangles.map((const ScenePrimitives::Triangle*)(data+offset[TRIANGLES]), count[TRIANGLES], owner);
+            primitives->m_quads.map((const ScenePrimitives::Quad*)(data+offset[QUADS]), count[QUADS], owner);
+            primitives->m_references.map((const unsigned int*)(data+offset[REFERENCES]), count[REFERENCES], owner);
+            primitives->m_areas.map((const double*)(data+offset[AREAS]), count[AREAS], owner);
+            primitives->m_bvh.map((const BVH::Node*)(data+offset[BVH_NODES]), count[BVH_NODES],
+                                  (const unsigned int*)(data+offset[BVH_INDICES]), count[BVH_INDICES],
+                                  record.buildCost, owner);
+            primitives->m_bounds=AABB(glm::vec3(record.bounds[0], record.bounds[1], record.bounds[2]),
+                                      glm::vec3(record.bounds[3], record.bounds[4], record.bounds[5]));
+            primitives->m_built=true;
+            object=primitives;
+        }
+        object->setColor(glm::vec3(record.color[0], record.color[1], record.color[2]));
+        manager.append(object, false);
+    }
+    return true;
+}
+
+//writing
+
+bool SceneCache::write(const QString& cachePath, const std::vector<SceneObject*>& objects,
+                       const SceneLoader::CameraDescription_t& camera, const std::vector<QString>& sources)
+{
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, ms_magic, sizeof(ms_magic));
+    header.version=ms_version;
+    header.layout=layoutSignature();
+    header.objectCount=(uint32_t)objects.size();
+    header.sourceCount=(uint32_t)sources.size();
+    header.objectsOffset=sizeof(Header);
+    header.sourcesOffset=header.objectsOffset+objects.size()*sizeof(ObjectRecord);
+
+    CameraRecord& cameraRecord=header.camera;
+    cameraRecord.defined=camera.defined ? 1 : 0;
+    for(int i=0; i<3; ++i)
+    {
+        cameraRecord.position[i]=camera.position[i];
+        cameraRecord.viewDirection[i]=camera.viewDirection[i];
+        cameraRecord.upVector[i]=camera.upVector[i];
+    }
+    cameraRecord.fieldOfView=camera.fieldOfView;
+    cameraRecord.width=camera.width;
+    cameraRecord.height=camera.height;
+
+    //sources, whose paths follow their table
+    std::vector<SourceRecord> sourceRecords(sources.size());
+    std::vector<QByteArray> paths(sources.size());
+    uint64_t offset=header.sourcesOffset+sources.size()*sizeof(SourceRecord);
+    for(size_t i=0; i<sources.size(); ++i)
+    {
+        paths[i]=sources[i].toUtf8();
+        sourceRecords[i].hash=hashFile(sources[i]);
+        sourceRecords[i].pathOffset=offset;
+        sourceRecords[i].pathSize=paths[i].size();
+        offset+=paths[i].size();
+    }
+
+    //objects, whose sections follow the paths
+    std::vector<ObjectRecord> records(objects.size());
+    std::vector<const void*> sectionData(objects.size()*SECTION_COUNT, NULL);
+    for(size_t i=0; i<objects.size(); ++i)
+    {
+        ObjectRecord& record=records[i];
+        std::memset(&record, 0, sizeof(ObjectRecord));
+        glm::vec3 color=objects[i]->color();
+        std::memcpy(record.color, &color[0], sizeof(record.color));
+
+        const MaterialProp *material=dynamic_cast<const MaterialProp*>(objects[i]);
+        const LightSource *light=dynamic_cast<const LightSource*>(objects[i]);
+        if(material!=NULL)
+        {
+            const MaterialProp::MaterialProperties_t& properties=material->materialProperties();
+            const glm::vec3 *colors[3]={&properties.vAmbiant, &properties.vDiffuse, &properties.vSpecular};
+            for(int c=0; c<3; ++c)
+                std::memcpy(record.properties+3*c, &(*colors[c])[0], 3*sizeof(float));
+            record.properties[9]=properties.fSpecularPower;
+            record.properties[10]=properties.fReflectionPower;
+        }
+        else if(light!=NULL)
+        {
+            const LightSource::LightProperties_t& properties=light->lightProperties();
+            const glm::vec3 *colors[3]={&properties.vAmbiant, &properties.vDiffuse, &properties.vSpecular};
+            for(int c=0; c<3; ++c)
+                std::memcpy(record.properties+3*c, &(*colors[c])[0], 3*sizeof(float));
+        }
+
+        const SceneFace *face=dynamic_cast<const SceneFace*>(objects[i]);
+        const ScenePrimitives *primitives=dynamic_cast<const ScenePrimitives*>(objects[i]);
+        if(face!=NULL && (material!=NULL || light!=NULL))
+        {
+            record.kind= material!=NULL ? FACE_PROP : FACE_LIGHT;
+            std::memcpy(record.face, &face->bottomLeft()[0], 3*sizeof(float));
+            std::memcpy(record.face+3, &face->axisW()[0], 3*sizeof(float));
+            std::memcpy(record.face+6, &face->axisH()[0], 3*sizeof(float));
+            record.face[9]=face->width();
+            record.face[10]=face->height();
+        }
+        else if(primitives!=NULL && primitives->isBuilt() && (material!=NULL || light!=NULL))
+        {
+            record.kind= material!=NULL ? PRIMITIVES_PROP : PRIMITIVES_LIGHT;
+            AABB bounds=primitives->bounds();
+            std::memcpy(record.bounds, &bounds.pMin[0], 3*sizeof(float));
+            std::memcpy(record.bounds+3, &bounds.pMax[0], 3*sizeof(float));
+            record.buildCost=primitives->m_bvh.buildCost();
+
+            const void **data=&sectionData[i*SECTION_COUNT];
+            data[SPHERES]=primitives->m_spheres.data();         record.sectionCount[SPHERES]=primitives->m_spheres.size();
+            data[DISKS]=primitives->m_disks.data();             record.sectionCount[DISKS]=primitives->m_disks.size();
+            data[TRIANGLES]=primitives->m_triangles.data();     record.sectionCount[TRIANGLES]=primitives->m_triangles.size();
+            data[QUADS]=primitives->m_quads.data();             record.sectionCount[QUADS]=primitives->m_quads.size();
+            data[REFERENCES]=primitives->m_references.data();   record.sectionCount[REFERENCES]=primitives->m_references.size();
+            data[AREAS]=primitives->m_areas.data();             record.sectionCount[AREAS]=primitives->m_areas.size();
+            data[BVH_NODES]=primitives->m_bvh.nodes().data();   record.sectionCount[BVH_NODES]=primitives->m_bvh.nodes().size();
+            data[BVH_INDICES]=primitives->m_bvh.indices().data(); record.sectionCount[BVH_INDICES]=primitives->m_bvh.indices().size();
+        }
+        else
+        {
+            WARNING("SceneCache: only built faces and registries with material or light properties can be cached");
+            return false;
+        }
+    }
+
+    const size_t elementSizes[SECTION_COUNT]={sizeof(ScenePrimitives::Sphere), sizeof(ScenePrimitives::Disk),
+                                              sizeof(ScenePrimitives::Triangle), sizeof(ScenePrimitives::Quad),
+                                              sizeof(unsigned int), sizeof(double), sizeof(BVH::Node), sizeof(unsigned int)};
+    for(size_t i=0; i<records.size(); ++i)
+    {
+        for(int s=0; s<SECTION_COUNT; ++s)
+        {
+            offset=(offset+ms_alignment-1)/ms_alignment*ms_alignment;
+            records[i].sectionOffset[s]=offset;
+            offset+=records[i].sectionCount[s]*elementSizes[s];
+        }
+    }
+
+    QString temporaryPath=cachePath+".tmp";
+    QFile file(temporaryPath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("SceneCache: couldn't write %s", qPrintable(temporaryPath));
+        return false;
+    }
+
+    //everything is written in the order of the offsets, padding up to each of them
+    uint64_t position=0;
+    bool written=true;
+    std::vector<char> padding(ms_alignment, 0);
+    auto writeAt=[&](uint64_t at, const void *data, uint64_t size)
+    {
+        if(at>position)
+            written=written && file.write(padding.data(), at-position)==(qint64)(at-position);
+        written=written && (size==0 || file.write((const char*)data, size)==(qint64)size);
+        position=at+size;
+    };
+
+    writeAt(0, &header, sizeof(Header));
+    writeAt(header.objectsOffset, records.data(), records.size()*sizeof(ObjectRecord));
+    writeAt(header.sourcesOffset, sourceRecords.data(), sourceRecords.size()*sizeof(SourceRecord));
+    for(size_t i=0; i<paths.size(); ++i)
+        writeAt(sourceRecords[i].pathOffset, paths[i].constData(), paths[i].size());
+    for(size_t i=0; i<records.size(); ++i)
+        for(int s=0; s<SECTION_COUNT; ++s)
+            writeAt(records[i].sectionOffset[s], sectionData[i*SECTION_COUNT+s], records[i].sectionCount[s]*elementSizes[s]);
+    file.close();
+
+    if(!written)
+    {
+        qWarning("SceneCache: couldn't write %s", qPrintable(temporaryPath));
+        QFile::remove(temporaryPath);
+        return false;
+    }
+    QFile::remove(cachePath);
+    if(!file.rename(cachePath))
+    {
+        qWarning("SceneCache: couldn't replace %s", qPrintable(cachePath));
+        QFile::remove(temporaryPath);
+        return false;
+    }
+    return true;
+}
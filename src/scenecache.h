@@ -0,0 +1,110 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include "sceneloader.h"
+#include <QString>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+///
+/// \brief The SceneCache class writes and reads a binary copy of the objects of a loaded scene,
+/// with everything their construction computed: the primitives of the registries, their BVH and their areas.
+/// A cached scene is not parsed nor built again: the file is mapped in memory, and the arrays of the registries
+/// read straight from the mapping (see MappedArray), so the pages are only loaded by the system when a ray reaches them.
+///
+/// The file is made of a header, a table of objects, a table of the source files it was made from
+/// (with a hash of their content), and the arrays of the registries, aligned on 64 bytes.
+/// Only offsets are stored, never pointers. The cache is rejected, and should be written again, when:
+/// - it was written by another version of the format, or a build with another layout of the primitives or nodes,
+/// - one of its sources changed or disappeared.
+///
+/// Only faces and registries are cached, which are what SceneLoader creates.
+///
+class SceneCache
+{
+public:
+
+    /// \brief isValid tells if the cache can be read, and was made from the current version of its sources.
+    static bool isValid(const QString& cachePath);
+
+    ///
+    /// \brief write replaces the cache with the given objects, which must be built.
+    /// The file is written beside and renamed at the end, so that a failed write never leaves a broken cache.
+    /// \param sources the files the objects were loaded from
+    ///
+    static bool write(const QString& cachePath, const std::vector<SceneObject*>& objects,
+                      const SceneLoader::CameraDescription_t& camera, const std::vector<QString>& sources);
+
+    ///
+    /// \brief read appends the cached objects to the manager, without reallocating its buffers.
+    /// The cache is checked before any object is created, but not its sources (see isValid).
+    ///
+    static bool read(const QString& cachePath, SceneManager& manager, SceneLoader::CameraDescription_t& camera);
+
+    /// \brief hashFile is a 64 bits hash of the content of a file, 0 if it can't be read.
+    static uint64_t hashFile(const QString& path);
+
+private:
+
+    typedef enum {FACE_PROP=0, FACE_LIGHT, PRIMITIVES_PROP, PRIMITIVES_LIGHT} ObjectKind_t;
+    typedef enum {SPHERES=0, DISKS, TRIANGLES, QUADS, REFERENCES, AREAS, BVH_NODES, BVH_INDICES, SECTION_COUNT} Section_t;
+
+    class CameraRecord
+    {
+    public:
+        uint32_t    defined;
+        float       position[3];
+        float       viewDirection[3];
+        float       upVector[3];
+        float       fieldOfView;
+        int32_t     width;
+        int32_t     height;
+    };
+
+    class Header
+    {
+    public:
+        char            magic[8];
+        uint32_t        version;
+        uint32_t        layout;         //signature of the sizes of the stored classes
+        uint32_t        objectCount;
+        uint32_t        sourceCount;
+        uint64_t        objectsOffset;  //ObjectRecord[objectCount]
+        uint64_t        sourcesOffset;  //SourceRecord[sourceCount]
+        CameraRecord    camera;
+    };
+
+    class SourceRecord
+    {
+    public:
+        uint64_t    hash;
+        uint64_t    pathOffset;         //UTF-8, not null terminated
+        uint64_t    pathSize;
+    };
+
+    class ObjectRecord
+    {
+    public:
+        uint32_t    kind;
+        float       color[3];
+        float       properties[11];     //material (ambiant, diffuse, specular, specular power, reflection power) or light
+        float       face[11];           //faces: bottom left, axis W, axis H, width, height
+        float       bounds[6];          //registries: bounds and SAH cost of their BVH
+        float       buildCost;
+        uint64_t    sectionOffset[SECTION_COUNT];
+        uint64_t    sectionCount[SECTION_COUNT];
+    };
+
+    /// \brief keeps the file mapped as long as an array reads it
+    class MappedFile;
+
+    static uint32_t layoutSignature();
+    static bool readHeader(const uchar *data, uint64_t size, const Header*& header, const QString& cachePath);
+
+    static const char           ms_magic[8];
+    static const uint32_t       ms_version=1;
+    static const uint64_t       ms_alignment=64;
+};
+
+#endif // SCENECACHE_H
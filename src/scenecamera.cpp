@@ -1,4 +1,6 @@
 #include "scenecamera.h"
+#include "trace.h"
+#include <algorithm>
 
 #ifndef USE_QGLVIEWER
 
@@ -6,17 +8,21 @@ qglviewer_fake::Camera::Camera() :
     m_position(0, 0, 10.0f),
     m_viewDirection(0,0, -1.0f),
     m_rightVector(1.0f, 0, 0),
-    m_upVector(0, 1.0f, 0)
+    m_upVector(0, 1.0f, 0),
+    m_fieldOfView(M_PI/2.0f),
+    m_aspectRatio(16.0f/9.0f),
+    m_screenWidth(800),
+    m_screenHeight(600)
 {}
 
 int qglviewer_fake::Camera::screenWidth()
 {
-    return 800;
+    return m_screenWidth;
 }
 
 int qglviewer_fake::Camera::screenHeight()
 {
-    return 600;
+    return m_screenHeight;
 }
 
 const glm::vec3& qglviewer_fake::Camera::position()
@@ -46,24 +52,76 @@ float qglviewer_fake::Camera::zNear()
 
 float qglviewer_fake::Camera::fieldOfView()
 {
-    return M_PI/2.0f;
+    return m_fieldOfView;
 }
 
 float qglviewer_fake::Camera::aspectRatio()
 {
-    return 16.0f/9.0f;
+    return m_aspectRatio;
+}
+
+void qglviewer_fake::Camera::setPosition(const glm::vec3& position)
+{
+    m_position=position;
+}
+
+void qglviewer_fake::Camera::setViewDirection(const glm::vec3& direction)
+{
+    if(glm::length(direction)<=EPSILON)
+        return;
+    m_viewDirection=glm::normalize(direction);
+    orthonormalize();
+}
+
+void qglviewer_fake::Camera::setUpVector(const glm::vec3& up)
+{
+    if(glm::length(up)<=EPSILON)
+        return;
+    m_upVector=glm::normalize(up);
+    orthonormalize();
+}
+
+void qglviewer_fake::Camera::setFieldOfView(float fov)
+{
+    m_fieldOfView=fov;
+}
+
+void qglviewer_fake::Camera::setScreenWidthAndHeight(int width, int height)
+{
+    m_screenWidth=std::max(width, 1);
+    m_screenHeight=std::max(height, 1);
+    m_aspectRatio=(float)m_screenWidth/m_screenHeight;
+}
+
+void qglviewer_fake::Camera::orthonormalize()
+{
+    glm::vec3 right=glm::cross(m_viewDirection, m_upVector);
+    //an up vector colinear to the view direction says nothing, keep the previous right vector in that case
+    if(glm::length(right)>EPSILON)
+        m_rightVector=glm::normalize(right);
+    m_upVector=glm::normalize(glm::cross(m_rightVector, m_viewDirection));
 }
 
 SceneCamera::SceneCamera(qglviewer_fake::Camera &camera) :
     m_camera        (camera),
-    m_renderedImage (NULL)
+    m_renderedImage (NULL),
+    m_tileSize      (64),
+    m_pixelOrder    (HILBERT),
+    m_tilePixelOrder(),
+    m_tilePixelOrderSize(),
+    m_rays          ()
 {}
 
 #else
 
 SceneCamera::SceneCamera(qglviewer::Camera &camera) :
     m_camera        (camera),
-    m_renderedImage (NULL)
+    m_renderedImage (NULL),
+    m_tileSize      (64),
+    m_pixelOrder    (HILBERT),
+    m_tilePixelOrder(),
+    m_tilePixelOrderSize(),
+    m_rays          ()
 {}
 
 #endif
@@ -74,80 +132,321 @@ SceneCamera::~SceneCamera()
         delete m_renderedImage;
 }
 
+SceneCamera::View SceneCamera::currentView() const
+{
+    View view;
+    view.position = vecToGlmVec3(m_camera.position());
+    view.viewDirection = vecToGlmVec3(m_camera.viewDirection());
+    view.rightVector = vecToGlmVec3(m_camera.rightVector());
+    view.upVector = vecToGlmVec3(m_camera.upVector());
+    view.fieldOfView = (float)m_camera.fieldOfView();
+    view.aspectRatio = (float)m_camera.aspectRatio();
+    view.zNear = (float)m_camera.zNear();
+    view.width = m_camera.screenWidth();
+    view.height = m_camera.screenHeight();
+    return view;
+}
+
 void SceneCamera::setupRendering()
 {
-    //allocate the image and register the current camera state (at least what is useful for us)
+    TRACE_SCOPE("SceneCamera::setupRendering");
+    //allocate the image (or open the file it is streamed to) and register the current camera state (at least what is useful for us)
+    View view = currentView();
     if(m_renderedImage!=NULL)
         delete m_renderedImage;
-    m_renderedImage = new QImage(m_camera.screenWidth(), m_camera.screenHeight(), QImage::Format_RGB888);
-    m_position = vecToGlmVec3(m_camera.position());
+    m_renderedImage = NULL;
+    if(m_outputFile.isEmpty())
+        m_renderedImage = new QImage(view.width, view.height, QImage::Format_RGB888);
+    else if(!m_writer.open(m_outputFile, view.width, view.height))
+        WARNING("SceneCamera: the rendered image will be lost");
 
-    m_viewDirection = vecToGlmVec3(m_camera.viewDirection());
-    m_rightVector = vecToGlmVec3(m_camera.rightVector());
-    m_upVector    = vecToGlmVec3(m_camera.upVector());
+    setupView(view);
+    std::cout << "center of the camera: " << glm::to_string(view.position + view.viewDirection*view.zNear) << std::endl;
+}
+
+void SceneCamera::setupView(const View& view)
+{
+    m_rays = Rays(view);
+}
 
+bool SceneCamera::resumeRendering(const View& view)
+{
+    if(m_renderedImage==NULL || m_renderedImage->width()!=view.width || m_renderedImage->height()!=view.height)
+        return false;
+    setupView(view);
+    return true;
+}
+
+SceneCamera::Rays::Rays() :
+    m_position(0.0f),
+    m_viewDirection(0.0f, 0.0f, -1.0f),
+    m_upVector(0.0f, 1.0f, 0.0f),
+    m_rightVector(1.0f, 0.0f, 0.0f),
+    m_topLeftScreen(0.0f),
+    m_screenWidthReal(0.0f),
+    m_screenHeightReal(0.0f),
+    m_zNear(0.0f),
+    m_pixelsPerUnitX(0.0f),
+    m_pixelsPerUnitY(0.0f),
+    m_width(0),
+    m_height(0)
+{}
+
+SceneCamera::Rays::Rays(const View& view) :
+    m_position(view.position),
+    m_viewDirection(view.viewDirection),
+    m_upVector(view.upVector),
+    m_rightVector(view.rightVector),
+    m_zNear(view.zNear),
+    m_width(view.width),
+    m_height(view.height)
+{
     //project on the zPlane
-    float distanceFromZPlane = (float)m_camera.zNear();
+    float distanceFromZPlane = view.zNear;
     glm::vec3 toZPlaneCenter = m_viewDirection * distanceFromZPlane;
     glm::vec3 zPlaneCenter = m_position + toZPlaneCenter;
 
     //find the zPlane actual width using tan (opposite side = tan(angle)*length adjacent size)
-    m_screenHeightReal = std::tan(m_camera.fieldOfView()/2)*2 * distanceFromZPlane;
-    m_screenWidthReal = m_screenHeightReal * m_camera.aspectRatio();
-
-    std::cout << "center of the camera: " << glm::to_string(zPlaneCenter) << std::endl;
+    m_screenHeightReal = std::tan(view.fieldOfView/2)*2 * distanceFromZPlane;
+    m_screenWidthReal = m_screenHeightReal * view.aspectRatio;
 
     //find the bottom left of the screen for convenience
     m_topLeftScreen = zPlaneCenter + (m_upVector * m_screenHeightReal - m_rightVector * m_screenWidthReal)/2.0f;
+
+    //pixels covered by a unit of the zPlane, seen at a depth of 1
+    m_pixelsPerUnitX = m_zNear * m_width / m_screenWidthReal;
+    m_pixelsPerUnitY = m_zNear * m_height / m_screenHeightReal;
 }
 
-Ray SceneCamera::castRayFromPixel(int x, int y) const
+Ray SceneCamera::Rays::castRay(float x, float y) const
 {
-    if(m_renderedImage==NULL)
-        ERROR("setupRendering() not called before castRayFromPixel!");
     glm::vec3 R3Pixel = m_topLeftScreen
-            + m_rightVector*(((float)x+0.5f)/m_renderedImage->width())  *   m_screenWidthReal
-            - m_upVector*(((float)y+0.5f)/m_renderedImage->height())    *   m_screenHeightReal;
+            + m_rightVector*(x/m_width)  *   m_screenWidthReal
+            - m_upVector*(y/m_height)    *   m_screenHeightReal;
 
     return Ray(m_position, glm::normalize(R3Pixel - m_position));
 }
 
+bool SceneCamera::Rays::project(const glm::vec3& point, float& x, float& y) const
+{
+    glm::vec3 toPoint = point - m_position;
+    float depth = glm::dot(toPoint, m_viewDirection);
+    if(depth<=EPSILON)
+        return false;
+    //back on the zPlane, in pixels from the center of the image
+    float inverseDepth = 1.0f/depth;
+    x = m_width*0.5f + glm::dot(toPoint, m_rightVector)*m_pixelsPerUnitX*inverseDepth;
+    y = m_height*0.5f - glm::dot(toPoint, m_upVector)*m_pixelsPerUnitY*inverseDepth;
+    return true;
+}
+
+Ray SceneCamera::castRayFromPixel(int x, int y) const
+{
+    if(m_rays.width()==0)
+        ERROR("setupRendering() not called before castRayFromPixel!");
+    return m_rays.castRay((float)x+0.5f, (float)y+0.5f);
+}
+
 Ray SceneCamera::castStochasticRayFromPixel(int x, int y) const
 {
-    if(m_renderedImage==NULL)
+    if(m_rays.width()==0)
         ERROR("setupRendering() not called before castStochasticRayFromPixel!");
     std::uniform_real_distribution<float> randomGen(0.0f, 1.0f);
-    glm::vec3 R3Pixel = m_topLeftScreen
-            + m_rightVector*(((float)x+randomGen(Random::genMt19937))/m_renderedImage->width())  *   m_screenWidthReal
-            - m_upVector*(((float)y+randomGen(Random::genMt19937))/m_renderedImage->height())    *   m_screenHeightReal;
+    float dx = randomGen(Random::genMt19937);
+    float dy = randomGen(Random::genMt19937);
+    return m_rays.castRay((float)x+dx, (float)y+dy);
+}
 
-    return Ray(m_position, glm::normalize(R3Pixel - m_position));
+void SceneCamera::setOutputFile(const QString& path)
+{
+    m_outputFile=path;
+}
+
+void SceneCamera::setTileSize(int size)
+{
+    m_tileSize=std::max(size, 1);
+}
+
+void SceneCamera::setPixelOrder(PixelOrder_t order)
+{
+    m_pixelOrder=order;
+    m_tilePixelOrder.clear();
+}
+
+const std::vector<SceneCamera::TilePixel>& SceneCamera::tilePixels(const RenderTile& tile)
+{
+    //the tiles mostly have the same size, only the last row and column are smaller
+    if(m_tilePixelOrder.empty() || tile.width!=m_tilePixelOrderSize.width || tile.height!=m_tilePixelOrderSize.height)
+    {
+        tilePixels(tile.width, tile.height, m_pixelOrder, m_tilePixelOrder);
+        m_tilePixelOrderSize=tile;
+    }
+    return m_tilePixelOrder;
+}
+
+void SceneCamera::tilePixels(int width, int height, PixelOrder_t order, std::vector<TilePixel>& pixels)
+{
+    pixels.clear();
+    pixels.reserve(std::max(width*height, 0));
+    TilePixel pixel;
+    if(order==COLUMN_MAJOR || order==ROW_MAJOR)
+    {
+        int outer = order==COLUMN_MAJOR ? width : height;
+        int inner = order==COLUMN_MAJOR ? height : width;
+        for(int i=0; i<outer; ++i)
+        {
+            for(int j=0; j<inner; ++j)
+            {
+                pixel.x = order==COLUMN_MAJOR ? i : j;
+                pixel.y = order==COLUMN_MAJOR ? j : i;
+                pixels.push_back(pixel);
+            }
+        }
+        return;
+    }
+
+    //the curves cover a square of a power of 2, whose points outside of the tile are skipped
+    int side=1;
+    while(side<width || side<height)
+        side*=2;
+    for(int d=0; d<side*side; ++d)
+    {
+        int x=0, y=0;
+        if(order==MORTON)
+        {
+            //even bits of d give x, odd bits give y
+            for(int bit=0; (1<<bit)<side; ++bit)
+            {
+                x |= ((d>>(2*bit))&1)<<bit;
+                y |= ((d>>(2*bit+1))&1)<<bit;
+            }
+        }
+        else
+        {
+            //each pair of bits of d picks a quadrant, which is rotated so that the curve stays continuous
+            for(int s=1, t=d; s<side; s*=2, t/=4)
+            {
+                int rx=1&(t/2);
+                int ry=1&(t^rx);
+                if(ry==0)
+                {
+                    if(rx==1)
+                    {
+                        x=s-1-x;
+                        y=s-1-y;
+                    }
+                    std::swap(x, y);
+                }
+                x+=s*rx;
+                y+=s*ry;
+            }
+        }
+        if(x<width && y<height)
+        {
+            pixel.x=x;
+            pixel.y=y;
+            pixels.push_back(pixel);
+        }
+    }
+}
+
+int SceneCamera::tileCount() const
+{
+    return tileCount(m_rays.width(), m_rays.height(), m_tileSize);
+}
+
+SceneCamera::RenderTile SceneCamera::tile(int i) const
+{
+    return tile(i, m_rays.width(), m_rays.height(), m_tileSize);
+}
+
+int SceneCamera::tileCount(int width, int height, int tileSize)
+{
+    int columns=(width+tileSize-1)/tileSize;
+    int rows=(height+tileSize-1)/tileSize;
+    return columns*rows;
+}
+
+SceneCamera::RenderTile SceneCamera::tile(int i, int width, int height, int tileSize)
+{
+    int columns=(width+tileSize-1)/tileSize;
+    RenderTile tile;
+    tile.x=(i%columns)*tileSize;
+    tile.y=(i/columns)*tileSize;
+    tile.width=std::min(tileSize, width-tile.x);
+    tile.height=std::min(tileSize, height-tile.y);
+    return tile;
+}
+
+SceneCamera::RenderTile SceneCamera::beginTile(int i)
+{
+    m_currentTile=tile(i);
+    if(m_renderedImage==NULL)
+        m_tilePixels.assign(m_currentTile.width*m_currentTile.height*3, 0);
+    return m_currentTile;
+}
+
+void SceneCamera::endTile()
+{
+    TRACE_SCOPE("SceneCamera::endTile");
+    if(m_renderedImage==NULL && m_writer.isOpen())
+        m_writer.writeTile(m_currentTile.x, m_currentTile.y, m_currentTile.width, m_currentTile.height, m_tilePixels.data());
 }
 
 void SceneCamera::setPixelf(int x, int y, float r, float g, float b)
 {
-    m_renderedImage->setPixel(x, y, qRgb(int(r*255), int(g*255), int(b*255)));
+    storePixel(x, y, qRgb(int(r*255), int(g*255), int(b*255)));
 }
 
 void SceneCamera::setPixelfv(int x, int y, const glm::vec3 *rgb)
 {
-    m_renderedImage->setPixel(x, y, qRgb(int(rgb->r*255), int(rgb->g*255), int(rgb->b*255)));
+    storePixel(x, y, qRgb(int(rgb->r*255), int(rgb->g*255), int(rgb->b*255)));
 }
 
 void SceneCamera::setPixelb(int x, int y, unsigned char r, unsigned char g, unsigned char b)
 {
-    m_renderedImage->setPixel(x, y, qRgb(r,g,b));
+    storePixel(x, y, qRgb(r,g,b));
 }
 
 void SceneCamera::setPixelbv(int x, int y, const unsigned char *rgb)
 {
-    m_renderedImage->setPixel(x, y, qRgb(rgb[0],rgb[1],rgb[2]));
+    storePixel(x, y, qRgb(rgb[0],rgb[1],rgb[2]));
 }
 
-void SceneCamera::showBeautifulRender()
+void SceneCamera::showBeautifulRender(const CostMap *costMap)
 {
-    if(m_renderedImage==NULL)
+    TRACE_SCOPE("SceneCamera::showBeautifulRender");
+    if(m_rays.width()==0)
         ERROR("setupRendering() not called before showBeautifulRender!");
+    if(costMap!=NULL && costMap->isEmpty())
+        costMap=NULL;
+    if(m_renderedImage==NULL)
+    {
+        if(m_writer.close())
+            std::cout << "rendered image saved in " << m_outputFile.toStdString() << std::endl;
+        if(costMap!=NULL)
+        {
+            QString base=m_outputFile.endsWith(".ppm", Qt::CaseInsensitive) ? m_outputFile.left(m_outputFile.size()-4) : m_outputFile;
+            for(int c=0; c<CostMap::CHANNEL_COUNT; ++c)
+            {
+                QString path=base+"_cost_"+CostMap::channelName((CostMap::Channel_t)c)+".ppm";
+                if(costMap->write(path, (CostMap::Channel_t)c))
+                    std::cout << "cost map saved in " << path.toStdString() << std::endl;
+            }
+        }
+        return;
+    }
     m_dialog.setImage(m_renderedImage);
+    QStringList names;
+    std::vector<QImage> overlays;
+    if(costMap!=NULL)
+    {
+        for(int c=0; c<CostMap::CHANNEL_COUNT; ++c)
+        {
+            names << QString("Cost: ")+CostMap::channelName((CostMap::Channel_t)c);
+            overlays.push_back(costMap->overlay(*m_renderedImage, (CostMap::Channel_t)c));
+        }
+    }
+    m_dialog.setOverlays(names, overlays);
     m_dialog.show();
 }
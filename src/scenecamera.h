@@ -11,6 +11,9 @@
 #include <iostream>
 #include <random>
 #include "errorsHandler.hpp"
+#include "tiledimagewriter.h"
+#include "costmap.h"
+#include <vector>
 
 
 
@@ -40,11 +43,27 @@ public:
     float fieldOfView();
     float aspectRatio();
 
+    //same setters as qglviewer::Camera, so that scenes can place the camera in both builds
+
+    void setPosition(const glm::vec3& position);
+    void setViewDirection(const glm::vec3& direction);
+    void setUpVector(const glm::vec3& up);
+    void setFieldOfView(float fov);
+    void setScreenWidthAndHeight(int width, int height);
+
 private:
-    const glm::vec3 m_position;
-    const glm::vec3 m_viewDirection;
-    const glm::vec3 m_rightVector;
-    const glm::vec3 m_upVector;
+    /// \brief keeps the 3 axis orthonormal after the view direction or the up vector changed.
+    void orthonormalize();
+
+    glm::vec3 m_position;
+    glm::vec3 m_viewDirection;
+    glm::vec3 m_rightVector;
+    glm::vec3 m_upVector;
+
+    float   m_fieldOfView;
+    float   m_aspectRatio;
+    int     m_screenWidth;
+    int     m_screenHeight;
 };
 
 }
@@ -62,10 +81,167 @@ public:
 
     ~SceneCamera();
 
+    ///
+    /// \brief The RenderTile class is a rectangle of pixels of the rendered image.
+    ///
+    class RenderTile
+    {
+    public:
+        int x, y;
+        int width, height;
+    };
+
+    ///
+    /// \brief setOutputFile makes the next renderings stream the image to a binary PPM file instead of showing it:
+    /// only the tile being rendered is held in memory, so the size of the image is only limited by the disk.
+    /// An empty path (the default) renders the whole image in memory, and shows it in a dialog.
+    ///
+    void setOutputFile(const QString& path);
+    inline const QString& outputFile() const {return m_outputFile;}
+
+    /// \brief renderedImage is the image of the last rendering, NULL if it was streamed to the output file.
+    inline const QImage* renderedImage() const {return m_renderedImage;}
+
+    /// \brief setTileSize sets the size of the square tiles the image is rendered by (64 by default).
+    void setTileSize(int size);
+    inline int tileSize() const {return m_tileSize;}
+
+    ///
+    /// \brief The PixelOrder_t enum is the order the pixels of a tile are rendered in.
+    /// COLUMN_MAJOR goes down one column after the other, across the rows of the image.
+    /// ROW_MAJOR follows the rows, in the order the pixels of the image are stored.
+    /// MORTON (Z-order) and HILBERT follow space-filling curves, so that consecutive rays stay close in both
+    /// directions and traverse the same nodes of the acceleration structures while they are in the cache.
+    /// The Hilbert curve never jumps between pixels, the Morton curve is cheaper but jumps at each power of 2.
+    ///
+    typedef enum {COLUMN_MAJOR, ROW_MAJOR, MORTON, HILBERT} PixelOrder_t;
+
+    /// \brief setPixelOrder sets the order of the pixels of the tiles (HILBERT by default).
+    void setPixelOrder(PixelOrder_t order);
+    inline PixelOrder_t pixelOrder() const {return m_pixelOrder;}
+
+    ///
+    /// \brief The TilePixel class is a pixel of a tile, relative to its top left corner.
+    ///
+    class TilePixel
+    {
+    public:
+        unsigned short x, y;
+    };
+
+    /// \brief tilePixels the pixels of a tile of this size, in the order set by setPixelOrder().
+    const std::vector<TilePixel>& tilePixels(const RenderTile& tile);
+
+    /// \brief tilePixels fills the pixels of a tile in some order, for renderings which don't use the camera.
+    static void tilePixels(int width, int height, PixelOrder_t order, std::vector<TilePixel>& pixels);
+
+    ///
+    /// \brief The View class is what a rendering needs from the camera, copied so that the camera can move
+    /// while a rendering goes on in the background (see RenderJob).
+    ///
+    class View
+    {
+    public:
+        glm::vec3   position;
+        glm::vec3   viewDirection;
+        glm::vec3   upVector;
+        glm::vec3   rightVector;
+        float       fieldOfView;
+        float       aspectRatio;
+        float       zNear;
+        int         width, height;
+
+        inline bool operator==(const View& other) const
+        {
+            return position==other.position && viewDirection==other.viewDirection && upVector==other.upVector
+                    && rightVector==other.rightVector && fieldOfView==other.fieldOfView && aspectRatio==other.aspectRatio
+                    && zNear==other.zNear && width==other.width && height==other.height;
+        }
+        inline bool operator!=(const View& other) const {return !(*this==other);}
+    };
+
+    /// \brief currentView copies the current state of the camera, from the thread the camera belongs to.
+    View currentView() const;
+
+    ///
+    /// \brief The Rays class casts the rays of a view. It is small and copyable, so that renderings running
+    /// in the background keep their own rays instead of setting up the camera (see RenderJob, PreviewRenderer).
+    /// Points of the image are given in pixels, (0,0) being the top left corner of the image.
+    ///
+    class Rays
+    {
+    public:
+        Rays();
+        explicit Rays(const View& view);
+
+        inline int width() const                    {return m_width;}
+        inline int height() const                   {return m_height;}
+        inline const glm::vec3& position() const    {return m_position;}
+
+        /// \brief castRay casts the ray through the point (x,y) of the image (the center of pixel (i,j) is (i+0.5,j+0.5)).
+        Ray castRay(float x, float y) const;
+
+        ///
+        /// \brief project finds the point (x,y) of the image a point of the scene is seen at.
+        /// \return false if the point is behind the camera (x and y are then undefined)
+        ///
+        bool project(const glm::vec3& point, float& x, float& y) const;
+
+    private:
+        glm::vec3   m_position;
+        glm::vec3   m_viewDirection;
+        glm::vec3   m_upVector;
+        glm::vec3   m_rightVector;
+        glm::vec3   m_topLeftScreen;
+        float       m_screenWidthReal, m_screenHeightReal;
+        float       m_zNear;
+        float       m_pixelsPerUnitX, m_pixelsPerUnitY;     //see project()
+        int         m_width, m_height;
+    };
+
+    /// \brief rays the rays set up by setupRendering() or setupView().
+    inline const Rays& rays() const {return m_rays;}
+
+    ///
+    /// \brief setupRendering allocates the image (or opens the output file) and sets up the rays of the current view.
+    ///
     void setupRendering();
 
-    int width() const {return m_renderedImage != NULL ? m_renderedImage->width() : 0;}
-    int height() const {return m_renderedImage != NULL ? m_renderedImage->height() : 0;}
+    ///
+    /// \brief setupView sets up the rays of a view, without allocating any image: the pixels are then
+    /// kept by the caller, who must not call setPixel* nor showBeautifulRender.
+    ///
+    void setupView(const View& view);
+
+    ///
+    /// \brief resumeRendering sets up the rays of a view again, keeping the image of the last rendering, so that only
+    /// some of its tiles are rendered again before it is shown. Images streamed to a file can't be resumed.
+    /// \return false if there is no image of the size of the view to resume
+    ///
+    bool resumeRendering(const View& view);
+
+    int width() const {return m_rays.width();}
+    int height() const {return m_rays.height();}
+
+    //tiles, in row major order. Renderings go through every tile between beginTile() and endTile(),
+    //and only set the pixels of the current tile.
+
+    int tileCount() const;
+    RenderTile tile(int i) const;
+
+    //the same tiles, for an image of any size
+    static int tileCount(int width, int height, int tileSize);
+    static RenderTile tile(int i, int width, int height, int tileSize);
+
+    ///
+    /// \brief beginTile starts tile i, whose pixels are then given by setPixel*.
+    ///
+    RenderTile beginTile(int i);
+
+    ///
+    /// \brief endTile writes the current tile to the output file, if any.
+    ///
+    void endTile();
 
     Ray castRayFromPixel(int x, int y) const;
     Ray castStochasticRayFromPixel(int x, int y) const;
@@ -84,11 +260,19 @@ public:
     static glm::vec3 vecToGlmVec3(const glm::vec3& v) {return v;}
     static glm::vec3 glmVec3ToVec(const glm::vec3 &v) {return v;}
 #endif
-    void showBeautifulRender();
+
+    ///
+    /// \brief showBeautifulRender shows the rendered image, or closes the output file it was streamed to.
+    /// \param costMap if not NULL, the heatmaps of its channels are shown over the image in the dialog,
+    /// or written next to the output file (image.ppm gives image_cost_time.ppm, and so on)
+    ///
+    void showBeautifulRender(const CostMap *costMap=NULL);
 
 
 private:
 
+    inline void storePixel(int x, int y, QRgb color);
+
 #ifdef USE_QGLVIEWER
     qglviewer::Camera   &m_camera;
 #else
@@ -97,20 +281,34 @@ private:
 
 
 
-    QImage              *m_renderedImage;
-
-    glm::vec3           m_position;
+    QImage              *m_renderedImage;   //NULL when the image is streamed to m_outputFile
 
-    glm::vec3           m_viewDirection;
-    glm::vec3           m_upVector;
-    glm::vec3           m_rightVector;
+    QString             m_outputFile;
+    TiledImageWriter    m_writer;
+    int                 m_tileSize;
+    PixelOrder_t        m_pixelOrder;
+    std::vector<TilePixel> m_tilePixelOrder;   //last order given by tilePixels(), for tiles of m_tilePixelOrderSize
+    RenderTile          m_tilePixelOrderSize;
+    RenderTile          m_currentTile;
+    std::vector<unsigned char> m_tilePixels;   //RGB pixels of the current tile, when streaming
 
-    float m_screenWidthReal, m_screenHeightReal;
-
-    glm::vec3           m_topLeftScreen;
+    Rays                m_rays;
 
     Dialog_RenderedImage m_dialog;
 
 };
 
+void SceneCamera::storePixel(int x, int y, QRgb color)
+{
+    if(m_renderedImage!=NULL)
+        m_renderedImage->setPixel(x, y, color);
+    else
+    {
+        unsigned char *pixel=&m_tilePixels[((y-m_currentTile.y)*m_currentTile.width + (x-m_currentTile.x))*3];
+        pixel[0]=qRed(color);
+        pixel[1]=qGreen(color);
+        pixel[2]=qBlue(color);
+    }
+}
+
 #endif // SCENECAMERA_H
@@ -1,4 +1,5 @@
 #include "sceneface.h"
+#include "renderstats.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <iostream>
@@ -38,6 +39,7 @@ void SceneFace::intersectsRay(const Ray &ray, RayHitProperties& properties)
     //to do this, first we check if the ray intersects the plane defined by the face,
     //then we check if the point on the plane is inside the face.
     //This approach allows us to eliminate every cases where the ray isn't even able to intersect the plane before it does.
+    RENDER_STATS_ADD(intersectionTests, 1);
 
     float NdotrD=glm::dot(m_normal, ray.direction());
     if(std::abs(NdotrD)>EPSILON)
@@ -64,6 +66,8 @@ void SceneFace::intersectsRay(const Ray &ray, RayHitProperties& properties)
                 //We found a new intersection better than any previous intersection.
                 properties.occuredHit   = true;
                 properties.objectHit    = this;
+                properties.primitiveHit = 0;
+                properties.instanceHit  = NULL;
                 properties.positionHit  = pM;
                 properties.normalHit    = NdotrD>0 ? -m_normal : m_normal;
                 properties.distanceHit  = distanceFromPlane;
@@ -73,6 +77,17 @@ void SceneFace::intersectsRay(const Ray &ray, RayHitProperties& properties)
     return;
 }
 
+AABB SceneFace::bounds() const
+{
+    AABB box;
+    for(unsigned int i=0; i<4; ++i)
+        box.extend(m_P[i]);
+    //faces are flat, give them some thickness so that the box is never degenerated
+    box.pMin-=glm::vec3(EPSILON);
+    box.pMax+=glm::vec3(EPSILON);
+    return box;
+}
+
 SceneFace::Integral SceneFace::beginIntegral(size_t N, Integral::Type_t type) const
 {
     Integral ui;
@@ -90,10 +105,14 @@ SceneFace::Integral SceneFace::beginIntegral(size_t N, Integral::Type_t type) co
         break;
 
     case Integral::UNIFORM_RANDOM:
+    {
+        std::uniform_real_distribution<float> randomGen(0.0f, 1.0f);
         ui.size=N;
         ui.actualSize=N*N;
-        ui.value=(m_P[0]+m_P[1]+m_P[2]+m_P[3])/4.0f;
+        float u=randomGen(Random::genMt19937);
+        ui.value=m_P[0] + m_axisW * (u * m_width) + m_axisH * (randomGen(Random::genMt19937) * m_height);
         break;
+    }
 
     default: //single_mean or invalid
         ui.size=1;
@@ -123,7 +142,8 @@ void SceneFace::nextIntegral(Integral& integral) const
     case Integral::UNIFORM_RANDOM:
     {
         std::uniform_real_distribution<float> randomGen(0.0f, 1.0f);
-        integral.value=m_P[0] + m_axisW * randomGen(Random::genMt19937) / m_width + m_axisH * randomGen(Random::genMt19937) / m_height;
+        float u=randomGen(Random::genMt19937);
+        integral.value=m_P[0] + m_axisW * (u * m_width) + m_axisH * (randomGen(Random::genMt19937) * m_height);
         break;
     }
     default: //single_mean or invalid
@@ -152,6 +172,45 @@ SceneFace::Integral SceneFace::endIntegral(size_t N, Integral::Type_t type) cons
     return ui;
 }
 
+void SceneFace::sampleSurface(size_t N, Integral::Type_t type, LightSamples& samples) const
+{
+    float density=1.0f/(m_width*m_height);
+    switch(type)
+    {
+    case Integral::UNIFORM:
+    {
+        //same grid as nextIntegral(), from the bottom left corner to the top right one
+        samples.resize(N*N);
+        for(size_t j=0; j<N; ++j)
+        {
+            for(size_t i=0; i<N; ++i)
+            {
+                if(i==0 && j==0)
+                    samples.set(0, m_P[0], density);
+                else
+                    samples.set(j*N+i, m_P[0] + m_axisW * ((float)i / (N-1)) * m_width
+                                              + m_axisH * ((float)j / (N-1)) * m_height, density);
+            }
+        }
+        break;
+    }
+    case Integral::UNIFORM_RANDOM:
+    {
+        std::uniform_real_distribution<float> randomGen(0.0f, 1.0f);
+        samples.resize(N*N);
+        for(size_t i=0; i<N*N; ++i)
+        {
+            float u=randomGen(Random::genMt19937);
+            samples.set(i, m_P[0] + m_axisW * (u * m_width) + m_axisH * (randomGen(Random::genMt19937) * m_height), density);
+        }
+        break;
+    }
+    default: //single_mean or invalid
+        samples.resize(1);
+        samples.set(0, (m_P[0]+m_P[1]+m_P[2]+m_P[3])/4.0f, density);
+    }
+}
+
 //OpenGL sizes
 
 GLint SceneFace::numberAttributes() const
@@ -197,27 +256,8 @@ void SceneFace::draw() const
     glDrawElementsBaseVertex(GL_TRIANGLE_FAN, sizeEBO(), GL_UNSIGNED_INT, (GLvoid*)(m_firstEBO), m_baseVertexEBO);
 }
 
-glm::vec3 SceneFace_Prop::colorAmbiant(const SceneFace_Light &light) const
+void SceneFace::drawInstanced(GLsizei instanceCount) const
 {
-    return light.lightProperties().vAmbiant * m_materialProperties.vAmbiant;
-}
-
-glm::vec3 SceneFace_Prop::colorDiffuse(const SceneFace_Light &light, const glm::vec3 &N, const glm::vec3 &L) const
-{
-    // calculation as for Lambertian reflection
-    float NdotL = glm::dot(N , L);
-    float diffuseTerm = std::max(0.0f, NdotL); //0 <= diffuseTerm <= 1
-
-    return light.lightProperties().vDiffuse * diffuseTerm * m_materialProperties.vDiffuse;
-}
-
-glm::vec3 SceneFace_Prop::colorSpecular(const SceneFace_Light &light, const glm::vec3 &N, const glm::vec3 &L, const glm::vec3 &vToEye) const
-{
-    //get light reflected from the surface
-    glm::vec3 reflectedL = glm::reflect(-L , N);
-
-    float specularTerm = std::pow( std::max(0.0f, glm::dot(reflectedL, vToEye)), m_materialProperties.fSpecularPower );
-    //0 <= specularTerm <= 1
-
-    return m_materialProperties.vSpecular * specularTerm * light.lightProperties().vSpecular;
+    glUniform3fv(ms_uniformColorLocation, 1, &m_color[0]);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLE_FAN, 4, GL_UNSIGNED_INT, (GLvoid*)(m_firstEBO), instanceCount, m_baseVertexEBO);
 }
@@ -2,6 +2,7 @@
 #define SCENEFACE_H
 
 #include "sceneobject.h"
+#include "material.h"
 
 ///
 /// \brief The SceneFace class is a representation of a static face in a scene with
@@ -14,11 +15,22 @@ public:
 
     void intersectsRay(const Ray &ray, RayHitProperties& properties);
 
+    AABB bounds() const;
+
+    //geometry, as given to the constructor (with normalized and orthogonal directions)
+
+    inline const glm::vec3& bottomLeft() const  {return m_P[0];}
+    inline const glm::vec3& axisW() const       {return m_axisW;}
+    inline const glm::vec3& axisH() const       {return m_axisH;}
+    inline float width() const                  {return m_width;}
+    inline float height() const                 {return m_height;}
+
     //Uniform integration
 
     Integral beginIntegral(size_t N=0, Integral::Type_t type=Integral::SINGLE_MEAN) const;
     void nextIntegral(Integral& integral) const;
     Integral endIntegral(size_t N=0, Integral::Type_t type=Integral::SINGLE_MEAN) const;
+    void sampleSurface(size_t N, Integral::Type_t type, LightSamples& samples) const;
 
     //OpenGL sizes
 
@@ -35,6 +47,7 @@ public:
     //OpenGL draw with given VBO and EBO segments
 
     void draw() const;
+    void drawInstanced(GLsizei instanceCount) const;
 
 private:
 
@@ -55,63 +68,29 @@ private:
     float m_height;
 };
 
-class SceneFace_Light;
-
 ///
 /// \brief The SceneFace_Prop class is a representation of a SceneFace with
 ///  phong material properties for advanced rendering.
 ///
-class SceneFace_Prop : public SceneFace
+class SceneFace_Prop : public SceneFace, public MaterialProp
 {
 public:
 
     SceneFace_Prop(const glm::vec3& p0, const glm::vec3& directionW, const glm::vec3& directionH, float w, float h) :
         SceneFace(p0, directionW, directionH, w, h)
     {}
-
-    typedef struct
-    {
-        glm::vec3   vAmbiant;
-        glm::vec3   vDiffuse;
-        glm::vec3   vSpecular;
-        float       fSpecularPower;
-        float       fReflectionPower;
-    } MaterialProperties_t;
-
-    inline void setMaterialProperties(const MaterialProperties_t& properties)   {m_materialProperties=properties;}
-    inline const MaterialProperties_t& materialProperties() const               {return m_materialProperties;}
-
-    glm::vec3 colorAmbiant(const SceneFace_Light &light) const;
-    glm::vec3 colorDiffuse(const SceneFace_Light &light, const glm::vec3 &N, const glm::vec3 &L) const;
-    glm::vec3 colorSpecular(const SceneFace_Light &light, const glm::vec3 &N, const glm::vec3 &L, const glm::vec3 &vToEye) const;
-
-private:
-        MaterialProperties_t                m_materialProperties;       //properties of material in the scene
 };
 
 ///
 /// \brief The SceneFace_Light class is a representation of a SceneFace with
 ///  phong light properties for advanced rendering.
 ///
-class SceneFace_Light : public SceneFace
+class SceneFace_Light : public SceneFace, public LightSource
 {
 public:
     SceneFace_Light(const glm::vec3& p0, const glm::vec3& directionW, const glm::vec3& directionH, float w, float h):
         SceneFace(p0, directionW, directionH, w, h)
     {}
-
-    typedef struct
-    {
-        glm::vec3   vAmbiant;
-        glm::vec3   vDiffuse;
-        glm::vec3   vSpecular;
-    } LightProperties_t;
-
-    inline void setLightProperties(const LightProperties_t& properties)     {m_lightProperties=properties;}
-    inline const LightProperties_t& lightProperties() const                 {return m_lightProperties;}
-
-private :
-    LightProperties_t                   m_lightProperties;          //properties of light source in the scene
 };
 
 #endif // SCENEFACE_H
@@ -0,0 +1,333 @@
+#include "sceneinstance.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+
+//SceneGroup
+
+SceneGroup::SceneGroup() :
+    SceneObject(),
+    m_objects(),
+    m_instances(),
+    m_bvh(),
+    m_bvh4(),
+    m_objectBounds(),
+    m_built(false),
+    m_wideBVH(false)
+{
+}
+
+SceneGroup::~SceneGroup()
+{
+    //the instances left behind show nothing anymore
+    for(std::vector<SceneInstance*>::iterator it=m_instances.begin(); it!=m_instances.end(); ++it)
+        (*it)->m_group=NULL;
+    for(std::vector<SceneObject*>::iterator it=m_objects.begin(); it!=m_objects.end(); ++it)
+        delete (*it);
+}
+
+void SceneGroup::append(SceneObject* object)
+{
+    if(object!=NULL)
+    {
+        m_objects.push_back(object);
+        m_built=false;
+    }
+}
+
+void SceneGroup::build()
+{
+    std::vector<AABB> objectsBounds;
+    objectsBounds.reserve(m_objects.size());
+    m_objectBounds=AABB();
+    for(std::vector<SceneObject*>::const_iterator it=m_objects.begin(); it!=m_objects.end(); ++it)
+    {
+        objectsBounds.push_back((*it)->bounds());
+        m_objectBounds.extend(objectsBounds.back());
+    }
+    m_bvh.build(objectsBounds);
+    if(m_wideBVH)
+        m_bvh4.build(m_bvh);
+    else
+        m_bvh4.clear();
+    m_built=true;
+}
+
+void SceneGroup::setWideBVH(bool wide)
+{
+    if(wide!=m_wideBVH)
+    {
+        m_wideBVH=wide;
+        m_built=false;
+    }
+}
+
+void SceneGroup::intersectsRayObjectSpace(const Ray &ray, RayHitProperties& properties) const
+{
+    if(!m_built)
+        ERROR("SceneGroup: build() not called before casting rays against the group!");
+
+    const std::vector<SceneObject*>& objects=m_objects;
+    auto intersector=[&objects](unsigned int i, const Ray& r, RayHitProperties& p) {objects[i]->intersectsRay(r, p);};
+    if(m_wideBVH)
+        m_bvh4.intersectsRay(ray, properties, intersector);
+    else
+        m_bvh.intersectsRay(ray, properties, intersector);
+}
+
+void SceneGroup::intersectsRay(const Ray &/*ray*/, RayHitProperties& /*properties*/)
+{
+    //only the instances of the group can be hit
+}
+
+AABB SceneGroup::bounds() const
+{
+    return AABB();
+}
+
+SceneObject::Integral SceneGroup::beginIntegral(size_t /*N*/, Integral::Type_t /*type*/) const
+{
+    Integral ui;
+    ui.type=Integral::SINGLE_MEAN;
+    ui.index=0;
+    ui.size=1;
+    ui.actualSize=1;
+    ui.value=m_objectBounds.center();
+    return ui;
+}
+
+void SceneGroup::nextIntegral(Integral& integral) const
+{
+    ++integral.index;
+}
+
+SceneObject::Integral SceneGroup::endIntegral(size_t /*N*/, Integral::Type_t /*type*/) const
+{
+    Integral ui;
+    ui.index=1;
+    return ui;
+}
+
+//OpenGL sizes
+
+GLint SceneGroup::numberAttributes() const
+{
+    GLint number=0;
+    for(std::vector<SceneObject*>::const_iterator it=m_objects.begin(); it!=m_objects.end(); ++it)
+        number+=(*it)->numberAttributes();
+    return number;
+}
+
+GLsizeiptr SceneGroup::sizeVBOPosition() const
+{
+    GLsizeiptr size=0;
+    for(std::vector<SceneObject*>::const_iterator it=m_objects.begin(); it!=m_objects.end(); ++it)
+        size+=(*it)->sizeVBOPosition();
+    return size;
+}
+
+GLsizeiptr SceneGroup::sizeEBO() const
+{
+    GLsizeiptr size=0;
+    for(std::vector<SceneObject*>::const_iterator it=m_objects.begin(); it!=m_objects.end(); ++it)
+        size+=(*it)->sizeEBO();
+    return size;
+}
+
+//OpenGL fill given VBO and EBO segment
+
+void SceneGroup::layoutObjects() const
+{
+    GLintptr firstVBOPosition=m_firstVBOPosition;
+    GLintptr firstEBO=m_firstEBO;
+    GLintptr baseVertex=m_baseVertexEBO;
+    for(std::vector<SceneObject*>::const_iterator it=m_objects.begin(); it!=m_objects.end(); ++it)
+    {
+        SceneObject *object=(*it);
+        object->setFirstVBOPosition(firstVBOPosition);
+        object->setFirstEBO(firstEBO);
+        object->setBaseVertexEBO(baseVertex);
+
+        firstVBOPosition    +=  object->sizeVBOPosition();
+        firstEBO            +=  object->sizeEBO();
+        baseVertex          +=  object->numberAttributes();
+    }
+}
+
+void SceneGroup::makeVBOPosition(GLint vboId) const
+{
+    layoutObjects();
+    for(std::vector<SceneObject*>::const_iterator it=m_objects.begin(); it!=m_objects.end(); ++it)
+        (*it)->makeVBOPosition(vboId);
+}
+
+void SceneGroup::makeEBO(GLint eboId) const
+{
+    layoutObjects();
+    for(std::vector<SceneObject*>::const_iterator it=m_objects.begin(); it!=m_objects.end(); ++it)
+        (*it)->makeEBO(eboId);
+}
+
+//OpenGL draw with given VBO and EBO segments
+
+void SceneGroup::draw() const
+{
+    if(m_instances.empty() || ms_attribInstanceMatrixLocation<0)
+        return;
+
+    //send the instance matrices, then draw every instance of every object at once
+    std::vector<glm::mat4> matrices;
+    matrices.reserve(m_instances.size());
+    for(std::vector<SceneInstance*>::const_iterator it=m_instances.begin(); it!=m_instances.end(); ++it)
+        matrices.push_back((*it)->transform());
+
+    glBindBuffer(GL_ARRAY_BUFFER, ms_vboInstanceId);
+    glBufferData(GL_ARRAY_BUFFER, matrices.size()*sizeof(glm::mat4), glm::value_ptr(matrices[0]), GL_STREAM_DRAW);
+    for(GLuint i=0; i<4; ++i)
+    {
+        //a mat4 attribute takes 4 locations, one per column
+        GLuint location=ms_attribInstanceMatrixLocation+i;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(i*sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    drawInstanced(m_instances.size());
+
+    resetInstanceMatrix();
+}
+
+void SceneGroup::drawInstanced(GLsizei instanceCount) const
+{
+    for(std::vector<SceneObject*>::const_iterator it=m_objects.begin(); it!=m_objects.end(); ++it)
+        (*it)->drawInstanced(instanceCount);
+}
+
+//SceneInstance
+
+SceneInstance::SceneInstance(SceneGroup *group, const glm::mat4& transform) :
+    SceneObject(),
+    m_group(group)
+{
+    if(m_group==NULL)
+        ERROR("SceneInstance: an instance must reference a group");
+    m_group->m_instances.push_back(this);
+    setTransform(transform);
+    //not a move: the instance isn't in a scene yet
+    m_moved=false;
+}
+
+SceneInstance::~SceneInstance()
+{
+    if(m_group==NULL)
+        return;
+    std::vector<SceneInstance*>& instances=m_group->m_instances;
+    instances.erase(std::remove(instances.begin(), instances.end(), this), instances.end());
+}
+
+void SceneInstance::setTransform(const glm::mat4& transform)
+{
+    m_transform=transform;
+    m_inverseTransform=glm::inverse(transform);
+    m_normalMatrix=glm::transpose(glm::mat3(m_inverseTransform));
+    setMoved();
+}
+
+#ifdef USE_QGLVIEWER
+void SceneInstance::setFrame(const qglviewer::Frame& frame)
+{
+    //both are column major
+    GLdouble m[16];
+    frame.getWorldMatrix(m);
+    glm::mat4 transform;
+    for(unsigned int i=0; i<16; ++i)
+        glm::value_ptr(transform)[i]=(float)m[i];
+    setTransform(transform);
+}
+#endif
+
+void SceneInstance::intersectsRay(const Ray &ray, RayHitProperties& properties)
+{
+    if(m_group==NULL)
+        return;
+
+    //bring the ray into object space. The direction is not normalized on purpose:
+    //that way the distances along the ray are the same in both spaces and can be compared with the other hits.
+    Ray objectRay(glm::vec3(m_inverseTransform * glm::vec4(ray.origin(), 1.0f)),
+                  glm::vec3(m_inverseTransform * glm::vec4(ray.direction(), 0.0f)));
+
+    RayHitProperties objectProperties(properties);
+    m_group->intersectsRayObjectSpace(objectRay, objectProperties);
+
+    if(objectProperties.occuredHit && (!properties.occuredHit || objectProperties.distanceHit < properties.distanceHit))
+    {
+        //the hit object is the shared one, so that the material properties are found as usual
+        properties.occuredHit   = true;
+        properties.objectHit    = objectProperties.objectHit;
+        properties.primitiveHit = objectProperties.primitiveHit;
+        properties.instanceHit  = this;
+        properties.positionHit  = glm::vec3(m_transform * glm::vec4(objectProperties.positionHit, 1.0f));
+        properties.normalHit    = glm::normalize(m_normalMatrix * objectProperties.normalHit);
+        properties.distanceHit  = objectProperties.distanceHit;
+    }
+}
+
+AABB SceneInstance::bounds() const
+{
+    return m_group!=NULL ? m_group->objectBounds().transformed(m_transform) : AABB();
+}
+
+SceneObject::Integral SceneInstance::beginIntegral(size_t /*N*/, Integral::Type_t /*type*/) const
+{
+    Integral ui;
+    ui.type=Integral::SINGLE_MEAN;
+    ui.index=0;
+    ui.size=1;
+    ui.actualSize=1;
+    ui.value=bounds().center();
+    return ui;
+}
+
+void SceneInstance::nextIntegral(Integral& integral) const
+{
+    ++integral.index;
+}
+
+SceneObject::Integral SceneInstance::endIntegral(size_t /*N*/, Integral::Type_t /*type*/) const
+{
+    Integral ui;
+    ui.index=1;
+    return ui;
+}
+
+GLint SceneInstance::numberAttributes() const
+{
+    return 0;
+}
+
+GLsizeiptr SceneInstance::sizeVBOPosition() const
+{
+    return 0;
+}
+
+GLsizeiptr SceneInstance::sizeEBO() const
+{
+    return 0;
+}
+
+void SceneInstance::makeVBOPosition(GLint /*vboId*/) const
+{
+}
+
+void SceneInstance::makeEBO(GLint /*eboId*/) const
+{
+}
+
+void SceneInstance::draw() const
+{
+    //drawn by its group, along with the other instances
+}
+
+void SceneInstance::drawInstanced(GLsizei /*instanceCount*/) const
+{
+}
@@ -0,0 +1,161 @@
+#ifndef SCENEINSTANCE_H
+#define SCENEINSTANCE_H
+
+#include "sceneobject.h"
+#include "bvh.h"
+#include "bvh4.h"
+#include <vector>
+
+#ifdef USE_QGLVIEWER
+#include <QGLViewer/frame.h>
+#endif
+
+class SceneInstance;
+
+///
+/// \brief The SceneGroup class is a set of objects expressed in object space, meant to be shared by several SceneInstance.
+/// The group is the only one to hold the geometry: it owns its objects, their VBO and EBO segments and the bottom-level BVH
+/// traversed by the rays of every instance. A group doesn't exist in the world by itself, so it can't be hit by a ray,
+/// and it draws all its instances at once with an instanced draw call.
+///
+class SceneGroup : public SceneObject
+{
+public:
+    SceneGroup();
+    ~SceneGroup();
+
+    ///
+    /// \brief attaches an object to the group, which takes its ownership.
+    /// build() must be called again before any ray is cast against the group.
+    ///
+    void append(SceneObject* object);
+
+    ///
+    /// \brief build (re)builds the bottom-level BVH shared by every instance.
+    ///
+    void build();
+    inline bool isBuilt() const                                 {return m_built;}
+
+    ///
+    /// \brief setWideBVH chooses whether the rays traverse the binary BVH or the BVH4 collapsed from it.
+    ///
+    void setWideBVH(bool wide);
+    inline bool wideBVH() const                                 {return m_wideBVH;}
+
+    ///
+    /// \brief intersectsRayObjectSpace same as intersectsRay, with a ray already expressed in object space.
+    ///
+    void intersectsRayObjectSpace(const Ray &ray, RayHitProperties& properties) const;
+
+    inline const AABB& objectBounds() const                     {return m_objectBounds;}
+    inline const std::vector<SceneInstance*>& instances() const {return m_instances;}
+
+    void intersectsRay(const Ray &ray, RayHitProperties& properties);
+
+    AABB bounds() const;
+
+    //Uniform integration
+
+    Integral beginIntegral(size_t N=0, Integral::Type_t type=Integral::SINGLE_MEAN) const;
+    void nextIntegral(Integral& integral) const;
+    Integral endIntegral(size_t N=0, Integral::Type_t type=Integral::SINGLE_MEAN) const;
+
+    //OpenGL sizes
+
+    GLint numberAttributes() const;
+
+    GLsizeiptr sizeVBOPosition() const;
+    GLsizeiptr sizeEBO() const;
+
+    //OpenGL fill given VBO and EBO segment
+
+    void makeVBOPosition(GLint vboId) const;
+    void makeEBO(GLint eboId) const;
+
+    //OpenGL draw with given VBO and EBO segments
+
+    void draw() const;
+    void drawInstanced(GLsizei instanceCount) const;
+
+private:
+
+    friend class SceneInstance;
+
+    /// \brief places the segments of the group objects inside the segment of the group.
+    void layoutObjects() const;
+
+    std::vector<SceneObject*>       m_objects;
+    std::vector<SceneInstance*>     m_instances;        //registered by the instances themselves
+
+    BVH                             m_bvh;
+    BVH4                            m_bvh4;
+    AABB                            m_objectBounds;
+    bool                            m_built;
+    bool                            m_wideBVH;
+};
+
+///
+/// \brief The SceneInstance class places a SceneGroup in the world with its own transform.
+/// It doesn't copy any geometry, so the memory used by a scene only grows with its unique geometry:
+/// rays are brought into object space and traverse the BVH of the group,
+/// and the group draws every instance at once.
+///
+class SceneInstance : public SceneObject
+{
+public:
+    SceneInstance(SceneGroup *group, const glm::mat4& transform=glm::mat4(1.0f));
+    ~SceneInstance();
+
+    ///
+    /// \brief setTransform moves the instance. The manager refits its acceleration structure and invalidates
+    /// the tiles the instance was or is now seen in on the next update (see SceneObject::takeMoved()).
+    ///
+    void setTransform(const glm::mat4& transform);
+    inline const glm::mat4& transform() const                   {return m_transform;}
+
+#ifdef USE_QGLVIEWER
+    ///
+    /// \brief setFrame uses the world matrix of the frame as the transform of the instance.
+    /// Must be called again whenever the frame is modified.
+    ///
+    void setFrame(const qglviewer::Frame& frame);
+#endif
+
+    /// \brief group is NULL once the group was deleted: the instance then can't be hit and has an empty box.
+    inline SceneGroup* group() const                            {return m_group;}
+
+    void intersectsRay(const Ray &ray, RayHitProperties& properties);
+
+    AABB bounds() const;
+
+    //Uniform integration
+
+    Integral beginIntegral(size_t N=0, Integral::Type_t type=Integral::SINGLE_MEAN) const;
+    void nextIntegral(Integral& integral) const;
+    Integral endIntegral(size_t N=0, Integral::Type_t type=Integral::SINGLE_MEAN) const;
+
+    //OpenGL sizes (an instance has no VBO or EBO segment)
+
+    GLint numberAttributes() const;
+
+    GLsizeiptr sizeVBOPosition() const;
+    GLsizeiptr sizeEBO() const;
+
+    void makeVBOPosition(GLint vboId) const;
+    void makeEBO(GLint eboId) const;
+
+    void draw() const;
+    void drawInstanced(GLsizei instanceCount) const;
+
+private:
+
+    friend class SceneGroup;        //detaches its instances when it is deleted
+
+    SceneGroup      *m_group;
+
+    glm::mat4       m_transform;            //object to world
+    glm::mat4       m_inverseTransform;     //world to object
+    glm::mat3       m_normalMatrix;         //object to world, for normals
+};
+
+#endif // SCENEINSTANCE_H
@@ -0,0 +1,594 @@
+#include "sceneloader.h"
+#include "scenecache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QByteArray>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonParseError>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+const size_t SceneLoader::ms_minChunkSize;
+
+SceneLoader::SceneLoader(TaskPool *pool) :
+    m_pool(pool),
+    m_camera(),
+    m_materials(),
+    m_lights(),
+    m_cacheEnabled(false),
+    m_sources(),
+    m_objects(),
+    m_vertexCount(0),
+    m_triangleCount(0),
+    m_loadTime(0),
+    m_loadedFromCache(false)
+{
+    m_camera.defined=false;
+}
+
+bool SceneLoader::load(const QString& path, SceneManager& manager)
+{
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    m_vertexCount=0;
+    m_triangleCount=0;
+    m_camera.defined=false;
+    m_sources.clear();
+    m_objects.clear();
+    m_loadedFromCache=false;
+
+    QString cachePath=path+".cache";
+    if(m_cacheEnabled && SceneCache::isValid(cachePath) && SceneCache::read(cachePath, manager, m_camera))
+    {
+        m_loadedFromCache=true;
+        m_loadTime=std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+        return true;
+    }
+
+    bool loaded;
+    if(path.endsWith(".obj", Qt::CaseInsensitive))
+    {
+        ScenePrimitives_Prop *mesh=new ScenePrimitives_Prop();
+        loaded=loadOBJ(path, *mesh);
+        if(loaded)
+        {
+            //a plain grey, as the material libraries of OBJ files are not read
+            MaterialProp::MaterialProperties_t properties;
+            properties.vAmbiant=glm::vec3(0.2f, 0.2f, 0.2f);
+            properties.vDiffuse=glm::vec3(0.6f, 0.6f, 0.6f);
+            properties.vSpecular=glm::vec3(0.3f, 0.3f, 0.3f);
+            properties.fSpecularPower=30.0f;
+            properties.fReflectionPower=0.0f;
+            mesh->setMaterialProperties(properties);
+            mesh->setColor(glm::vec3(0.6f, 0.6f, 0.6f));
+            mesh->build();
+            manager.append(mesh, false);
+            m_objects.push_back(mesh);
+        }
+        else
+            delete mesh;
+    }
+    else
+        loaded=loadJSON(path, manager);
+
+    if(loaded && m_cacheEnabled && !SceneCache::write(cachePath, m_objects, m_camera, m_sources))
+        qWarning("SceneLoader: the cache of %s couldn't be written", qPrintable(path));
+
+    m_loadTime=std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+    return loaded;
+}
+
+#ifdef USE_QGLVIEWER
+void SceneLoader::setupCamera(qglviewer::Camera& camera) const
+{
+    if(!m_camera.defined)
+        return;
+    camera.setPosition(SceneCamera::glmVec3ToVec(m_camera.position));
+    camera.setViewDirection(SceneCamera::glmVec3ToVec(m_camera.viewDirection));
+    camera.setUpVector(SceneCamera::glmVec3ToVec(m_camera.upVector));
+    camera.setFieldOfView(m_camera.fieldOfView);
+    //the size of the image is the size of the viewer
+}
+#else
+void SceneLoader::setupCamera(qglviewer_fake::Camera& camera) const
+{
+    if(!m_camera.defined)
+        return;
+    camera.setPosition(m_camera.position);
+    camera.setViewDirection(m_camera.viewDirection);
+    camera.setUpVector(m_camera.upVector);
+    camera.setFieldOfView(m_camera.fieldOfView);
+    if(m_camera.width>0 && m_camera.height>0)
+        camera.setScreenWidthAndHeight(m_camera.width, m_camera.height);
+}
+#endif
+
+//JSON scenes
+
+bool SceneLoader::loadJSON(const QString& path, SceneManager& manager)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qWarning("SceneLoader: couldn't open %s", qPrintable(path));
+        return false;
+    }
+    m_sources.push_back(QFileInfo(path).absoluteFilePath());
+
+    QJsonParseError error;
+    QJsonDocument document;
+    uchar *data= file.size()>0 ? file.map(0, file.size()) : NULL;
+    if(data!=NULL)
+    {
+        //the document keeps its own copy of the values, the mapping can be released right after parsing
+        document=QJsonDocument::fromJson(QByteArray::fromRawData((const char*)data, file.size()), &error);
+        file.unmap(data);
+    }
+    else
+        document=QJsonDocument::fromJson(file.readAll(), &error);
+
+    if(document.isNull() || !document.isObject())
+    {
+        qWarning("SceneLoader: %s is not a valid scene (%s at offset %d)", qPrintable(path),
+                 qPrintable(error.errorString()), error.offset);
+        return false;
+    }
+
+    QJsonObject root=document.object();
+
+    if(root.contains("camera"))
+    {
+        QJsonObject camera=root["camera"].toObject();
+        m_camera.defined        = true;
+        m_camera.position       = vec3FromJson(camera["position"], glm::vec3(0, 0, 10.0f));
+        m_camera.viewDirection  = vec3FromJson(camera["viewDirection"], glm::vec3(0, 0, -1.0f));
+        m_camera.upVector       = vec3FromJson(camera["upVector"], glm::vec3(0, 1.0f, 0));
+        m_camera.fieldOfView    = (float)camera["fieldOfView"].toDouble(M_PI/2.0f);
+        m_camera.width          = camera["width"].toInt(0);
+        m_camera.height         = camera["height"].toInt(0);
+    }
+
+    m_materials.clear();
+    QJsonObject materials=root["materials"].toObject();
+    for(QJsonObject::const_iterator it=materials.begin(); it!=materials.end(); ++it)
+        m_materials[it.key()]=it.value();
+
+    m_lights.clear();
+    QJsonObject lights=root["lights"].toObject();
+    for(QJsonObject::const_iterator it=lights.begin(); it!=lights.end(); ++it)
+        m_lights[it.key()]=it.value();
+
+    //a wrong object doesn't prevent the rest of the scene from being loaded
+    QString directory=QFileInfo(path).absolutePath();
+    QJsonArray objects=root["objects"].toArray();
+    for(int i=0; i<objects.size(); ++i)
+    {
+        if(!appendObject(objects[i].toObject(), directory, manager))
+            qWarning("SceneLoader: object %d of %s skipped", i, qPrintable(path));
+    }
+    return true;
+}
+
+bool SceneLoader::appendObject(const QJsonObject& description, const QString& directory, SceneManager& manager)
+{
+    QString type=description["type"].toString();
+    glm::vec3 color=vec3FromJson(description["color"], glm::vec3(1.0f, 1.0f, 1.0f));
+
+    bool isLight=description.contains("light");
+    MaterialProp::MaterialProperties_t material;
+    LightSource::LightProperties_t light;
+    if(isLight ? !parseLight(description["light"], light) : !parseMaterial(description["material"], material))
+        return false;
+
+    if(type=="face")
+    {
+        glm::vec3 position=vec3FromJson(description["position"]);
+        glm::vec3 directionW=vec3FromJson(description["directionW"], glm::vec3(1.0f, 0, 0));
+        glm::vec3 directionH=vec3FromJson(description["directionH"], glm::vec3(0, 1.0f, 0));
+        float width=(float)description["width"].toDouble(0);
+        float height=(float)description["height"].toDouble(0);
+        //SceneFace refuses these faces on the spot
+        if(width==0 || height==0 || glm::length(glm::cross(directionW, directionH))<=0)
+        {
+            WARNING("SceneLoader: a face has a null size, or colinear directions");
+            return false;
+        }
+
+        SceneFace *face;
+        if(isLight)
+        {
+            SceneFace_Light *faceLight=new SceneFace_Light(position, directionW, directionH, width, height);
+            faceLight->setLightProperties(light);
+            face=faceLight;
+        }
+        else
+        {
+            SceneFace_Prop *faceProp=new SceneFace_Prop(position, directionW, directionH, width, height);
+            faceProp->setMaterialProperties(material);
+            face=faceProp;
+        }
+        face->setColor(color);
+        manager.append(face, false);
+        m_objects.push_back(face);
+        return true;
+    }
+    else if(type=="primitives")
+    {
+        ScenePrimitives *primitives;
+        if(isLight)
+        {
+            ScenePrimitives_Light *primitivesLight=new ScenePrimitives_Light();
+            primitivesLight->setLightProperties(light);
+            primitives=primitivesLight;
+        }
+        else
+        {
+            ScenePrimitives_Prop *primitivesProp=new ScenePrimitives_Prop();
+            primitivesProp->setMaterialProperties(material);
+            primitives=primitivesProp;
+        }
+
+        QJsonArray spheres=description["spheres"].toArray();
+        for(int i=0; i<spheres.size(); ++i)
+        {
+            QJsonObject sphere=spheres[i].toObject();
+            float radius=(float)sphere["radius"].toDouble(0);
+            if(radius>0)
+                primitives->append(ScenePrimitives::Sphere(vec3FromJson(sphere["center"]), radius));
+            else
+                WARNING("SceneLoader: sphere with a null radius skipped");
+        }
+
+        QJsonArray disks=description["disks"].toArray();
+        for(int i=0; i<disks.size(); ++i)
+        {
+            QJsonObject disk=disks[i].toObject();
+            float radius=(float)disk["radius"].toDouble(0);
+            glm::vec3 normal=vec3FromJson(disk["normal"]);
+            if(radius>0 && glm::length(normal)>EPSILON)
+                primitives->append(ScenePrimitives::Disk(vec3FromJson(disk["center"]), normal, radius));
+            else
+                WARNING("SceneLoader: disk with a null radius or normal skipped");
+        }
+
+        QJsonArray triangles=description["triangles"].toArray();
+        for(int i=0; i<triangles.size(); ++i)
+        {
+            QJsonArray points=triangles[i].toArray();
+            ScenePrimitives::Triangle triangle;
+            if(triangle.set(vec3FromJson(points[0]), vec3FromJson(points[1]), vec3FromJson(points[2])))
+                primitives->append(triangle);
+            else
+                WARNING("SceneLoader: degenerated triangle skipped");
+        }
+
+        QJsonArray quads=description["quads"].toArray();
+        for(int i=0; i<quads.size(); ++i)
+        {
+            QJsonObject quad=quads[i].toObject();
+            glm::vec3 directionW=vec3FromJson(quad["directionW"], glm::vec3(1.0f, 0, 0));
+            glm::vec3 directionH=vec3FromJson(quad["directionH"], glm::vec3(0, 1.0f, 0));
+            float width=(float)quad["width"].toDouble(0);
+            float height=(float)quad["height"].toDouble(0);
+            if(width!=0 && height!=0 && glm::length(glm::cross(directionW, directionH))>0)
+                primitives->append(ScenePrimitives::Quad(vec3FromJson(quad["position"]), directionW, directionH, width, height));
+            else
+                WARNING("SceneLoader: quad with a null size or colinear directions skipped");
+        }
+
+        if(description.contains("obj"))
+        {
+            QString objPath=QDir(directory).filePath(description["obj"].toString());
+            if(!loadOBJ(objPath, *primitives))
+            {
+                delete primitives;
+                return false;
+            }
+        }
+
+        primitives->build();
+        primitives->setColor(color);
+        manager.append(primitives, false);
+        m_objects.push_back(primitives);
+        return true;
+    }
+
+    qWarning("SceneLoader: unknown object type \"%s\"", qPrintable(type));
+    return false;
+}
+
+bool SceneLoader::parseMaterial(const QJsonValue& value, MaterialProp::MaterialProperties_t& properties) const
+{
+    QJsonObject material;
+    if(value.isString())
+    {
+        std::map<QString, QJsonValue>::const_iterator it=m_materials.find(value.toString());
+        if(it==m_materials.end())
+        {
+            qWarning("SceneLoader: unknown material \"%s\"", qPrintable(value.toString()));
+            return false;
+        }
+        material=(*it).second.toObject();
+    }
+    else
+        material=value.toObject();
+
+    properties.vAmbiant         = vec3FromJson(material["ambiant"]);
+    properties.vDiffuse         = vec3FromJson(material["diffuse"]);
+    properties.vSpecular        = vec3FromJson(material["specular"]);
+    properties.fSpecularPower   = (float)material["specularPower"].toDouble(1.0);
+    properties.fReflectionPower = (float)material["reflectionPower"].toDouble(0.0);
+    return true;
+}
+
+bool SceneLoader::parseLight(const QJsonValue& value, LightSource::LightProperties_t& properties) const
+{
+    QJsonObject light;
+    if(value.isString())
+    {
+        std::map<QString, QJsonValue>::const_iterator it=m_lights.find(value.toString());
+        if(it==m_lights.end())
+        {
+            qWarning("SceneLoader: unknown light \"%s\"", qPrintable(value.toString()));
+            return false;
+        }
+        light=(*it).second.toObject();
+    }
+    else
+        light=value.toObject();
+
+    properties.vAmbiant     = vec3FromJson(light["ambiant"]);
+    properties.vDiffuse     = vec3FromJson(light["diffuse"]);
+    properties.vSpecular    = vec3FromJson(light["specular"]);
+    return true;
+}
+
+glm::vec3 SceneLoader::vec3FromJson(const QJsonValue& value, const glm::vec3& defaultValue)
+{
+    QJsonArray array=value.toArray();
+    if(array.size()!=3)
+        return defaultValue;
+    return glm::vec3(array[0].toDouble(), array[1].toDouble(), array[2].toDouble());
+}
+
+//OBJ meshes
+
+bool SceneLoader::loadOBJ(const QString& path, ScenePrimitives& primitives)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qWarning("SceneLoader: couldn't open %s", qPrintable(path));
+        return false;
+    }
+    m_sources.push_back(QFileInfo(path).absoluteFilePath());
+    if(file.size()==0)
+        return true;
+
+    uchar *data=file.map(0, file.size());
+    if(data==NULL)
+    {
+        qWarning("SceneLoader: couldn't map %s in memory", qPrintable(path));
+        return false;
+    }
+    bool parsed=parseOBJ((const char*)data, file.size(), primitives);
+    file.unmap(data);
+    return parsed;
+}
+
+bool SceneLoader::parseOBJ(const char *data, size_t size, ScenePrimitives& primitives)
+{
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+
+    //cut the file in chunks of whole lines, a few per thread so that they are balanced
+    size_t chunkCount=std::max((size_t)1, std::min(size/ms_minChunkSize, (size_t)m_pool->concurrency()*4));
+    std::vector<Chunk> chunks(chunkCount);
+    const char *end=data+size;
+    const char *chunkBegin=data;
+    for(size_t i=0; i<chunkCount; ++i)
+    {
+        const char *chunkEnd= i+1<chunkCount ? nextLine(std::max(chunkBegin, data+size*(i+1)/chunkCount), end) : end;
+        chunks[i].begin=chunkBegin;
+        chunks[i].end=chunkEnd;
+        chunkBegin=chunkEnd;
+    }
+
+    //first pass: count the vertices and triangles of each chunk, to know where each chunk writes
+    m_pool->parallelFor(0, chunks.size(), 1, [&chunks](size_t first, size_t last)
+    {
+        for(size_t i=first; i<last; ++i)
+            countOBJ(chunks[i]);
+    });
+
+    size_t vertexCount=0, triangleCount=0;
+    for(std::vector<Chunk>::iterator it=chunks.begin(); it!=chunks.end(); ++it)
+    {
+        (*it).firstVertex=vertexCount;
+        (*it).firstTriangle=triangleCount;
+        vertexCount+=(*it).vertexCount;
+        triangleCount+=(*it).triangleCount;
+    }
+
+    //second pass: the vertices, which may be referenced by the faces of any chunk
+    std::vector<glm::vec3> vertices(vertexCount);
+    glm::vec3 *vertexData= vertexCount>0 ? &vertices[0] : NULL;
+    m_pool->parallelFor(0, chunks.size(), 1, [&chunks, vertexData](size_t first, size_t last)
+    {
+        for(size_t i=first; i<last; ++i)
+            parseOBJVertices(chunks[i], vertexData);
+    });
+
+    //third pass: the faces, straight into the registry
+    ScenePrimitives::Triangle *triangles=primitives.allocateTriangles(triangleCount);
+    m_pool->parallelFor(0, chunks.size(), 1, [&chunks, vertexData, vertexCount, triangles](size_t first, size_t last)
+    {
+        for(size_t i=first; i<last; ++i)
+            parseOBJFaces(chunks[i], vertexData, vertexCount, triangles);
+    });
+
+    size_t invalidFaces=0;
+    for(std::vector<Chunk>::const_iterator it=chunks.begin(); it!=chunks.end(); ++it)
+        invalidFaces+=(*it).invalidFaces;
+    if(invalidFaces>0)
+        qWarning("SceneLoader: %u faces reference missing vertices, and were replaced by empty triangles", (unsigned int)invalidFaces);
+
+    m_vertexCount+=vertexCount;
+    m_triangleCount+=triangleCount;
+    m_loadTime=std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+    return true;
+}
+
+void SceneLoader::countOBJ(Chunk& chunk)
+{
+    chunk.vertexCount=0;
+    chunk.triangleCount=0;
+    for(const char *line=chunk.begin; line<chunk.end; line=nextLine(line, chunk.end))
+    {
+        const char *c=skipSpaces(line, chunk.end);
+        if(chunk.end-c<2 || (c[1]!=' ' && c[1]!='\t'))
+            continue;
+
+        if(c[0]=='v')
+            ++chunk.vertexCount;
+        else if(c[0]=='f')
+        {
+            //a face of n vertices gives n-2 triangles
+            size_t n=0;
+            for(c=skipSpaces(c+2, chunk.end); c<chunk.end && *c!='\r' && *c!='\n'; c=skipSpaces(c, chunk.end))
+            {
+                c=skipToken(c, chunk.end);
+                ++n;
+            }
+            if(n>=3)
+                chunk.triangleCount+=n-2;
+        }
+    }
+}
+
+void SceneLoader::parseOBJVertices(const Chunk& chunk, glm::vec3 *vertices)
+{
+    glm::vec3 *vertex=vertices+chunk.firstVertex;
+    for(const char *line=chunk.begin; line<chunk.end; line=nextLine(line, chunk.end))
+    {
+        const char *c=skipSpaces(line, chunk.end);
+        if(chunk.end-c<2 || c[0]!='v' || (c[1]!=' ' && c[1]!='\t'))
+            continue;
+
+        //missing coordinates are left to 0
+        c+=2;
+        for(int i=0; i<3; ++i)
+        {
+            float value=0.0f;
+            c=parseFloat(skipSpaces(c, chunk.end), chunk.end, value);
+            (*vertex)[i]=value;
+        }
+        ++vertex;
+    }
+}
+
+void SceneLoader::parseOBJFaces(Chunk& chunk, const glm::vec3 *vertices, size_t vertexCount, ScenePrimitives::Triangle *triangles)
+{
+    ScenePrimitives::Triangle *triangle=triangles+chunk.firstTriangle;
+    long declaredVertices=chunk.firstVertex;     //relative indices count back from the last declared vertex
+    chunk.invalidFaces=0;
+    for(const char *line=chunk.begin; line<chunk.end; line=nextLine(line, chunk.end))
+    {
+        const char *c=skipSpaces(line, chunk.end);
+        if(chunk.end-c<2 || (c[1]!=' ' && c[1]!='\t'))
+            continue;
+
+        if(c[0]=='v')
+            ++declaredVertices;
+        else if(c[0]=='f')
+        {
+            //triangulate as a fan around the first vertex, each token being "v", "v/vt", "v//vn" or "v/vt/vn"
+            long first=-1, previous=-1;
+            size_t n=0;
+            bool valid=true;
+            for(c=skipSpaces(c+2, chunk.end); c<chunk.end && *c!='\r' && *c!='\n'; c=skipSpaces(c, chunk.end))
+            {
+                long index=0;
+                parseInt(c, chunk.end, index);
+                c=skipToken(c, chunk.end);
+
+                long vertex= index>0 ? index-1 : declaredVertices+index;
+                if(index==0 || vertex<0 || vertex>=(long)vertexCount)
+                {
+                    valid=false;
+                    vertex=-1;
+                }
+
+                if(n==0)
+                    first=vertex;
+                else if(n>=2)
+                {
+                    //the triangle is written even when invalid, since its place was counted
+                    if(first>=0 && previous>=0 && vertex>=0)
+                        triangle->set(vertices[first], vertices[previous], vertices[vertex]);
+                    else
+                        triangle->set(glm::vec3(0,0,0), glm::vec3(0,0,0), glm::vec3(0,0,0));
+                    ++triangle;
+                }
+                previous=vertex;
+                ++n;
+            }
+            if(!valid)
+                ++chunk.invalidFaces;
+        }
+    }
+}
+
+const char* SceneLoader::parseFloat(const char *c, const char *end, float& value)
+{
+    const char *start=c;
+    bool negative=false;
+    if(c<end && (*c=='-' || *c=='+'))
+        negative=(*c++=='-');
+
+    double mantissa=0.0;
+    bool digits=false;
+    for( ; c<end && *c>='0' && *c<='9'; ++c, digits=true)
+        mantissa=mantissa*10.0 + (*c-'0');
+
+    if(c<end && *c=='.')
+    {
+        double scale=0.1;
+        for(++c; c<end && *c>='0' && *c<='9'; ++c, scale*=0.1, digits=true)
+            mantissa+=(*c-'0')*scale;
+    }
+    if(!digits)
+        return start;
+
+    if(c<end && (*c=='e' || *c=='E'))
+    {
+        long exponent;
+        const char *afterExponent=parseInt(c+1, end, exponent);
+        if(afterExponent!=c+1)
+        {
+            mantissa*=std::pow(10.0, (double)exponent);
+            c=afterExponent;
+        }
+    }
+
+    value=(float)(negative ? -mantissa : mantissa);
+    return c;
+}
+
+const char* SceneLoader::parseInt(const char *c, const char *end, long& value)
+{
+    const char *start=c;
+    bool negative=false;
+    if(c<end && (*c=='-' || *c=='+'))
+        negative=(*c++=='-');
+
+    if(c==end || *c<'0' || *c>'9')
+        return start;
+
+    long result=0;
+    for( ; c<end && *c>='0' && *c<='9'; ++c)
+        result=result*10 + (*c-'0');
+    value=negative ? -result : result;
+    return c;
+}
@@ -0,0 +1,170 @@
+#ifndef SCENELOADER_H
+#define SCENELOADER_H
+
+#include "scenemanager.h"
+#include "taskpool.h"
+#include <QString>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <map>
+#include <cstring>
+
+///
+/// \brief The SceneLoader class fills a SceneManager from files instead of SceneManager::setup().
+/// It reads two formats:
+/// - JSON scenes (.json), describing the camera, the materials, the lights and the objects of the scene
+///   (faces and registries of primitives, whose triangles may come from an OBJ file),
+/// - Wavefront OBJ meshes (.obj), loaded as a single registry of triangles.
+/// Files are mapped in memory rather than read, and OBJ files are parsed by chunks in parallel,
+/// straight into the triangle array of the registry: the only allocations are the few arrays of the mesh.
+///
+/// A JSON scene looks like:
+/// {
+///   "camera":    {"position": [0,0,10], "viewDirection": [0,0,-1], "upVector": [0,1,0], "fieldOfView": 1.57,
+///                 "width": 800, "height": 600},
+///   "materials": {"green": {"ambiant": [0.1,0.3,0.1], "diffuse": [0.2,0.4,0.2], "specular": [0.2,0.8,0.2],
+///                           "specularPower": 30, "reflectionPower": 0}},
+///   "lights":    {"white": {"ambiant": [0.5,0.5,0.5], "diffuse": [0.7,0.7,0.7], "specular": [1,1,1]}},
+///   "objects": [
+///     {"type": "face", "position": [-5,-3,0], "directionW": [1,0,0], "directionH": [0,1,0], "width": 10, "height": 7,
+///      "color": [0.1,0.4,0.1], "material": "green"},
+///     {"type": "primitives", "light": "white",
+///      "spheres": [{"center": [0,0,0], "radius": 1}], "disks": [{"center": [0,0,0], "normal": [0,1,0], "radius": 1}],
+///      "triangles": [[[0,0,0], [1,0,0], [0,1,0]]], "quads": [{"position": [0,0,0], "directionW": [1,0,0], ...}],
+///      "obj": "mesh.obj"}
+///   ]
+/// }
+/// "material" and "light" are either the name of an entry of "materials" and "lights", or the properties themselves.
+/// Relative paths are relative to the scene file.
+///
+class SceneLoader
+{
+public:
+
+    typedef struct
+    {
+        bool        defined;            //false if the scene doesn't place the camera
+        glm::vec3   position;
+        glm::vec3   viewDirection;
+        glm::vec3   upVector;
+        float       fieldOfView;        //vertical, in radians
+        int         width;              //size of the rendered image, 0 if not given
+        int         height;
+    } CameraDescription_t;
+
+    SceneLoader(TaskPool *pool=&TaskPool::globalInstance());
+
+    ///
+    /// \brief load appends the objects described by a scene (.json) or a mesh (.obj) to the manager,
+    /// without reallocating its buffers (as setup() does).
+    /// \return false if the file couldn't be read, in which case a warning tells why.
+    ///
+    bool load(const QString& path, SceneManager& manager);
+
+    ///
+    /// \brief setCacheEnabled makes load() go through a binary cache of the scene, written beside it (path + ".cache"),
+    /// which is read instead of the scene as long as none of the files of the scene changed (see SceneCache).
+    ///
+    inline void setCacheEnabled(bool enabled)          {m_cacheEnabled=enabled;}
+    inline bool isCacheEnabled() const                  {return m_cacheEnabled;}
+
+    ///
+    /// \brief loadOBJ appends the triangles of an OBJ file to the registry. The registry isn't built.
+    ///
+    bool loadOBJ(const QString& path, ScenePrimitives& primitives);
+
+    ///
+    /// \brief parseOBJ same as loadOBJ, from a buffer which isn't necessarily null terminated.
+    /// Only the vertex positions and the faces are read, faces with more than 3 vertices are triangulated as fans.
+    ///
+    bool parseOBJ(const char *data, size_t size, ScenePrimitives& primitives);
+
+    inline const CameraDescription_t& camera() const   {return m_camera;}
+
+#ifdef USE_QGLVIEWER
+    void setupCamera(qglviewer::Camera& camera) const;
+#else
+    void setupCamera(qglviewer_fake::Camera& camera) const;
+#endif
+
+    //statistics of the last load
+
+    inline size_t vertexCount() const                   {return m_vertexCount;}
+    inline size_t triangleCount() const                 {return m_triangleCount;}
+    inline double loadTime() const                      {return m_loadTime;}
+    inline bool loadedFromCache() const                 {return m_loadedFromCache;}
+
+private:
+
+    class Chunk
+    {
+    public:
+        const char  *begin;
+        const char  *end;
+        size_t      vertexCount;
+        size_t      triangleCount;
+        size_t      firstVertex;        //number of vertices declared before the chunk
+        size_t      firstTriangle;
+        size_t      invalidFaces;
+    };
+
+    bool loadJSON(const QString& path, SceneManager& manager);
+    bool appendObject(const QJsonObject& description, const QString& directory, SceneManager& manager);
+    bool parseMaterial(const QJsonValue& value, MaterialProp::MaterialProperties_t& properties) const;
+    bool parseLight(const QJsonValue& value, LightSource::LightProperties_t& properties) const;
+
+    //OBJ passes, on a single chunk
+
+    static void countOBJ(Chunk& chunk);
+    static void parseOBJVertices(const Chunk& chunk, glm::vec3 *vertices);
+    static void parseOBJFaces(Chunk& chunk, const glm::vec3 *vertices, size_t vertexCount, ScenePrimitives::Triangle *triangles);
+
+    //text helpers, which never read past end
+
+    static inline const char* skipSpaces(const char *c, const char *end);
+    static inline const char* skipToken(const char *c, const char *end);
+    static inline const char* nextLine(const char *c, const char *end);
+    static const char* parseFloat(const char *c, const char *end, float& value);
+    static const char* parseInt(const char *c, const char *end, long& value);
+
+    static glm::vec3 vec3FromJson(const QJsonValue& value, const glm::vec3& defaultValue=glm::vec3(0,0,0));
+
+    TaskPool                                        *m_pool;
+
+    CameraDescription_t                             m_camera;
+    std::map<QString, QJsonValue>                   m_materials;
+    std::map<QString, QJsonValue>                   m_lights;
+
+    bool                                            m_cacheEnabled;
+    std::vector<QString>                            m_sources;      //files read by the last load
+    std::vector<SceneObject*>                       m_objects;      //objects appended by the last load
+
+    size_t                                          m_vertexCount;
+    size_t                                          m_triangleCount;
+    double                                          m_loadTime;     //ms
+    bool                                            m_loadedFromCache;
+
+    static const size_t                             ms_minChunkSize=1<<20;     //bytes
+};
+
+const char* SceneLoader::skipSpaces(const char *c, const char *end)
+{
+    while(c<end && (*c==' ' || *c=='\t'))
+        ++c;
+    return c;
+}
+
+const char* SceneLoader::skipToken(const char *c, const char *end)
+{
+    while(c<end && *c!=' ' && *c!='\t' && *c!='\r' && *c!='\n')
+        ++c;
+    return c;
+}
+
+const char* SceneLoader::nextLine(const char *c, const char *end)
+{
+    const char *newLine=(const char*)std::memchr(c, '\n', end-c);
+    return newLine!=NULL ? newLine+1 : end;
+}
+
+#endif // SCENELOADER_H
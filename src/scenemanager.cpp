@@ -1,10 +1,39 @@
 #include "scenemanager.h"
+#include "trace.h"
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 
+const size_t SceneManager::ms_pilotPixels;
+const unsigned int SceneManager::ms_minimumPasses;
+const size_t SceneManager::ms_maxTileDependencies;
+const unsigned int SceneManager::ms_reflectionBeam;
+const size_t SceneManager::ms_wavePoints;
+const int SceneManager::ms_beamSlices;
+const float SceneManager::ms_edgeCosAngle=0.9f;
+const float SceneManager::ms_edgeDepthRatio=0.05f;
+const float SceneManager::ms_edgeContrast=0.2f;
+thread_local SceneManager::TileDependencies_t *SceneManager::ms_recordedTile=NULL;
+thread_local SceneObject::LightSamples SceneManager::ms_lightSamples;
+thread_local std::vector<glm::vec3> SceneManager::ms_reflectionDirections;
+const size_t SceneManager::ms_sampleChunk;
 
 #ifdef USE_QGLVIEWER
-SceneManager::SceneManager(qglviewer::Camera &camera, GLint vaoId, GLint vboPositionId, GLint eboId, GLuint colorLocation) :
+SceneManager::SceneManager(qglviewer::Camera &camera, GLint vaoId, GLint vboPositionId, GLint eboId, GLuint colorLocation,
+                           GLuint vboInstanceId, GLint instanceMatrixLocation) :
     m_objects(),
+    m_bvh(),
+    m_bvhObjects(),
+    m_bvhBounds(),
+    m_bvhIndices(),
+    m_bvhMoved(),
+    m_bvhRebuild(),
+    m_bvhDirty(true),
+    m_renderLock(),
+    m_accelerationBackend(BINARY_BVH),
+    m_bvh4(),
+    m_primaryVisibility(TRACED_VISIBILITY),
+    m_visibilityBuffer(),
     m_camera(camera),
     m_VAOId(vaoId),
     m_VBOPositionId(vboPositionId),
@@ -13,15 +42,42 @@ SceneManager::SceneManager(qglviewer::Camera &camera, GLint vaoId, GLint vboPosi
     m_EBOSize(0),
     m_currentBaseVertex(0),
     m_VBOPositionCapacity(0),
-    m_EBOCapacity(0)
+    m_EBOCapacity(0),
+    m_renderRecord(),
+    m_specializedShading(true),
+    m_fastMath(false),
+    m_shadingKernel(NULL),
+    m_lights(),
+    m_shadingOrder(PIXEL_ORDER),
+    m_raySorter(),
+    m_waveOrder(),
+    m_wavefrontReport(),
+    m_antialiasing(0),
+    m_antialiasedPixels(0),
+    m_costMapEnabled(false),
+    m_costMap()
 {
     SceneObject::setColorLocation(colorLocation);
+    SceneObject::setInstanceLocations(vboInstanceId, instanceMatrixLocation);
 }
 
 #else
 
-SceneManager::SceneManager(qglviewer_fake::Camera &camera, GLint vaoId, GLint vboPositionId, GLint eboId, GLuint colorLocation) :
+SceneManager::SceneManager(qglviewer_fake::Camera &camera, GLint vaoId, GLint vboPositionId, GLint eboId, GLuint colorLocation,
+                           GLuint vboInstanceId, GLint instanceMatrixLocation) :
     m_objects(),
+    m_bvh(),
+    m_bvhObjects(),
+    m_bvhBounds(),
+    m_bvhIndices(),
+    m_bvhMoved(),
+    m_bvhRebuild(),
+    m_bvhDirty(true),
+    m_renderLock(),
+    m_accelerationBackend(BINARY_BVH),
+    m_bvh4(),
+    m_primaryVisibility(TRACED_VISIBILITY),
+    m_visibilityBuffer(),
     m_camera(camera),
     m_VAOId(vaoId),
     m_VBOPositionId(vboPositionId),
@@ -30,9 +86,23 @@ SceneManager::SceneManager(qglviewer_fake::Camera &camera, GLint vaoId, GLint vb
     m_EBOSize(0),
     m_currentBaseVertex(0),
     m_VBOPositionCapacity(0),
-    m_EBOCapacity(0)
+    m_EBOCapacity(0),
+    m_renderRecord(),
+    m_specializedShading(true),
+    m_fastMath(false),
+    m_shadingKernel(NULL),
+    m_lights(),
+    m_shadingOrder(PIXEL_ORDER),
+    m_raySorter(),
+    m_waveOrder(),
+    m_wavefrontReport(),
+    m_antialiasing(0),
+    m_antialiasedPixels(0),
+    m_costMapEnabled(false),
+    m_costMap()
 {
     SceneObject::setColorLocation(colorLocation);
+    SceneObject::setInstanceLocations(vboInstanceId, instanceMatrixLocation);
 }
 
 #endif
@@ -117,6 +187,8 @@ void SceneManager::append(SceneObject* object, bool reallocate)
     if(object!=NULL)
     {
         m_objects.insert(std::pair<unsigned int, SceneObject*>(object->id(), object));
+        m_bvhDirty=true;
+        invalidateTiles(object, AABB(), object->bounds());
 
         //the indexes where we finished writting
         GLsizeiptr firstVBOPos=m_VBOPositionSize;
@@ -149,6 +221,20 @@ SceneObject *SceneManager::remove(unsigned int id)
     {
         SceneObject *removedPtr=(*position).second;
         m_objects.erase(position);
+        if(removedPtr!=NULL)
+            invalidateTiles(removedPtr, removedPtr->bounds(), AABB());
+
+        //an emptied box is refitted out of the traversals (see BVH::refit), no need to rebuild the BVH
+        std::map<unsigned int, unsigned int>::iterator bvhPosition=m_bvhIndices.find(id);
+        if(!m_bvhDirty && bvhPosition!=m_bvhIndices.end())
+        {
+            m_bvhObjects[(*bvhPosition).second]=NULL;
+            m_bvhBounds[(*bvhPosition).second]=AABB();
+            m_bvhMoved.push_back((*bvhPosition).second);
+            m_bvhIndices.erase(bvhPosition);
+        }
+        else
+            m_bvhDirty=true;
         remakeScene();
 
         return removedPtr;
@@ -166,6 +252,7 @@ void SceneManager::allocateScene()
 
 void SceneManager::remakeScene()
 {
+    TRACE_SCOPE("SceneManager::remakeScene");
     //first check if the desired size of the scene is bigger than its current maximum size and update first indexes
     m_VBOPositionSize   =   0;
     m_EBOSize           =   0;
@@ -204,6 +291,7 @@ void SceneManager::remakeScene()
 
 void SceneManager::updateScene()
 {
+    TRACE_SCOPE("SceneManager::updateScene");
     for(iterator it=begin(); it!=end(); ++it)
     {
         SceneObject *object=(*it).second;
@@ -217,6 +305,7 @@ void SceneManager::updateScene()
 
 void SceneManager::drawScene()
 {
+    SceneObject::resetInstanceMatrix();
     for(const_iterator it=begin(); it!=end(); ++it)
     {
         SceneObject *object=(*it).second;
@@ -225,25 +314,200 @@ void SceneManager::drawScene()
     }
 }
 
+//Ray queries
+
+void SceneManager::buildAccelerationStructure()
+{
+    //a background rebuild would be outdated (this waits for it to finish)
+    m_bvhRebuild=std::future<BVH>();
+
+    m_bvhObjects.clear();
+    m_bvhBounds.clear();
+    m_bvhIndices.clear();
+    m_bvhMoved.clear();
+    for(const_iterator it=begin(); it!=end(); ++it)
+    {
+        SceneObject *object=(*it).second;
+        if(object!=NULL)
+        {
+            //instances need the BVH of their group to be built to know their bounds
+            SceneGroup *group=dynamic_cast<SceneGroup*>(object);
+            if(group!=NULL)
+            {
+                group->setWideBVH(m_accelerationBackend==WIDE_BVH);
+                if(!group->isBuilt())
+                    group->build();
+            }
+            m_bvhIndices[(*it).first]=m_bvhObjects.size();
+            m_bvhObjects.push_back(object);
+        }
+    }
+
+    m_bvhBounds.reserve(m_bvhObjects.size());
+    for(std::vector<SceneObject*>::const_iterator it=m_bvhObjects.begin(); it!=m_bvhObjects.end(); ++it)
+        m_bvhBounds.push_back((*it)->bounds());
+
+    m_bvh.build(m_bvhBounds);
+    m_bvhDirty=false;
+
+    if(m_accelerationBackend==WIDE_BVH)
+        m_bvh4.build(m_bvh);
+}
+
+void SceneManager::updateAccelerationStructure()
+{
+    TRACE_SCOPE("SceneManager::updateAccelerationStructure");
+    QWriteLocker locker(&m_renderLock);
+
+    //the objects which moved by themselves, e.g. instances given a new transform
+    for(iterator it=begin(); it!=end(); ++it)
+    {
+        if((*it).second!=NULL && (*it).second->takeMoved())
+            objectMoved((*it).first);
+    }
+
+    if(m_bvhDirty)
+    {
+        buildAccelerationStructure();
+        return;
+    }
+
+    bool changed=false;
+
+    //use the background rebuild if it is done, refitted to whatever moved since it started
+    if(m_bvhRebuild.valid() && m_bvhRebuild.wait_for(std::chrono::seconds(0))==std::future_status::ready)
+    {
+        m_bvh=m_bvhRebuild.get();
+        m_bvh.refit(m_bvhBounds);
+        changed=true;
+    }
+
+    if(!m_bvhMoved.empty())
+    {
+        m_bvh.refit(m_bvhBounds, m_bvhMoved);
+        m_bvhMoved.clear();
+        changed=true;
+    }
+
+    if(changed && m_accelerationBackend==WIDE_BVH)
+        m_bvh4.build(m_bvh);
+
+    if(m_bvh.needsRebuild() && !m_bvhRebuild.valid())
+    {
+        std::vector<AABB> bounds(m_bvhBounds);
+        m_bvhRebuild=std::async(std::launch::async, [bounds]()
+                                    {
+                                        BVH bvh;
+                                        bvh.build(bounds);
+                                        return bvh;
+                                    });
+    }
+}
+
+void SceneManager::objectMoved(unsigned int id)
+{
+    std::map<unsigned int, unsigned int>::const_iterator position=m_bvhIndices.find(id);
+
+    //the box the object had in the BVH is where it was last rendered, or close to it
+    const_iterator object=m_objects.find(id);
+    if(object!=m_objects.end() && (*object).second!=NULL)
+    {
+        AABB oldBounds = position!=m_bvhIndices.end() ? m_bvhBounds[(*position).second] : AABB();
+        invalidateTiles((*object).second, oldBounds, (*object).second->bounds());
+    }
+
+    if(m_bvhDirty || position==m_bvhIndices.end())
+    {
+        m_bvhDirty=true;
+        return;
+    }
+
+    unsigned int index=(*position).second;
+    AABB bounds = m_bvhObjects[index]!=NULL ? m_bvhObjects[index]->bounds() : AABB();
+
+    //a refit can't bring back an object that wasn't in the BVH when it was built
+    if(m_bvhBounds[index].isEmpty() && !bounds.isEmpty())
+    {
+        m_bvhDirty=true;
+        return;
+    }
+    m_bvhBounds[index]=bounds;
+    m_bvhMoved.push_back(index);
+}
+
+void SceneManager::setAccelerationBackend(AccelerationBackend_t backend)
+{
+    if(backend!=m_accelerationBackend)
+    {
+        m_accelerationBackend=backend;
+        m_bvhDirty=true;
+        m_bvh4.clear();
+    }
+}
+
+void SceneManager::setPrimaryVisibility(PrimaryVisibility_t visibility)
+{
+    m_primaryVisibility=visibility;
+    if(visibility!=RASTERIZED_VISIBILITY)
+        m_visibilityBuffer.clear();
+}
+
+void SceneManager::setShadingOrder(ShadingOrder_t order)
+{
+    m_shadingOrder=order;
+}
+
+void SceneManager::intersectsRay(const Ray &ray, SceneObject::RayHitProperties& properties, const SceneObject *ignored) const
+{
+    const std::vector<SceneObject*>& objects=m_bvhObjects;
+    bool recording = ms_recordedTile!=NULL;
+    int hitIndex=-1;
+    auto intersector=[&objects, ignored, recording, &hitIndex](unsigned int i, const Ray& r, SceneObject::RayHitProperties& p)
+                        {
+                            if(objects[i]!=NULL && objects[i]!=ignored)
+                            {
+                                if(!recording)
+                                {
+                                    objects[i]->intersectsRay(r, p);
+                                    return;
+                                }
+                                //the closest hit belongs to the last object which brought the hit closer
+                                bool hadHit=p.occuredHit;
+                                float distance=p.distanceHit;
+                                objects[i]->intersectsRay(r, p);
+                                if(p.occuredHit && (!hadHit || p.distanceHit<distance))
+                                    hitIndex=i;
+                            }
+                        };
+    if(m_accelerationBackend==WIDE_BVH)
+        m_bvh4.intersectsRay(ray, properties, intersector);
+    else
+        m_bvh.intersectsRay(ray, properties, intersector);
+
+    if(hitIndex>=0)
+        recordObject(objects[hitIndex]->id());
+}
+
 //Non-OpenGL rendering
 
 void SceneManager::myFirstRendering()
 {
+    updateAccelerationStructure();
     m_camera.setupRendering();
-    int w=m_camera.width();
-    int h=m_camera.height();
+    m_renderRecord.tiles.clear();
+    int tileCount=m_camera.tileCount();
 
-    for(int x=0; x<w; ++x)
+    for(int i=0; i<tileCount; ++i)
     {
-        for(int y=0; y<h; ++y)
+        SceneCamera::RenderTile tile=m_camera.beginTile(i);
+        const std::vector<SceneCamera::TilePixel>& pixels=m_camera.tilePixels(tile);
+        for(std::vector<SceneCamera::TilePixel>::const_iterator it=pixels.begin(); it!=pixels.end(); ++it)
         {
+            int x=tile.x+it->x, y=tile.y+it->y;
             Ray r=m_camera.castRayFromPixel(x,y);
             SceneObject::RayHitProperties hitProperties;
-            for(iterator it=begin(); it!=end(); ++it)
-            {
-                SceneObject *object=(*it).second;
-                object->intersectsRay(r, hitProperties);
-            }
+            RENDER_STATS_ADD(primaryRays, 1);
+            intersectsRay(r, hitProperties);
             if(hitProperties.occuredHit)
             {
                 m_camera.setPixelfv(x, y, &hitProperties.objectHit->color());
@@ -253,63 +517,918 @@ void SceneManager::myFirstRendering()
                 m_camera.setPixelf(x, y, 0, 0, 0);
             }
         }
+        m_camera.endTile();
     }
     m_camera.showBeautifulRender();
 }
 
-void SceneManager::mainRendering(size_t quality, SceneObject::Integral::Type_t typeIntegral, float reflectionAngle, unsigned int reflectionQuality)
+SceneManager::RenderStats_t SceneManager::mainRendering(size_t quality, SceneObject::Integral::Type_t typeIntegral,
+                                                        float reflectionAngle, unsigned int reflectionQuality)
 {
+    TRACE_SCOPE("SceneManager::mainRendering");
+    RenderSettings_t settings;
+    settings.firstRendering=false;
+    settings.quality=quality;
+    settings.typeIntegral=typeIntegral;
+    settings.reflectionAngle=reflectionAngle;
+    settings.reflectionQuality=reflectionQuality;
+
+    typedef std::chrono::steady_clock Clock;
+    RenderStats_t stats=RenderStats_t();
+    RenderStats::reset();
+    Clock::time_point start=Clock::now();
+    updateAccelerationStructure();
+    Clock::time_point stage=Clock::now();
+    stats.accelerationTime=std::chrono::duration<double>(stage-start).count();
+
+    m_renderRecord.settings=settings;
+    m_renderRecord.view=m_camera.currentView();
+    m_renderRecord.tileSize=m_camera.tileSize();
     m_camera.setupRendering();
-    int w=m_camera.width();
-    int h=m_camera.height();
-    for(int x=0; x<w; ++x)
+    if(m_costMapEnabled)
+    {
+        m_costMap.resize(m_camera.width(), m_camera.height());
+        if(m_shadingOrder!=PIXEL_ORDER)
+            WARNING("SceneManager: the cost map is only recorded with the PIXEL_ORDER shading order");
+    }
+    else
+        m_costMap.resize(0, 0);
+    if(m_primaryVisibility==RASTERIZED_VISIBILITY)
     {
-        for(int y=0; y<h; ++y)
+        stage=Clock::now();
+        m_visibilityBuffer.build(m_bvhObjects, m_camera.rays(), m_camera.tileSize());
+        stats.visibilityTime=std::chrono::duration<double>(Clock::now()-stage).count();
+    }
+    int tileCount=m_camera.tileCount();
+    m_renderRecord.tiles.assign(tileCount, TileDependencies_t());
+    m_renderRecord.dirtyTiles.assign(tileCount, false);
+    m_antialiasedPixels=0;
+    m_wavefrontReport=WavefrontReport_t();
+    stage=Clock::now();
+    prepareShading(settings);
+    //the image is rendered by tiles, which is what lets the camera stream it to a file (see SceneCamera::setOutputFile)
+    for(int i=0; i<tileCount; ++i)
+        renderTile(i, settings);
+    m_shadingKernel=NULL;
+    stats.shadingTime=std::chrono::duration<double>(Clock::now()-stage).count();
+
+    stage=Clock::now();
+    m_camera.showBeautifulRender(m_costMapEnabled ? &m_costMap : NULL);
+    Clock::time_point end=Clock::now();
+    stats.outputTime=std::chrono::duration<double>(end-stage).count();
+    stats.totalTime=std::chrono::duration<double>(end-start).count();
+    stats.counters=RenderStats::collect();
+    return stats;
+}
+
+SceneManager::FastMathReport_t SceneManager::compareFastMath(size_t quality, unsigned int reflectionQuality)
+{
+    FastMathReport_t report=FastMathReport_t();
+    if(!m_camera.outputFile().isEmpty())
+    {
+        WARNING("SceneManager: compareFastMath() needs the image in memory, it isn't compared while it is streamed to a file.");
+        return report;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    bool fastMath=m_fastMath, specializedShading=m_specializedShading;
+    unsigned int antialiasing=m_antialiasing;
+    m_specializedShading=true;
+    m_antialiasing=0;
+    updateAccelerationStructure();
+
+    m_fastMath=false;
+    Clock::time_point start=Clock::now();
+    mainRendering(quality, SceneObject::Integral::UNIFORM, 0.0f, reflectionQuality);
+    report.exactTime=std::chrono::duration<double>(Clock::now()-start).count();
+    QImage exact=*m_camera.renderedImage();
+
+    m_fastMath=true;
+    start=Clock::now();
+    mainRendering(quality, SceneObject::Integral::UNIFORM, 0.0f, reflectionQuality);
+    report.fastTime=std::chrono::duration<double>(Clock::now()-start).count();
+    const QImage& fast=*m_camera.renderedImage();
+
+    m_fastMath=fastMath;
+    m_specializedShading=specializedShading;
+    m_antialiasing=antialiasing;
+
+    double squaredError=0.0, error=0.0;
+    for(int y=0; y<exact.height(); ++y)
+        for(int x=0; x<exact.width(); ++x)
         {
-            glm::vec3 finalColor(0,0,0);
-            Ray firstRay;
-            firstRay=m_camera.castRayFromPixel(x,y);
-            //try to find the closest hit
-            SceneObject::RayHitProperties firstRayHitProperties;
-            for(iterator it=begin(); it!=end(); ++it)
+            QRgb e=exact.pixel(x, y), f=fast.pixel(x, y);
+            int differences[3]={std::abs(qRed(e)-qRed(f)), std::abs(qGreen(e)-qGreen(f)), std::abs(qBlue(e)-qBlue(f))};
+            for(int c=0; c<3; ++c)
             {
-                SceneObject *object=(*it).second;
-                object->intersectsRay(firstRay, firstRayHitProperties);
+                report.maxError=std::max(report.maxError, differences[c]);
+                error+=differences[c];
+                squaredError+=differences[c]*differences[c];
             }
-            if(firstRayHitProperties.occuredHit) //we found something?
+            if(e!=f)
+                ++report.differingPixels;
+        }
+    double channels=3.0*exact.width()*exact.height();
+    report.meanError = channels>0 ? error/channels : 0.0;
+    report.psnr = squaredError>0 ? 10.0*std::log10(255.0*255.0*channels/squaredError) : INFINITY;
+    return report;
+}
+
+int SceneManager::rerenderEdits()
+{
+    TRACE_SCOPE("SceneManager::rerenderEdits");
+    if(m_renderRecord.tiles.empty())
+    {
+        WARNING("SceneManager - rerenderEdits: mainRendering() wasn't called before");
+        return 0;
+    }
+
+    RenderSettings_t settings=m_renderRecord.settings;
+    //a new view, new tiles or an image which wasn't kept: nothing can be reused
+    if(m_camera.currentView()!=m_renderRecord.view || m_camera.tileSize()!=m_renderRecord.tileSize
+            || !m_camera.resumeRendering(m_renderRecord.view))
+    {
+        mainRendering(settings.quality, settings.typeIntegral, settings.reflectionAngle, settings.reflectionQuality);
+        return (int)m_renderRecord.tiles.size();
+    }
+
+    updateAccelerationStructure();
+    if(m_primaryVisibility==RASTERIZED_VISIBILITY && dirtyTileCount()>0)
+        m_visibilityBuffer.build(m_bvhObjects, m_camera.rays(), m_camera.tileSize());
+    //the costs of the tiles which aren't rendered again are kept, unless the map was just enabled
+    if(m_costMapEnabled && (m_costMap.width()!=m_camera.width() || m_costMap.height()!=m_camera.height()))
+        m_costMap.resize(m_camera.width(), m_camera.height());
+    prepareShading(settings);
+    int rendered=0;
+    for(size_t i=0; i<m_renderRecord.tiles.size(); ++i)
+    {
+        if(m_renderRecord.dirtyTiles[i])
+        {
+            renderTile(i, settings);
+            ++rendered;
+        }
+    }
+    m_shadingKernel=NULL;
+    m_camera.showBeautifulRender(m_costMapEnabled ? &m_costMap : NULL);
+    return rendered;
+}
+
+int SceneManager::dirtyTileCount() const
+{
+    return (int)std::count(m_renderRecord.dirtyTiles.begin(), m_renderRecord.dirtyTiles.end(), true);
+}
+
+void SceneManager::renderTile(int i, const RenderSettings_t& settings)
+{
+    TRACE_SCOPE("SceneManager::renderTile");
+    TileDependencies_t& dependencies=m_renderRecord.tiles[i];
+    dependencies.objects.clear();
+    dependencies.beams.clear();
+    dependencies.complete=true;
+    ms_recordedTile=&dependencies;
+
+    SceneCamera::RenderTile tile=m_camera.beginTile(i);
+    CostMap *costMap=recordedCostMap();
+    if(costMap!=NULL)
+        costMap->clearRect(tile.x, tile.y, tile.width, tile.height);
+    if(m_primaryVisibility==RASTERIZED_VISIBILITY)
+        m_visibilityBuffer.resolveTile(i);
+    if(m_antialiasing==0 && m_shadingOrder==PIXEL_ORDER)
+    {
+        const std::vector<SceneCamera::TilePixel>& pixels=m_camera.tilePixels(tile);
+        for(std::vector<SceneCamera::TilePixel>::const_iterator it=pixels.begin(); it!=pixels.end(); ++it)
+        {
+            int x=tile.x+it->x, y=tile.y+it->y;
+            CostMap::Probe probe(costMap);
+            glm::vec3 finalColor=renderPixel(x, y, settings);
+            probe.addTo(x, y);
+            m_camera.setPixelfv(x, y, &finalColor);
+        }
+    }
+    else
+    {
+        std::vector<glm::vec3> colors(tile.width*tile.height);
+        std::vector<SceneObject::RayHitProperties> tileHits;
+        bool waves = m_shadingOrder!=PIXEL_ORDER;
+        if(waves)
+            renderWavefront(tile, settings, colors, m_antialiasing>0 ? &tileHits : NULL);
+
+        if(m_antialiasing>0)
+        {
+            //first pass: one ray per pixel, and what it hit. The pixels around the tile are only intersected,
+            //so that the edges along its sides are found without rendering them.
+            int w=tile.width+2, h=tile.height+2;
+            std::vector<PixelHit_t> hits(w*h);
+            for(int y=tile.y-1; y<=tile.y+tile.height; ++y)
             {
-                //is it a material prop?
-                SceneFace_Prop *material=dynamic_cast<SceneFace_Prop*>(firstRayHitProperties.objectHit);
-                if(material!=NULL)
+                for(int x=tile.x-1; x<=tile.x+tile.width; ++x)
                 {
-                    //compute vector to camera
-                    glm::vec3 vToEye = glm::normalize(firstRay.origin() - firstRayHitProperties.positionHit);
-                    //compute material color...
-                    finalColor = lightenMaterialProp(material, firstRayHitProperties.positionHit,
-                                                     firstRayHitProperties.normalHit,
-                                                     vToEye, quality, typeIntegral);
-                    //multiply by its opacity, if this is a thing
-                    if(reflectionQuality > 0)
-                        finalColor *= (1.0f - material->materialProperties().fReflectionPower);
-                    //...and add its reflection color
-                    //you'll note the "final rush" functions arguments that could easily be packed inside a convenient structure. Sorry about that.
-                    finalColor += reflectionMaterialProp(material, firstRayHitProperties.positionHit,
-                                                            firstRayHitProperties.normalHit, vToEye,
-                                                        quality, typeIntegral, reflectionAngle, reflectionQuality);
+                    PixelHit_t& pixel=hits[(y-tile.y+1)*w + x-tile.x+1];
+                    pixel.inImage = x>=0 && y>=0 && x<m_camera.width() && y<m_camera.height();
+                    if(!pixel.inImage)
+                        continue;
+                    SceneObject::RayHitProperties hit;
+                    if(x>=tile.x && y>=tile.y && x<tile.x+tile.width && y<tile.y+tile.height)
+                    {
+                        size_t p=(y-tile.y)*tile.width + x-tile.x;
+                        if(waves)
+                            hit=tileHits[p];
+                        else
+                        {
+                            CostMap::Probe probe(costMap);
+                            colors[p]=renderPixel(x, y, settings, &hit);
+                            probe.addTo(x, y);
+                        }
+                    }
+                    else
+                    {
+                        RENDER_STATS_ADD(primaryRays, 1);
+                        intersectsRay(m_camera.castRayFromPixel(x,y), hit);
+                    }
+                    pixel.object = hit.occuredHit ? hit.objectHit : NULL;
+                    pixel.normal = hit.normalHit;
+                    pixel.distance = hit.distanceHit;
                 }
-                else //is it a light source?
+            }
+
+            //second pass: more jittered rays through the pixels on edges
+            static const int neighbours[4][2]={{-1,0}, {1,0}, {0,-1}, {0,1}};
+            for(int y=0; y<tile.height; ++y)
+            {
+                for(int x=0; x<tile.width; ++x)
                 {
-                    SceneFace_Light *light=dynamic_cast<SceneFace_Light*>(firstRayHitProperties.objectHit);
-                    if(light!=NULL)
-                        finalColor = glm::clamp(light->lightProperties().vAmbiant + light->lightProperties().vDiffuse + light->lightProperties().vSpecular,
-                                                        glm::vec3(0,0,0), glm::vec3(1.0f, 1.0f, 1.0f));
+                    glm::vec3& color=colors[y*tile.width+x];
+                    const PixelHit_t& pixel=hits[(y+1)*w + x+1];
+                    bool edge=false;
+                    for(int n=0; n<4 && !edge; ++n)
+                    {
+                        int nx=x+neighbours[n][0], ny=y+neighbours[n][1];
+                        edge=onEdge(pixel, hits[(ny+1)*w + nx+1]);
+                        //the colors of the pixels around the tile aren't known
+                        if(!edge && nx>=0 && ny>=0 && nx<tile.width && ny<tile.height)
+                        {
+                            glm::vec3 difference=glm::abs(color-colors[ny*tile.width+nx]);
+                            edge=std::max(difference.r, std::max(difference.g, difference.b))>ms_edgeContrast;
+                        }
+                    }
+                    if(edge)
+                    {
+                        CostMap::Probe probe(costMap);
+                        glm::vec3 sum=color;
+                        for(unsigned int k=0; k<m_antialiasing; ++k)
+                        {
+                            Ray r=m_camera.castStochasticRayFromPixel(tile.x+x, tile.y+y);
+                            SceneObject::RayHitProperties hit;
+                            RENDER_STATS_ADD(primaryRays, 1);
+                            intersectsRay(r, hit);
+                            sum += settings.firstRendering ? (hit.occuredHit ? hit.objectHit->color() : glm::vec3(0,0,0))
+                                                           : shade(r, hit, settings);
+                        }
+                        color=sum/(float)(m_antialiasing+1);
+                        ++m_antialiasedPixels;
+                        probe.addTo(tile.x+x, tile.y+y);
+                    }
                 }
-                //else this isn't a suitable object for this rendering, black
             }
-            m_camera.setPixelfv(x, y, &finalColor);
         }
+        for(int y=0; y<tile.height; ++y)
+        {
+            for(int x=0; x<tile.width; ++x)
+                m_camera.setPixelfv(tile.x+x, tile.y+y, &colors[y*tile.width+x]);
+        }
+    }
+    m_camera.endTile();
+
+    ms_recordedTile=NULL;
+    std::sort(dependencies.objects.begin(), dependencies.objects.end());
+    dependencies.objects.erase(std::unique(dependencies.objects.begin(), dependencies.objects.end()), dependencies.objects.end());
+    if(dependencies.objects.size()>ms_maxTileDependencies)
+    {
+        dependencies.complete=false;
+        std::vector<unsigned int>().swap(dependencies.objects);
+    }
+    m_renderRecord.dirtyTiles[i]=false;
+}
+
+glm::vec3 SceneManager::renderPixel(int x, int y, const RenderSettings_t& settings, SceneObject::RayHitProperties *primaryHit)
+{
+    Ray r;
+    SceneObject::RayHitProperties hit;
+    castPrimaryRay(x, y, r, hit);
+    if(primaryHit!=NULL)
+        *primaryHit=hit;
+    if(settings.firstRendering)
+        return hit.occuredHit ? hit.objectHit->color() : glm::vec3(0,0,0);
+    return shade(r, hit, settings);
+}
+
+void SceneManager::castPrimaryRay(int x, int y, Ray& ray, SceneObject::RayHitProperties& hit)
+{
+    RENDER_STATS_ADD(primaryRays, 1);
+    if(!m_visibilityBuffer.isBuilt() || m_visibilityBuffer.traced(x, y))
+    {
+        ray=m_camera.castRayFromPixel(x,y);
+        intersectsRay(ray, hit);
+        return;
+    }
+    ray=m_visibilityBuffer.ray(x, y);
+    hit=m_visibilityBuffer.hit(x, y);
+    if(hit.occuredHit)
+        recordObject(hit.objectHit->id());
+}
+
+void SceneManager::renderWavefront(const SceneCamera::RenderTile& tile, const RenderSettings_t& settings,
+                                   std::vector<glm::vec3>& colors, std::vector<SceneObject::RayHitProperties> *primaryHits)
+{
+    size_t pixelCount=(size_t)tile.width*tile.height;
+    colors.assign(pixelCount, glm::vec3(0,0,0));
+    if(primaryHits!=NULL)
+        primaryHits->assign(pixelCount, SceneObject::RayHitProperties());
+    std::vector<ShadingPoint_t> points;
+
+    //camera rays, which are coherent already
+    const std::vector<SceneCamera::TilePixel>& pixels=m_camera.tilePixels(tile);
+    for(std::vector<SceneCamera::TilePixel>::const_iterator it=pixels.begin(); it!=pixels.end(); ++it)
+    {
+        size_t p=(size_t)it->y*tile.width + it->x;
+        Ray r;
+        SceneObject::RayHitProperties hit;
+        castPrimaryRay(tile.x+it->x, tile.y+it->y, r, hit);
+        if(primaryHits!=NULL)
+            (*primaryHits)[p]=hit;
+        if(!hit.occuredHit)
+            continue;
+        if(settings.firstRendering)
+        {
+            colors[p]=hit.objectHit->color();
+            continue;
+        }
+        const MaterialProp *material=dynamic_cast<const MaterialProp*>(hit.objectHit);
+        if(material!=NULL)
+        {
+            ShadingPoint_t point;
+            point.pixel=p;
+            point.material=material;
+            point.position=hit.positionHit;
+            point.normal=hit.normalHit;
+            point.vToEye=glm::normalize(r.origin() - hit.positionHit);
+            point.weight = settings.reflectionQuality>0 ? 1.0f-material->materialProperties().fReflectionPower : 1.0f;
+            point.object=hit.objectHit;
+            point.primitive=hit.primitiveHit;
+            point.instance=hit.instanceHit;
+            points.push_back(point);
+        }
+        else
+        {
+            const LightSource *light=dynamic_cast<const LightSource*>(hit.objectHit);
+            if(light!=NULL)
+                colors[p] = glm::clamp(light->lightProperties().vAmbiant + light->lightProperties().vDiffuse + light->lightProperties().vSpecular,
+                                       glm::vec3(0,0,0), glm::vec3(1.0f, 1.0f, 1.0f));
+        }
+    }
+    if(settings.firstRendering)
+        return;
+
+    //reflection rays of the points seen by the camera, as reflectionMaterialProp() casts them
+    size_t seenPoints=points.size();
+    std::vector<Ray> rays;
+    std::vector<unsigned int> sources;
+    std::vector<glm::vec3> directions;
+    for(size_t k=0; k<seenPoints; ++k)
+    {
+        const ShadingPoint_t& point=points[k];
+        if(settings.reflectionQuality==0 || point.material->materialProperties().fReflectionPower <= EPSILON)
+            continue;
+        Ray::RandomCone cone;
+        cone.setup(glm::reflect(-point.vToEye, point.normal), settings.reflectionAngle);
+        directions.resize(settings.reflectionQuality);
+        cone.sample(settings.reflectionQuality, directions.data());
+        for(unsigned int i=0; i<settings.reflectionQuality; ++i)
+        {
+            rays.push_back(Ray(point.position + point.normal*EPSILON, directions[i]));
+            sources.push_back(k);
+        }
+    }
+    std::vector<SceneObject::RayHitProperties> hits;
+    RENDER_STATS_ADD(reflectionRays, rays.size());
+    traceWave(rays, std::vector<const SceneObject*>(rays.size(), NULL), hits);
+
+    //the pixels add up their reflections in the order of their rays, as reflectionMaterialProp() does
+    std::vector<size_t> reflectedPoints(rays.size(), ~(size_t)0);
+    points.reserve(seenPoints+rays.size());
+    for(size_t j=0; j<rays.size(); ++j)
+    {
+        const ShadingPoint_t& source=points[sources[j]];
+        const SceneObject::RayHitProperties& hit=hits[j];
+        if(ms_recordedTile!=NULL && !m_bvh.empty())
+        {
+            const AABB& scene=m_bvh.bounds();
+            float reach=glm::length(glm::max(glm::abs(scene.pMin-rays[j].origin()), glm::abs(scene.pMax-rays[j].origin())));
+            recordRay(ms_reflectionBeam, rays[j].origin(), hit.occuredHit ? hit.positionHit : rays[j].origin()+rays[j].direction()*reach);
+        }
+        if(hit.occuredHit && (hit.objectHit!=source.object || hit.primitiveHit!=source.primitive
+                               || hit.instanceHit!=source.instance))
+        {
+            float power=source.material->materialProperties().fReflectionPower;
+            ShadingPoint_t point;
+            point.pixel=source.pixel;
+            point.material=source.material;
+            point.position=hit.positionHit;
+            point.normal=hit.normalHit;
+            point.vToEye=-rays[j].direction();
+            point.weight=power * (1.0f - power);
+            point.object=hit.objectHit;
+            point.primitive=hit.primitiveHit;
+            point.instance=hit.instanceHit;
+            reflectedPoints[j]=points.size();
+            points.push_back(point);
+        }
+    }
+
+    //shadow rays, by waves of a bounded number of points
+    std::vector<glm::vec3> lit(points.size());
+    std::vector<glm::vec3> waveLit;
+    for(size_t first=0; first<points.size(); first+=ms_wavePoints)
+    {
+        size_t count=std::min(ms_wavePoints, points.size()-first);
+        lightPoints(points.data()+first, count, settings, waveLit);
+        std::copy(waveLit.begin(), waveLit.end(), lit.begin()+first);
+    }
+
+    for(size_t k=0; k<seenPoints; ++k)
+        colors[points[k].pixel] = settings.reflectionQuality>0 ? lit[k]*points[k].weight : lit[k];
+    std::vector<glm::vec3> reflections(pixelCount, glm::vec3(0,0,0));
+    for(size_t j=0; j<rays.size(); ++j)
+    {
+        if(reflectedPoints[j]!=~(size_t)0)
+        {
+            const ShadingPoint_t& point=points[reflectedPoints[j]];
+            reflections[point.pixel]+=point.weight*lit[reflectedPoints[j]];
+        }
+    }
+    for(size_t k=0; k<seenPoints; ++k)
+    {
+        size_t p=points[k].pixel;
+        colors[p] += settings.reflectionQuality>1 ? reflections[p]/((float)settings.reflectionQuality) : reflections[p];
+    }
+}
+
+void SceneManager::lightPoints(const ShadingPoint_t *points, size_t count, const RenderSettings_t& settings, std::vector<glm::vec3>& lit)
+{
+    //shadow rays of every point towards every light, as lightenMaterialProp() casts them
+    std::vector<Ray> rays;
+    std::vector<const SceneObject*> ignored;
+    std::vector<size_t> samples;                //rays of each point and light
+    SceneObject::LightSamples& lightSamples=ms_lightSamples;
+    for(size_t k=0; k<count; ++k)
+    {
+        const ShadingPoint_t& point=points[k];
+        if(point.material->materialProperties().fReflectionPower >= (1.0f-EPSILON))
+            continue;
+        for(const_iterator itLight=begin(); itLight!=end(); ++itLight)
+        {
+            SceneObject *lightObject=(*itLight).second;
+            if(dynamic_cast<const LightSource*>(lightObject)==NULL)
+                continue;
+            lightObject->sampleSurface(settings.quality, settings.typeIntegral, lightSamples);
+            RENDER_STATS_ADD(lightSamples, lightSamples.size());
+            for(size_t first=0; first<lightSamples.size(); first+=ms_sampleChunk)
+            {
+                size_t chunk=std::min(ms_sampleChunk, lightSamples.size()-first);
+                alignas(SceneObject::LightSamples::ms_alignment) float x[ms_sampleChunk], y[ms_sampleChunk], z[ms_sampleChunk];
+                sampleDirections<ExactMath>(lightSamples, first, chunk, point.position, x, y, z);
+                for(size_t i=0; i<chunk; ++i)
+                {
+                    recordRay(lightObject->id(), point.position, lightSamples.position(first+i));
+                    rays.push_back(Ray(point.position+point.normal*EPSILON, glm::vec3(x[i], y[i], z[i])));
+                    ignored.push_back(lightObject);
+                }
+            }
+            samples.push_back(lightSamples.size());
+        }
+    }
+    std::vector<SceneObject::RayHitProperties> hits;
+    RENDER_STATS_ADD(shadowRays, rays.size());
+    traceWave(rays, ignored, hits);
+
+    lit.assign(count, glm::vec3(0,0,0));
+    size_t ray=0, group=0;
+    for(size_t k=0; k<count; ++k)
+    {
+        const ShadingPoint_t& point=points[k];
+        if(point.material->materialProperties().fReflectionPower >= (1.0f-EPSILON))
+            continue;
+        glm::vec3 finalColor(0,0,0);
+        for(const_iterator itLight=begin(); itLight!=end(); ++itLight)
+        {
+            const LightSource *lightSource=dynamic_cast<const LightSource*>((*itLight).second);
+            if(lightSource==NULL)
+                continue;
+            glm::vec3 singleFaceLightColor;
+            for(size_t i=0; i<samples[group]; ++i, ++ray)
+            {
+                if(!hits[ray].occuredHit)
+                {
+                    const glm::vec3& L=rays[ray].direction();
+                    singleFaceLightColor += point.material->colorDiffuse(*lightSource, point.normal, L)
+                                          + point.material->colorSpecular(*lightSource, point.normal, L, point.vToEye);
+                }
+                else
+                    RENDER_STATS_ADD(occludedShadowRays, 1);
+            }
+            singleFaceLightColor /= samples[group];
+            ++group;
+            finalColor += singleFaceLightColor+point.material->colorAmbiant(*lightSource);
+        }
+        lit[k]=glm::clamp(finalColor, glm::vec3(0,0,0), glm::vec3(1.0f, 1.0f, 1.0f));
+    }
+}
+
+void SceneManager::traceWave(const std::vector<Ray>& rays, const std::vector<const SceneObject*>& ignored,
+                             std::vector<SceneObject::RayHitProperties>& hits)
+{
+    typedef std::chrono::steady_clock Clock;
+    hits.assign(rays.size(), SceneObject::RayHitProperties());
+    Clock::time_point start=Clock::now();
+    if(m_shadingOrder==SORTED_WAVEFRONT)
+    {
+        m_raySorter.sort(rays, m_bvh.bounds(), m_waveOrder);
+        Clock::time_point sorted=Clock::now();
+        m_wavefrontReport.sortTime+=std::chrono::duration<double>(sorted-start).count();
+        start=sorted;
+        for(std::vector<unsigned int>::const_iterator it=m_waveOrder.begin(); it!=m_waveOrder.end(); ++it)
+            intersectsRay(rays[*it], hits[*it], ignored[*it]);
+    }
+    else
+    {
+        for(size_t i=0; i<rays.size(); ++i)
+            intersectsRay(rays[i], hits[i], ignored[i]);
+    }
+    m_wavefrontReport.traceTime+=std::chrono::duration<double>(Clock::now()-start).count();
+    m_wavefrontReport.rays+=rays.size();
+}
+
+bool SceneManager::onEdge(const PixelHit_t& a, const PixelHit_t& b)
+{
+    if(!a.inImage || !b.inImage)
+        return false;
+    if(a.object!=b.object)
+        return true;
+    if(a.object==NULL)
+        return false;
+    return glm::dot(a.normal, b.normal)<ms_edgeCosAngle
+            || std::abs(a.distance-b.distance)>ms_edgeDepthRatio*std::min(a.distance, b.distance);
+}
+
+void SceneManager::setAntialiasing(unsigned int samples)
+{
+    m_antialiasing=samples;
+}
+
+void SceneManager::recordObject(unsigned int id)
+{
+    TileDependencies_t *dependencies=ms_recordedTile;
+    if(dependencies==NULL || !dependencies->complete)
+        return;
+    //neighbour rays mostly hit the same objects
+    if(!dependencies->objects.empty() && dependencies->objects.back()==id)
+        return;
+    dependencies->objects.push_back(id);
+    if(dependencies->objects.size()>4*ms_maxTileDependencies)
+    {
+        std::sort(dependencies->objects.begin(), dependencies->objects.end());
+        dependencies->objects.erase(std::unique(dependencies->objects.begin(), dependencies->objects.end()), dependencies->objects.end());
+        if(dependencies->objects.size()>ms_maxTileDependencies)
+        {
+            dependencies->complete=false;
+            std::vector<unsigned int>().swap(dependencies->objects);
+        }
+    }
+}
+
+void SceneManager::recordRay(unsigned int key, const glm::vec3& from, const glm::vec3& to)
+{
+    TileDependencies_t *dependencies=ms_recordedTile;
+    if(dependencies==NULL)
+        return;
+    std::vector<RayBeam_t>::iterator beam=dependencies->beams.begin();
+    while(beam!=dependencies->beams.end() && (*beam).key!=key)
+        ++beam;
+    if(beam==dependencies->beams.end())
+    {
+        RayBeam_t newBeam;
+        newBeam.key=key;
+        beam=dependencies->beams.insert(beam, newBeam);
+    }
+    (*beam).from.extend(from);
+    (*beam).to.extend(to);
+}
+
+bool SceneManager::beamOverlaps(const RayBeam_t& beam, const AABB& box)
+{
+    //the points at t along the rays are in the box interpolated at t, whose bounds are linear in t:
+    //between two slices, they are in the box containing both
+    for(int i=0; i<ms_beamSlices; ++i)
+    {
+        float t0=(float)i/ms_beamSlices;
+        float t1=(float)(i+1)/ms_beamSlices;
+        AABB slice(beam.from.pMin*(1.0f-t0) + beam.to.pMin*t0, beam.from.pMax*(1.0f-t0) + beam.to.pMax*t0);
+        slice.extend(AABB(beam.from.pMin*(1.0f-t1) + beam.to.pMin*t1, beam.from.pMax*(1.0f-t1) + beam.to.pMax*t1));
+        if(slice.overlaps(box))
+            return true;
+    }
+    return false;
+}
+
+void SceneManager::invalidateTiles(const SceneObject *object, const AABB& oldBounds, const AABB& newBounds)
+{
+    if(object==NULL || m_renderRecord.tiles.empty())
+        return;
+
+    //a light lights every tile
+    if(dynamic_cast<const LightSource*>(object)!=NULL)
+    {
+        std::fill(m_renderRecord.dirtyTiles.begin(), m_renderRecord.dirtyTiles.end(), true);
+        return;
+    }
+
+    //the tiles which saw the object, its shadow or its reflection, and those whose shadow or reflection rays it may now stop
+    for(size_t i=0; i<m_renderRecord.tiles.size(); ++i)
+    {
+        const TileDependencies_t& dependencies=m_renderRecord.tiles[i];
+        if(!dependencies.complete || m_renderRecord.dirtyTiles[i])
+            continue;
+        bool dirty=std::binary_search(dependencies.objects.begin(), dependencies.objects.end(), object->id());
+        for(size_t j=0; j<dependencies.beams.size() && !dirty; ++j)
+            dirty=beamOverlaps(dependencies.beams[j], newBounds);
+        m_renderRecord.dirtyTiles[i]=dirty;
+    }
+
+    //the tiles the object is now seen in, and whatever the incomplete tiles may have seen of it
+    invalidateProjectedTiles(newBounds, false);
+    invalidateProjectedTiles(oldBounds, true);
+}
+
+void SceneManager::invalidateProjectedTiles(const AABB& box, bool incompleteOnly)
+{
+    if(box.isEmpty())
+        return;
+
+    const SceneCamera::View& view=m_renderRecord.view;
+    SceneCamera::Rays rays(view);
+    float xMin=std::numeric_limits<float>::max(), yMin=xMin;
+    float xMax=-xMin, yMax=-xMin;
+    for(int i=0; i<8; ++i)
+    {
+        glm::vec3 corner((i&1) ? box.pMax.x : box.pMin.x,
+                         (i&2) ? box.pMax.y : box.pMin.y,
+                         (i&4) ? box.pMax.z : box.pMin.z);
+        float x, y;
+        if(!rays.project(corner, x, y))
+        {
+            //partly behind the camera: it may be seen anywhere
+            xMin=yMin=0.0f;
+            xMax=(float)view.width;
+            yMax=(float)view.height;
+            break;
+        }
+        xMin=std::min(xMin, x);
+        xMax=std::max(xMax, x);
+        yMin=std::min(yMin, y);
+        yMax=std::max(yMax, y);
+    }
+    if(xMax<0.0f || yMax<0.0f || xMin>=view.width || yMin>=view.height)
+        return;
+
+    int tileSize=m_renderRecord.tileSize;
+    int columns=(view.width+tileSize-1)/tileSize;
+    int rows=(view.height+tileSize-1)/tileSize;
+    int firstColumn=std::max((int)xMin/tileSize, 0), lastColumn=std::min((int)xMax/tileSize, columns-1);
+    int firstRow=std::max((int)yMin/tileSize, 0), lastRow=std::min((int)yMax/tileSize, rows-1);
+    for(int row=firstRow; row<=lastRow; ++row)
+    {
+        for(int column=firstColumn; column<=lastColumn; ++column)
+        {
+            int i=row*columns+column;
+            if(!incompleteOnly || !m_renderRecord.tiles[i].complete)
+                m_renderRecord.dirtyTiles[i]=true;
+        }
+    }
+}
+
+glm::vec3 SceneManager::renderRay(const Ray& r, const RenderSettings_t& settings, SceneObject::RayHitProperties *primaryHit)
+{
+    if(settings.firstRendering)
+    {
+        SceneObject::RayHitProperties hitProperties;
+        RENDER_STATS_ADD(primaryRays, 1);
+        intersectsRay(r, hitProperties);
+        if(primaryHit!=NULL)
+            *primaryHit=hitProperties;
+        return hitProperties.occuredHit ? hitProperties.objectHit->color() : glm::vec3(0,0,0);
+    }
+    return shadePixel(r, settings.quality, settings.typeIntegral, settings.reflectionAngle, settings.reflectionQuality, primaryHit);
+}
+
+SceneManager::BudgetReport_t SceneManager::budgetedRendering(double budget, float reflectionAngle,
+                                                             size_t maxQuality, unsigned int maxReflectionQuality)
+{
+    typedef std::chrono::steady_clock Clock;
+    updateAccelerationStructure();
+    m_camera.setupRendering();
+    m_renderRecord.tiles.clear();
+    Clock::time_point start=Clock::now();
+    Clock::time_point deadline=start+std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget));
+
+    int w=m_camera.width();
+    size_t pixelCount=(size_t)w*m_camera.height();
+    if(pixelCount==0)
+        return BudgetReport_t();    //nothing to measure nor render: every field is 0
+    std::vector<glm::vec3> accumulation(pixelCount, glm::vec3(0,0,0));
+    std::vector<unsigned int> sampleCount(pixelCount, 0);
+    double lightSamples=0;
+
+    maxQuality=std::max(maxQuality, (size_t)1);
+    //reflections are traced by every pass or by none, since shadePixel() darkens reflective materials when they are
+    unsigned int minReflectionQuality= maxReflectionQuality>0 ? 1 : 0;
+
+    auto render=[&](int x, int y, size_t quality, unsigned int reflectionQuality)
+    {
+        size_t p=(size_t)y*w+x;
+        accumulation[p]+=shadePixel(m_camera.castStochasticRayFromPixel(x, y), quality,
+                                    SceneObject::Integral::UNIFORM_RANDOM, reflectionAngle, reflectionQuality);
+        ++sampleCount[p];
+        lightSamples+=quality*quality;
+    };
+
+    //pilot: the same spread pixels are rendered with 3 settings, to tell the cost of light samples and reflections
+    //from the rest. Its samples are as good as any other, and are kept in the image.
+    //It stops at the deadline too, checked as often as in the passes: the measures it couldn't make are then guessed.
+    size_t pilotCount=std::min(pixelCount, ms_pilotPixels);
+    size_t checkInterval=std::max(m_camera.tileSize(), 1);
+    bool expired=false;
+    auto pilot=[&](size_t quality, unsigned int reflectionQuality, double& pixelTime)
+    {
+        if(expired)
+            return false;
+        Clock::time_point pilotStart=Clock::now();
+        size_t i=0;
+        while(i<pilotCount && !expired)
+        {
+            size_t p=i*pixelCount/pilotCount;
+            render(p%w, p/w, quality, reflectionQuality);
+            if(++i%checkInterval==0)
+                expired=Clock::now()>=deadline;
+        }
+        if(i==0)
+            return false;
+        pixelTime=std::chrono::duration<double>(Clock::now()-pilotStart).count()/i;
+        return true;
+    };
+    //without measures, a light sample is guessed to cost as much as the rest of a pixel, and a reflection ray as a pixel
+    double timeBase=1e-6, timeLight, timeReflection;
+    pilot(1, minReflectionQuality, timeBase);
+    timeLight= pilot(2, minReflectionQuality, timeLight) ? std::max((timeLight-timeBase)/3.0, 0.0) : timeBase/2.0;
+    double timeFixed=std::max(timeBase-timeLight, 1e-9);
+    if(maxReflectionQuality<=minReflectionQuality)
+        timeReflection=0.0;
+    else
+        timeReflection= pilot(1, minReflectionQuality+1, timeReflection) ? std::max(timeReflection-timeBase, 0.0) : timeBase;
+
+    BudgetReport_t report;
+    report.pilotTime=std::chrono::duration<double>(Clock::now()-start).count();
+
+    //predicted time of a pixel: a reflection ray costs as much as the shading of the point it hits
+    auto pixelTime=[&](size_t quality, unsigned int reflectionQuality)
+    {
+        double shading=timeFixed+quality*quality*timeLight;
+        return shading + (reflectionQuality-minReflectionQuality)*timeReflection*shading/(timeFixed+timeLight);
+    };
+
+    double correction=1.0;     //time the last pass took over its predicted time
+    size_t quality=1;
+    unsigned int reflectionQuality=minReflectionQuality;
+    unsigned int passes=0;
+    int tileCount=m_camera.tileCount();
+    while(!expired)
+    {
+        double remaining=std::chrono::duration<double>(deadline-Clock::now()).count();
+        if(remaining<=0)
+            break;
+
+        //the most samples a pass can have while leaving time for the passes still wanted (at least this one)
+        double passBudget=remaining/(passes<ms_minimumPasses ? ms_minimumPasses-passes : 1);
+        double bestSamples=0;
+        quality=1;
+        reflectionQuality=minReflectionQuality;
+        for(size_t q=1; q<=maxQuality; ++q)
+        {
+            for(unsigned int r=minReflectionQuality; r<=maxReflectionQuality; ++r)
+            {
+                double samples=(double)(q*q)*std::max(r, 1u);
+                if(samples>bestSamples && pixelTime(q, r)*correction*pixelCount<=passBudget)
+                {
+                    bestSamples=samples;
+                    quality=q;
+                    reflectionQuality=r;
+                }
+            }
+        }
+
+        Clock::time_point passStart=Clock::now();
+        for(int i=0; i<tileCount && !expired; ++i)
+        {
+            SceneCamera::RenderTile tile=m_camera.tile(i);
+            const std::vector<SceneCamera::TilePixel>& pixels=m_camera.tilePixels(tile);
+            for(size_t k=0; k<pixels.size() && !expired; ++k)
+            {
+                render(tile.x+pixels[k].x, tile.y+pixels[k].y, quality, reflectionQuality);
+                if((k+1)%tile.height==0)
+                    expired=Clock::now()>=deadline;
+            }
+        }
+        if(!expired)
+        {
+            ++passes;
+            correction=std::chrono::duration<double>(Clock::now()-passStart).count()/(pixelTime(quality, reflectionQuality)*pixelCount);
+        }
+    }
+    report.renderTime=std::chrono::duration<double>(Clock::now()-start).count();
+
+    //mean of the samples of each pixel (an interrupted pass gave more samples to some of them)
+    size_t totalSamples=0;
+    for(int i=0; i<tileCount; ++i)
+    {
+        SceneCamera::RenderTile tile=m_camera.beginTile(i);
+        for(int y=tile.y; y<tile.y+tile.height; ++y)
+        {
+            for(int x=tile.x; x<tile.x+tile.width; ++x)
+            {
+                size_t p=(size_t)y*w+x;
+                glm::vec3 finalColor= sampleCount[p]>0 ? accumulation[p]/(float)sampleCount[p] : glm::vec3(0,0,0);
+                totalSamples+=sampleCount[p];
+                m_camera.setPixelfv(x, y, &finalColor);
+            }
+        }
+        m_camera.endTile();
     }
     m_camera.showBeautifulRender();
+
+    report.passes=passes;
+    report.quality=quality;
+    report.reflectionQuality=reflectionQuality;
+    report.samplesPerPixel=(float)totalSamples/pixelCount;
+    report.lightSamplesPerPixel=(float)(lightSamples/pixelCount);
+    return report;
+}
+
+glm::vec3 SceneManager::shadePixel(const Ray& firstRay, size_t quality, SceneObject::Integral::Type_t typeIntegral,
+                                   float reflectionAngle, unsigned int reflectionQuality,
+                                   SceneObject::RayHitProperties *primaryHit)
+{
+    //try to find the closest hit
+    SceneObject::RayHitProperties firstRayHitProperties;
+    RENDER_STATS_ADD(primaryRays, 1);
+    intersectsRay(firstRay, firstRayHitProperties);
+    if(primaryHit!=NULL)
+        *primaryHit=firstRayHitProperties;
+    return shadeHit(firstRay, firstRayHitProperties, quality, typeIntegral, reflectionAngle, reflectionQuality);
+}
+
+glm::vec3 SceneManager::shadeHit(const Ray& firstRay, const SceneObject::RayHitProperties& firstRayHitProperties, size_t quality,
+                                 SceneObject::Integral::Type_t typeIntegral, float reflectionAngle, unsigned int reflectionQuality)
+{
+    glm::vec3 finalColor(0,0,0);
+    if(firstRayHitProperties.occuredHit) //we found something?
+    {
+        //is it a material prop?
+        MaterialProp *material=dynamic_cast<MaterialProp*>(firstRayHitProperties.objectHit);
+        if(material!=NULL)
+        {
+            //compute vector to camera
+            glm::vec3 vToEye = glm::normalize(firstRay.origin() - firstRayHitProperties.positionHit);
+            //compute material color...
+            finalColor = lightenMaterialProp(material, firstRayHitProperties.positionHit,
+                                             firstRayHitProperties.normalHit,
+                                             vToEye, quality, typeIntegral);
+            //multiply by its opacity, if this is a thing
+            if(reflectionQuality > 0)
+                finalColor *= (1.0f - material->materialProperties().fReflectionPower);
+            //...and add its reflection color
+            //you'll note the "final rush" functions arguments that could easily be packed inside a convenient structure. Sorry about that.
+            finalColor += reflectionMaterialProp(material, firstRayHitProperties, vToEye,
+                                                quality, typeIntegral, reflectionAngle, reflectionQuality);
+        }
+        else //is it a light source?
+        {
+            LightSource *light=dynamic_cast<LightSource*>(firstRayHitProperties.objectHit);
+            if(light!=NULL)
+                finalColor = glm::clamp(light->lightProperties().vAmbiant + light->lightProperties().vDiffuse + light->lightProperties().vSpecular,
+                                                glm::vec3(0,0,0), glm::vec3(1.0f, 1.0f, 1.0f));
+        }
+        //else this isn't a suitable object for this rendering, black
+    }
+    return finalColor;
 }
 
 
@@ -320,7 +1439,14 @@ SceneObject *SceneManager::operator[](unsigned int i)
 
 void SceneManager::setObject(unsigned int index, SceneObject* object)
 {
+    //what the replaced object lit or was hit by (its box is the one the new object is moved from)
+    invalidateTiles(m_objects.at(index), AABB(), AABB());
     m_objects.at(index)=object;
+
+    std::map<unsigned int, unsigned int>::const_iterator position=m_bvhIndices.find(index);
+    if(position!=m_bvhIndices.end())
+        m_bvhObjects[(*position).second]=object;
+    objectMoved(index);
 }
 
 SceneObject* SceneManager::getObject(unsigned int index)
@@ -349,7 +1475,159 @@ void SceneManager::allocateEBO()
 
 //render functions
 
-glm::vec3 SceneManager::lightenMaterialProp(SceneFace_Prop *face, const glm::vec3& positionFace,
+void SceneManager::prepareShading(const RenderSettings_t& settings)
+{
+    m_lights.clear();
+    m_shadingKernel=NULL;
+    if(!m_specializedShading)
+        return;
+
+    bool specular=false;
+    for(const_iterator it=begin(); it!=end(); ++it)
+    {
+        SceneObject *object=(*it).second;
+        const LightSource *source=dynamic_cast<const LightSource*>(object);
+        if(source!=NULL)
+        {
+            m_lights.push_back(Light_t());
+            Light_t& light=m_lights.back();
+            light.object=object;
+            light.source=source;
+            //the samples of the other integrals don't depend on the shading point
+            if(settings.typeIntegral!=SceneObject::Integral::UNIFORM_RANDOM)
+                object->sampleSurface(settings.quality, settings.typeIntegral, light.samples);
+            specular = specular || source->lightProperties().vSpecular!=glm::vec3(0,0,0);
+        }
+    }
+
+    bool reflections = settings.reflectionQuality>0;
+    switch(settings.typeIntegral)
+    {
+    case SceneObject::Integral::UNIFORM:
+        m_shadingKernel = m_fastMath ? selectKernel<SceneObject::Integral::UNIFORM, FastMath>(!specular, reflections)
+                                     : selectKernel<SceneObject::Integral::UNIFORM, ExactMath>(!specular, reflections);
+        break;
+    case SceneObject::Integral::UNIFORM_RANDOM:
+        m_shadingKernel = m_fastMath ? selectKernel<SceneObject::Integral::UNIFORM_RANDOM, FastMath>(!specular, reflections)
+                                     : selectKernel<SceneObject::Integral::UNIFORM_RANDOM, ExactMath>(!specular, reflections);
+        break;
+    default: //single_mean or invalid
+        m_shadingKernel = m_fastMath ? selectKernel<SceneObject::Integral::SINGLE_MEAN, FastMath>(!specular, reflections)
+                                     : selectKernel<SceneObject::Integral::SINGLE_MEAN, ExactMath>(!specular, reflections);
+    }
+}
+
+template<SceneObject::Integral::Type_t Sampling, class Math>
+SceneManager::ShadingKernel_t SceneManager::selectKernel(bool lambert, bool reflections)
+{
+    if(lambert)
+        return reflections ? &SceneManager::shadingKernel<Sampling, LambertModel, true, Math>
+                           : &SceneManager::shadingKernel<Sampling, LambertModel, false, Math>;
+    return reflections ? &SceneManager::shadingKernel<Sampling, PhongModel, true, Math>
+                       : &SceneManager::shadingKernel<Sampling, PhongModel, false, Math>;
+}
+
+template<SceneObject::Integral::Type_t Sampling, class Model, bool Reflections, class Math>
+glm::vec3 SceneManager::shadingKernel(const Ray& firstRay, const SceneObject::RayHitProperties& hit, const RenderSettings_t& settings)
+{
+    glm::vec3 finalColor(0,0,0);
+    if(!hit.occuredHit)
+        return finalColor;
+
+    const MaterialProp *material=dynamic_cast<const MaterialProp*>(hit.objectHit);
+    if(material!=NULL)
+    {
+        glm::vec3 toEye = firstRay.origin() - hit.positionHit;
+        glm::vec3 vToEye = toEye*Math::inverseSqrt(glm::dot(toEye, toEye));
+        finalColor = lightenKernel<Sampling, Model, Math>(material, hit.positionHit, hit.normalHit, vToEye, settings.quality);
+        float power=material->materialProperties().fReflectionPower;
+        if(Reflections)
+        {
+            //same as reflectionMaterialProp()
+            finalColor *= (1.0f - power);
+            glm::vec3 reflectionColor(0,0,0);
+            if(power > EPSILON)
+            {
+                Ray::RandomCone cone;
+                cone.setup(glm::reflect(-vToEye, hit.normalHit), settings.reflectionAngle);
+                std::vector<glm::vec3>& directions=ms_reflectionDirections;
+                directions.resize(settings.reflectionQuality);
+                cone.sample(settings.reflectionQuality, directions.data());
+                for(unsigned int i=0; i<settings.reflectionQuality; ++i)
+                {
+                    Ray r(hit.positionHit + hit.normalHit*EPSILON, directions[i]);
+                    SceneObject::RayHitProperties rayHit;
+                    RENDER_STATS_ADD(reflectionRays, 1);
+                    intersectsRay(r, rayHit);
+                    if(ms_recordedTile!=NULL && !m_bvh.empty())
+                    {
+                        const AABB& scene=m_bvh.bounds();
+                        float reach=glm::length(glm::max(glm::abs(scene.pMin-r.origin()), glm::abs(scene.pMax-r.origin())));
+                        recordRay(ms_reflectionBeam, r.origin(), rayHit.occuredHit ? rayHit.positionHit : r.origin()+r.direction()*reach);
+                    }
+                    if(rayHit.occuredHit && !rayHit.sameSurface(hit))
+                        reflectionColor += power * (1.0f - power) *
+                                lightenKernel<Sampling, Model, Math>(material, rayHit.positionHit, rayHit.normalHit, -r.direction(), settings.quality);
+                }
+            }
+            finalColor += settings.reflectionQuality > 1 ? reflectionColor/((float)settings.reflectionQuality) : reflectionColor;
+        }
+    }
+    else
+    {
+        const LightSource *light=dynamic_cast<const LightSource*>(hit.objectHit);
+        if(light!=NULL)
+            finalColor = glm::clamp(light->lightProperties().vAmbiant + light->lightProperties().vDiffuse + light->lightProperties().vSpecular,
+                                    glm::vec3(0,0,0), glm::vec3(1.0f, 1.0f, 1.0f));
+    }
+    return finalColor;
+}
+
+template<SceneObject::Integral::Type_t Sampling, class Model, class Math>
+glm::vec3 SceneManager::lightenKernel(const MaterialProp *face, const glm::vec3& positionFace, const glm::vec3& normalFace,
+                                      const glm::vec3& vToEye, size_t quality)
+{
+    //same as lightenMaterialProp(), for the prepared lights
+    glm::vec3 finalColor(0,0,0);
+    if(face->materialProperties().fReflectionPower >= (1.0f-EPSILON))
+        return finalColor;
+
+    for(std::vector<Light_t>::const_iterator light=m_lights.begin(); light!=m_lights.end(); ++light)
+    {
+        const SceneObject::LightSamples *samples=&light->samples;
+        if(Sampling==SceneObject::Integral::UNIFORM_RANDOM)
+        {
+            light->object->sampleSurface(quality, Sampling, ms_lightSamples);
+            samples=&ms_lightSamples;
+        }
+        RENDER_STATS_ADD(lightSamples, samples->size());
+        glm::vec3 singleFaceLightColor;
+        for(size_t first=0; first<samples->size(); first+=ms_sampleChunk)
+        {
+            size_t count=std::min(ms_sampleChunk, samples->size()-first);
+            alignas(SceneObject::LightSamples::ms_alignment) float x[ms_sampleChunk], y[ms_sampleChunk], z[ms_sampleChunk];
+            sampleDirections<Math>(*samples, first, count, positionFace, x, y, z);
+            for(size_t k=0; k<count; ++k)
+            {
+                glm::vec3 L(x[k], y[k], z[k]);
+                recordRay(light->object->id(), positionFace, samples->position(first+k));
+                Ray toLight(positionFace+normalFace*EPSILON, L);
+                SceneObject::RayHitProperties shadowHit;
+                RENDER_STATS_ADD(shadowRays, 1);
+                intersectsRay(toLight, shadowHit, light->object);
+                if(!shadowHit.occuredHit)
+                    singleFaceLightColor += Model::template shade<Math>(*face, *light->source, normalFace, L, vToEye);
+                else
+                    RENDER_STATS_ADD(occludedShadowRays, 1);
+            }
+        }
+        singleFaceLightColor /= samples->size();
+        finalColor += singleFaceLightColor+face->colorAmbiant(*light->source);
+    }
+    return glm::clamp(finalColor, glm::vec3(0,0,0), glm::vec3(1.0f, 1.0f, 1.0f));
+}
+
+glm::vec3 SceneManager::lightenMaterialProp(const MaterialProp *face, const glm::vec3& positionFace,
                                             const glm::vec3& normalFace, const glm::vec3 vToEye,
                                             size_t quality, SceneObject::Integral::Type_t typeIntegral)
 {
@@ -357,40 +1635,48 @@ glm::vec3 SceneManager::lightenMaterialProp(SceneFace_Prop *face, const glm::vec
     glm::vec3 finalColor(0,0,0);
 
     if(face->materialProperties().fReflectionPower < (1.0f-EPSILON) ) {
+    SceneObject::LightSamples& samples=ms_lightSamples;
     for(const_iterator itLight=begin(); itLight!=end(); ++itLight)
     {
-        SceneFace_Light *lightSource=dynamic_cast<SceneFace_Light*>((*itLight).second);
+        SceneObject *lightObject=(*itLight).second;
+        const LightSource *lightSource=dynamic_cast<const LightSource*>(lightObject);
         if(lightSource!=NULL)
         {
             glm::vec3 singleFaceLightColor;
-            SceneFace::Integral ui(lightSource->beginIntegral(quality, typeIntegral));
-            for( ; ui!=lightSource->endIntegral(quality, typeIntegral); lightSource->nextIntegral(ui))
+            lightObject->sampleSurface(quality, typeIntegral, samples);
+            RENDER_STATS_ADD(lightSamples, samples.size());
+            for(size_t first=0; first<samples.size(); first+=ms_sampleChunk)
             {
-                //grab L and N for elegant writting purposes
-                glm::vec3 L=glm::normalize(ui.value-positionFace);
-                glm::vec3 N=normalFace;
-
-                //check for obstructions
-                //also, we need to start casting the ray a little bit further to avoid unwanted collisions with self
-                Ray toLight(positionFace+N*EPSILON, L);
-                SceneObject::RayHitProperties secondRayHitProperties;
-                for(iterator it=begin(); it!=end(); ++it)
+                size_t count=std::min(ms_sampleChunk, samples.size()-first);
+                alignas(SceneObject::LightSamples::ms_alignment) float x[ms_sampleChunk], y[ms_sampleChunk], z[ms_sampleChunk];
+                sampleDirections<ExactMath>(samples, first, count, positionFace, x, y, z);
+                for(size_t k=0; k<count; ++k)
                 {
-                    SceneObject *object=(*it).second;
+                    //grab L and N for elegant writting purposes
+                    glm::vec3 L(x[k], y[k], z[k]);
+                    glm::vec3 N=normalFace;
+                    recordRay(lightObject->id(), positionFace, samples.position(first+k));
+
+                    //check for obstructions
+                    //also, we need to start casting the ray a little bit further to avoid unwanted collisions with self
+                    Ray toLight(positionFace+N*EPSILON, L);
+                    SceneObject::RayHitProperties secondRayHitProperties;
                     //we're not interested by hitting the light.
-                    if(object->id() != lightSource->id())
-                        object->intersectsRay(toLight, secondRayHitProperties);
-                }
-                glm::vec3 diffuse, specular;
-                if(!secondRayHitProperties.occuredHit) //no obstruction found?
-                {//we need to increment the light of this pixel.
-                    diffuse = face->colorDiffuse(*lightSource, N, L);
-                    specular = face->colorSpecular(*lightSource, N, L, vToEye);
+                    RENDER_STATS_ADD(shadowRays, 1);
+                    intersectsRay(toLight, secondRayHitProperties, lightObject);
+                    glm::vec3 diffuse, specular;
+                    if(!secondRayHitProperties.occuredHit) //no obstruction found?
+                    {//we need to increment the light of this pixel.
+                        diffuse = face->colorDiffuse(*lightSource, N, L);
+                        specular = face->colorSpecular(*lightSource, N, L, vToEye);
+                    }
+                    else
+                        RENDER_STATS_ADD(occludedShadowRays, 1);
+                    singleFaceLightColor += diffuse+specular;
                 }
-                singleFaceLightColor += diffuse+specular;
             }
             //mean of all computed colors
-            singleFaceLightColor /= ui.actualSize;
+            singleFaceLightColor /= samples.size();
             //add ambiant color
             glm::vec3 ambiant(face->colorAmbiant(*lightSource));
             finalColor += singleFaceLightColor+ambiant;
@@ -401,31 +1687,53 @@ glm::vec3 SceneManager::lightenMaterialProp(SceneFace_Prop *face, const glm::vec
     return glm::clamp(finalColor, glm::vec3(0,0,0), glm::vec3(1.0f, 1.0f, 1.0f));
 }
 
-glm::vec3 SceneManager::reflectionMaterialProp(SceneFace_Prop *face, const glm::vec3& positionFace,
-                                            const glm::vec3& normalFace, const glm::vec3 vToEye,
+template<class Math>
+void SceneManager::sampleDirections(const SceneObject::LightSamples& samples, size_t first, size_t count, const glm::vec3& from,
+                                    float *x, float *y, float *z)
+{
+    const float *sx=samples.x()+first, *sy=samples.y()+first, *sz=samples.z()+first;
+    for(size_t k=0; k<count; ++k)
+    {
+        float dx=sx[k]-from.x, dy=sy[k]-from.y, dz=sz[k]-from.z;
+        float inverseLength=Math::inverseSqrt(dx*dx+dy*dy+dz*dz);
+        x[k]=dx*inverseLength;
+        y[k]=dy*inverseLength;
+        z[k]=dz*inverseLength;
+    }
+}
+
+glm::vec3 SceneManager::reflectionMaterialProp(const MaterialProp *face, const SceneObject::RayHitProperties& surface,
+                                            const glm::vec3 vToEye,
                                             size_t quality, SceneObject::Integral::Type_t typeIntegral,
                                             float angleReflection, unsigned int reflectionQuality)
 {
     glm::vec3 finalColor(0,0,0);
+    const glm::vec3& positionFace=surface.positionHit;
+    const glm::vec3& normalFace=surface.normalHit;
     if(face->materialProperties().fReflectionPower > EPSILON)
     {
-        //create the cone of reflexion
+        //create the cone of reflexion, and all its directions at once
         Ray::RandomCone cone;
-        cone.direction = glm::reflect(-vToEye, normalFace);
-        cone.angle = angleReflection;
+        cone.setup(glm::reflect(-vToEye, normalFace), angleReflection);
+        std::vector<glm::vec3>& directions=ms_reflectionDirections;
+        directions.resize(reflectionQuality);
+        cone.sample(reflectionQuality, directions.data());
 
         for(unsigned int i=0; i<reflectionQuality; ++i)
         {
-            //r will have an updated ray every call
-            Ray r(positionFace + normalFace*EPSILON, cone);
+            Ray r(positionFace + normalFace*EPSILON, directions[i]);
             SceneObject::RayHitProperties rayHit;
-            for(iterator it=begin(); it!=end(); ++it)
+            RENDER_STATS_ADD(reflectionRays, 1);
+            intersectsRay(r, rayHit);
+            if(ms_recordedTile!=NULL && !m_bvh.empty())
             {
-                SceneObject *object=(*it).second;
-                object->intersectsRay(r, rayHit);
+                //a reflection ray which hits nothing goes through the whole scene
+                const AABB& scene=m_bvh.bounds();
+                float reach=glm::length(glm::max(glm::abs(scene.pMin-r.origin()), glm::abs(scene.pMax-r.origin())));
+                recordRay(ms_reflectionBeam, r.origin(), rayHit.occuredHit ? rayHit.positionHit : r.origin()+r.direction()*reach);
             }
             //should this ever happen, We're really not interested into reflecting ourselves.
-            if(rayHit.occuredHit && rayHit.objectHit!=face)
+            if(rayHit.occuredHit && !rayHit.sameSurface(surface))
             {
                 finalColor+=face->materialProperties().fReflectionPower *
                         (1.0f - face->materialProperties().fReflectionPower) *
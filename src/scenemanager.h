@@ -2,18 +2,39 @@
 #define SCENEMANAGER_H
 
 #include "sceneface.h"
+#include "sceneinstance.h"
+#include "sceneprimitives.h"
 #include "scenecamera.h"
+#include "visibilitybuffer.h"
+#include "raysorter.h"
+#include "fastmath.h"
+#include "renderstats.h"
+#include "costmap.h"
+#include "bvh.h"
+#include "bvh4.h"
 #include <map>
+#include <vector>
+#include <future>
+#include <QReadWriteLock>
 
 class SceneManager
 {
 public:
 #ifdef USE_QGLVIEWER
-    SceneManager(qglviewer::Camera &camera, GLint vaoId, GLint vboPositionId, GLint eboId, GLuint colorLocation);
+    SceneManager(qglviewer::Camera &camera, GLint vaoId, GLint vboPositionId, GLint eboId, GLuint colorLocation,
+                 GLuint vboInstanceId=0, GLint instanceMatrixLocation=-1);
 #else
-    SceneManager(qglviewer_fake::Camera &camera, GLint vaoId, GLint vboPositionId, GLint eboId, GLuint colorLocation);
+    SceneManager(qglviewer_fake::Camera &camera, GLint vaoId, GLint vboPositionId, GLint eboId, GLuint colorLocation,
+                 GLuint vboInstanceId=0, GLint instanceMatrixLocation=-1);
 #endif
 
+    ///
+    /// BINARY_BVH traverses the binary BVH the scene is built and refitted with.
+    /// WIDE_BVH traverses a BVH4 collapsed from it, smaller and faster to traverse on big scenes,
+    /// but which has to be collapsed again whenever the binary BVH changes.
+    ///
+    typedef enum {BINARY_BVH, WIDE_BVH} AccelerationBackend_t;
+
     typedef std::map<unsigned int, SceneObject*>::iterator iterator;
     typedef std::map<unsigned int, SceneObject*>::const_iterator const_iterator;
 
@@ -71,6 +92,101 @@ public:
     ///
     void drawScene();
 
+    //Ray queries
+
+    ///
+    /// \brief (re)builds the bottom-level BVH of every group which needs it, then the top-level BVH over the objects of the scene.
+    /// The rendering functions call it themselves whenever the scene changed.
+    ///
+    void buildAccelerationStructure();
+
+    ///
+    /// \brief brings the acceleration structure up to date before rendering.
+    /// Moved objects (given to objectMoved(), or which moved by themselves, see SceneObject::takeMoved()) only refit the BVH, which is cheap but slowly degrades its quality: once it degraded too much,
+    /// a full rebuild is started in the background and used as soon as it is done.
+    /// The scene is only rebuilt on the spot if objects were appended since the last build.
+    ///
+    void updateAccelerationStructure();
+
+    ///
+    /// \brief tells the manager the object changed its position or shape (e.g. through a manipulated frame),
+    /// so that the acceleration structure is refitted before the next rendering, and the tiles it may have changed
+    /// are rendered again by rerenderEdits().
+    /// \param id id of the object
+    ///
+    void objectMoved(unsigned int id);
+
+    ///
+    /// \brief chooses the acceleration structure traversed by ray queries, for the scene and its groups.
+    ///
+    void setAccelerationBackend(AccelerationBackend_t backend);
+    inline AccelerationBackend_t accelerationBackend() const {return m_accelerationBackend;}
+
+    ///
+    /// TRACED_VISIBILITY traces the camera rays through the acceleration structure, as every other ray.
+    /// RASTERIZED_VISIBILITY finds what they hit first with a VisibilityBuffer, rasterized by tiles on the CPU,
+    /// and only traces shadow and reflection rays (and the camera rays of the pixels it can't rasterize).
+    /// The rendered image is the same: the buffer tests pixels with the intersection kernels of the rays
+    /// (only the primitive picked among several hit at the same distance, on a shared edge, may differ).
+    ///
+    typedef enum {TRACED_VISIBILITY, RASTERIZED_VISIBILITY} PrimaryVisibility_t;
+
+    ///
+    /// \brief chooses how mainRendering() and rerenderEdits() find what the camera rays of the pixels hit first.
+    /// Jittered rays (see setAntialiasing()) are always traced.
+    ///
+    void setPrimaryVisibility(PrimaryVisibility_t visibility);
+    inline PrimaryVisibility_t primaryVisibility() const {return m_primaryVisibility;}
+
+    ///
+    /// \brief setSpecializedShading chooses how mainRendering() and rerenderEdits() shade the camera rays:
+    /// with a kernel compiled for the integral, the light model and the reflections of the rendering, chosen once per rendering
+    /// (the default), or with the generic shadeHit(), which tests them at each shading point.
+    /// Both give the same image.
+    ///
+    inline void setSpecializedShading(bool enabled) {m_specializedShading=enabled;}
+    inline bool specializedShading() const {return m_specializedShading;}
+
+    ///
+    /// \brief setFastMath makes the specialized shading kernels (see setSpecializedShading()) use the approximations
+    /// of FastMath instead of the standard functions: normalizations of the eye and light directions with a fast inverse
+    /// square root (lengths within 5e-6 of 1), and specular powers with a polynomial pow (relative error below 2e-4)
+    /// where the library has no faster powf. The sines and cosines of the reflection cones are always approximated
+    /// (see Ray::RandomCone::sample()). Off by default. Channels differ from the exact ones by one level of 255 at most
+    /// on the default scene, see compareFastMath().
+    ///
+    inline void setFastMath(bool enabled) {m_fastMath=enabled;}
+    inline bool fastMath() const {return m_fastMath;}
+
+    ///
+    /// \brief The FastMathReport_t struct tells how far the image of the fast math kernels is from the exact one.
+    ///
+    typedef struct
+    {
+        int             maxError;               //largest difference of a channel, out of 255
+        double          meanError;              //mean difference of the channels, out of 255
+        double          psnr;                   //peak signal to noise ratio in dB, infinite for identical images
+        size_t          differingPixels;
+        double          exactTime;              //seconds
+        double          fastTime;               //seconds
+    } FastMathReport_t;
+
+    ///
+    /// \brief compareFastMath renders the image with mainRendering(), with the exact then with the fast math kernels,
+    /// and compares both images. The rendering uses the UNIFORM integral, without antialiasing, for the differences
+    /// to only come from the approximations and not from random samples.
+    /// The image must be rendered in memory (see SceneCamera::setOutputFile()), it is left with the fast math rendering.
+    ///
+    FastMathReport_t compareFastMath(size_t quality, unsigned int reflectionQuality=0);
+
+    ///
+    /// \brief intersectsRay finds the closest object of the scene hit by the ray.
+    /// \param ray the ray (with origin and direction)
+    /// \param properties hit properties of the intersection
+    /// \param ignored an object the ray can't hit (NULL if none)
+    ///
+    void intersectsRay(const Ray &ray, SceneObject::RayHitProperties& properties, const SceneObject *ignored=NULL) const;
+
     //Non-OpenGL rendering
 
     ///
@@ -80,17 +196,159 @@ public:
     ///
     void myFirstRendering();
 
+    ///
+    /// \brief The RenderStats_t struct tells where the time of a mainRendering() went.
+    /// The counters of the hot paths are only counted in builds with RENDER_STATS (see RenderStats), they are 0 otherwise.
+    ///
+    typedef struct
+    {
+        RenderStats::Counters_t     counters;           //of every thread, since the start of the rendering
+        double                      accelerationTime;   //seconds: updateAccelerationStructure()
+        double                      visibilityTime;     //rasterization of the camera rays, 0 if they are traced
+        double                      shadingTime;        //rendering of the tiles
+        double                      outputTime;         //showing the image, or closing the file it was streamed to
+        double                      totalTime;
+    } RenderStats_t;
+
     ///
     /// \brief phongRendering
     /// uses phong rendering to render each object, with some faces being light sources.
     /// \param quality precision of the shadowing
     /// \param N N*N stochastic tracing (use 0 if you don't want to use stochastic ray tracing)
+    /// \return the statistics of the rendering
     ///
-    void mainRendering(size_t quality=0, SceneObject::Integral::Type_t typeIntegral=SceneObject::Integral::SINGLE_MEAN,
+    RenderStats_t mainRendering(size_t quality=0, SceneObject::Integral::Type_t typeIntegral=SceneObject::Integral::SINGLE_MEAN,
                         float reflectionAngle=M_PI, unsigned int reflectionQuality=0);
 
+    ///
+    /// \brief setAntialiasing makes mainRendering() cast more jittered camera rays through the pixels on edges:
+    /// pixels which don't see the same object as one of their neighbours, whose surface turns or jumps in depth,
+    /// or whose color is far from theirs. The other pixels keep their single ray, so that edges get supersampled
+    /// for a small part of the cost of supersampling the whole image.
+    /// \param samples rays added to the pixels on edges, 0 (the default) for none
+    ///
+    void setAntialiasing(unsigned int samples);
+    inline unsigned int antialiasing() const {return m_antialiasing;}
+
+    /// \brief antialiasedPixels is the number of pixels of the last mainRendering() found on edges.
+    inline size_t antialiasedPixels() const {return m_antialiasedPixels;}
+
+    ///
+    /// \brief setCostMap makes mainRendering() and rerenderEdits() record what each pixel cost (see CostMap),
+    /// and show its heatmaps over the image, or write them next to the file it was streamed to.
+    /// The pixels are only measured with the PIXEL_ORDER shading order, whose rays are cast pixel by pixel.
+    /// Off by default.
+    ///
+    inline void setCostMap(bool enabled) {m_costMapEnabled=enabled;}
+    inline bool costMapEnabled() const {return m_costMapEnabled;}
+
+    /// \brief costMap is the cost of the pixels of the last rendering, empty if it wasn't recorded.
+    inline const CostMap& costMap() const {return m_costMap;}
+
+    ///
+    /// PIXEL_ORDER shades each pixel before the next one, following its reflection and shadow rays right away.
+    /// WAVEFRONT shades a tile by waves: every camera ray of the tile, then every reflection ray, then every shadow ray,
+    /// each wave being traced before the next one is generated.
+    /// SORTED_WAVEFRONT also sorts the reflection and shadow rays of each wave by direction and origin (see RaySorter)
+    /// before tracing them, so that rays traversing the same part of the scene follow each other.
+    /// The image is the same with every order, but for the random numbers drawn in another order.
+    ///
+    typedef enum {PIXEL_ORDER, WAVEFRONT, SORTED_WAVEFRONT} ShadingOrder_t;
+
+    /// \brief setShadingOrder chooses how mainRendering() and rerenderEdits() go through the rays of a tile.
+    void setShadingOrder(ShadingOrder_t order);
+    inline ShadingOrder_t shadingOrder() const {return m_shadingOrder;}
+
+    ///
+    /// \brief The WavefrontReport_t struct tells where the time of the waves of the last mainRendering() went,
+    /// to weigh the sorting of the rays against what it saves on their traversal.
+    ///
+    typedef struct
+    {
+        size_t          rays;                   //reflection and shadow rays traced by waves
+        double          sortTime;               //seconds
+        double          traceTime;              //seconds
+    } WavefrontReport_t;
+
+    inline const WavefrontReport_t& wavefrontReport() const {return m_wavefrontReport;}
+
+    ///
+    /// \brief The RenderSettings_t struct gathers the parameters of a rendering, for renderings which don't run
+    /// right away (see RenderJob).
+    ///
+    typedef struct
+    {
+        bool                            firstRendering;     //renders as myFirstRendering() instead of mainRendering()
+        size_t                          quality;
+        SceneObject::Integral::Type_t   typeIntegral;
+        float                           reflectionAngle;
+        unsigned int                    reflectionQuality;
+    } RenderSettings_t;
+
+    ///
+    /// \brief renderRay is the color a camera ray brings back, as myFirstRendering() or mainRendering() render it.
+    /// The acceleration structure must be up to date. Several threads may render rays at once, as long as
+    /// the scene isn't edited meanwhile.
+    /// \param primaryHit if not NULL, receives what the ray hit first
+    ///
+    glm::vec3 renderRay(const Ray& ray, const RenderSettings_t& settings, SceneObject::RayHitProperties *primaryHit=NULL);
+
+    ///
+    /// \brief rerenderEdits renders again, with the settings and the view of the last mainRendering(), only the tiles
+    /// the edits made through the manager since then may have changed (append(), remove(), setObject(), objectMoved()),
+    /// and shows the image again.
+    /// Each tile records the objects its rays hit (camera, shadow and reflection rays) and the box its shadow and
+    /// reflection rays went through: it is rendered again if it hit an edited object, if the new box of the object
+    /// overlaps its rays, or if the object is now seen in it. Tiles which hit too many objects to record them fall back
+    /// to the boxes of the object, projected on the image. Editing a light renders every tile again, and so does
+    /// a new view or an image streamed to a file.
+    /// \return the number of tiles rendered again
+    ///
+    int rerenderEdits();
+
+    /// \brief dirtyTileCount is the number of tiles rerenderEdits() would render again, if the view didn't change.
+    int dirtyTileCount() const;
+
+    ///
+    /// \brief The BudgetReport_t struct tells what a budgeted rendering achieved.
+    ///
+    typedef struct
+    {
+        unsigned int    passes;                 //complete passes over the image
+        size_t          quality;                //settings of the last pass
+        unsigned int    reflectionQuality;
+        float           samplesPerPixel;        //camera rays per pixel, on average
+        float           lightSamplesPerPixel;   //light samples per pixel and per light, on average
+        double          pilotTime;              //seconds
+        double          renderTime;             //seconds, pilot included
+    } BudgetReport_t;
+
+    ///
+    /// \brief budgetedRendering renders like mainRendering(), with as many samples as fit in a wall-clock budget.
+    /// A pilot pass on a few pixels measures the cost of light and reflection samples. The image is then rendered
+    /// by progressive passes of jittered camera rays and random light samples, accumulated in a float image:
+    /// the settings of each pass are picked (and corrected by the time the previous pass actually took)
+    /// to give the most samples while leaving time for a few passes. The rendering stops at the deadline, pilot included,
+    /// checked every tile height of pixels, with every sample accumulated so far. An image without pixels gives a report of zeros.
+    /// \param budget seconds, the acceleration structure and the output of the image excluded
+    /// \param maxQuality highest light quality of a pass (quality*quality samples per light)
+    /// \param maxReflectionQuality highest number of reflection rays of a pass
+    ///
+    BudgetReport_t budgetedRendering(double budget, float reflectionAngle=M_PI/8.0f,
+                                     size_t maxQuality=10, unsigned int maxReflectionQuality=5);
+
     //Other functions
 
+    /// \brief the camera the non-OpenGL renderings cast their rays from, and write their image with.
+    inline SceneCamera& sceneCamera() {return m_camera;}
+
+    ///
+    /// \brief renderLock is held for reading by the renderings running on other threads while they render
+    /// (see RenderJob, PreviewRenderer), and for writing by updateAccelerationStructure(): a background
+    /// rebuild of the BVH is never swapped in under a rendering.
+    ///
+    inline QReadWriteLock& renderLock() {return m_renderLock;}
+
     SceneObject *operator[](unsigned int i);
 
     void setObject(unsigned int index, SceneObject* object);
@@ -102,16 +360,230 @@ public:
 private:
 
     //render functions
-    glm::vec3 lightenMaterialProp(SceneFace_Prop *face, const glm::vec3& positionFace, const glm::vec3 &normalFace,
+
+    /// \brief shadePixel is the color seen by a camera ray (see mainRendering()).
+    glm::vec3 shadePixel(const Ray& firstRay, size_t quality, SceneObject::Integral::Type_t typeIntegral,
+                         float reflectionAngle, unsigned int reflectionQuality,
+                         SceneObject::RayHitProperties *primaryHit=NULL);
+
+    /// \brief shadeHit is the color seen by a camera ray, once what it hit first is known.
+    glm::vec3 shadeHit(const Ray& firstRay, const SceneObject::RayHitProperties& firstRayHitProperties, size_t quality,
+                       SceneObject::Integral::Type_t typeIntegral, float reflectionAngle, unsigned int reflectionQuality);
+
+    glm::vec3 lightenMaterialProp(const MaterialProp *face, const glm::vec3& positionFace, const glm::vec3 &normalFace,
                                   const glm::vec3 vToEye, size_t quality, SceneObject::Integral::Type_t type=SceneObject::Integral::SINGLE_MEAN);
 
-    glm::vec3 reflectionMaterialProp(SceneFace_Prop *face, const glm::vec3& positionFace,
-                                    const glm::vec3& normalFace, const glm::vec3 vToEye,
+    glm::vec3 reflectionMaterialProp(const MaterialProp *face, const SceneObject::RayHitProperties& surface,
+                                    const glm::vec3 vToEye,
                                     size_t quality, SceneObject::Integral::Type_t typeIntegral,
                                     float angleReflection, unsigned int reflectionQuality);
 
+    //shading kernels, specialized at compile time (see setSpecializedShading())
+
+    ///
+    /// \brief The Light_t struct is a light of the scene, found once per rendering, with the samples of its integral
+    /// if they are the same for every shading point.
+    ///
+    typedef struct
+    {
+        SceneObject                 *object;
+        const LightSource           *source;
+        SceneObject::LightSamples   samples;
+    } Light_t;
+
+    ///
+    /// \brief The PhongModel struct lights a material with the diffuse and specular terms of a light,
+    /// as MaterialProp::colorDiffuse() and MaterialProp::colorSpecular() do, with the pow of Math.
+    ///
+    struct PhongModel
+    {
+        template<class Math>
+        static inline glm::vec3 shade(const MaterialProp& material, const LightSource& light,
+                                      const glm::vec3& N, const glm::vec3& L, const glm::vec3& vToEye)
+        {
+            const MaterialProp::MaterialProperties_t& m=material.materialProperties();
+            glm::vec3 diffuse=light.lightProperties().vDiffuse * std::max(0.0f, glm::dot(N, L)) * m.vDiffuse;
+            float specularTerm=Math::pow(std::max(0.0f, glm::dot(glm::reflect(-L, N), vToEye)), m.fSpecularPower);
+            return diffuse + m.vSpecular * specularTerm * light.lightProperties().vSpecular;
+        }
+    };
+
+    /// \brief The LambertModel struct lights a material with the diffuse term only, for lights without specular.
+    struct LambertModel
+    {
+        template<class Math>
+        static inline glm::vec3 shade(const MaterialProp& material, const LightSource& light,
+                                      const glm::vec3& N, const glm::vec3& L, const glm::vec3& /*vToEye*/)
+            {return material.colorDiffuse(light, N, L);}
+    };
+
+    typedef glm::vec3 (SceneManager::*ShadingKernel_t)(const Ray&, const SceneObject::RayHitProperties&, const RenderSettings_t&);
+
+    ///
+    /// \brief prepareShading finds the lights of the scene, samples those whose samples are fixed,
+    /// and chooses the shading kernel of the rendering.
+    ///
+    void prepareShading(const RenderSettings_t& settings);
+
+    template<SceneObject::Integral::Type_t Sampling, class Math>
+    static ShadingKernel_t selectKernel(bool lambert, bool reflections);
+
+    ///
+    /// \brief shadingKernel is shadeHit() for one integral, light model and reflection mode, using the prepared lights.
+    /// Math (ExactMath or FastMath) gives the inverse square roots and the powers of the shading.
+    ///
+    template<SceneObject::Integral::Type_t Sampling, class Model, bool Reflections, class Math>
+    glm::vec3 shadingKernel(const Ray& firstRay, const SceneObject::RayHitProperties& hit, const RenderSettings_t& settings);
+
+    template<SceneObject::Integral::Type_t Sampling, class Model, class Math>
+    glm::vec3 lightenKernel(const MaterialProp *face, const glm::vec3& positionFace, const glm::vec3& normalFace,
+                            const glm::vec3& vToEye, size_t quality);
+
+    /// \brief recordedCostMap is the map the tiles record the cost of their pixels in, NULL if there is none.
+    inline CostMap *recordedCostMap() {return m_costMapEnabled && m_shadingOrder==PIXEL_ORDER ? &m_costMap : NULL;}
+
+    /// \brief shade is the color of what a camera ray hit first, with the kernel of the rendering if there is one.
+    inline glm::vec3 shade(const Ray& firstRay, const SceneObject::RayHitProperties& hit, const RenderSettings_t& settings)
+    {
+        if(m_shadingKernel!=NULL)
+            return (this->*m_shadingKernel)(firstRay, hit, settings);
+        return shadeHit(firstRay, hit, settings.quality, settings.typeIntegral, settings.reflectionAngle, settings.reflectionQuality);
+    }
+
+    //incremental renderings (see rerenderEdits())
+
+    ///
+    /// \brief The RayBeam_t struct bounds rays going from one box to another: every ray of the beam is inside
+    /// the boxes interpolated between them, which is much tighter than their common box for long, slanted rays.
+    ///
+    typedef struct
+    {
+        unsigned int                key;                //id of the light of shadow rays, ms_reflectionBeam for reflection rays
+        AABB                        from;               //origins of the rays
+        AABB                        to;                 //ends of the rays
+    } RayBeam_t;
+
+    typedef struct
+    {
+        std::vector<unsigned int>   objects;            //ids of the objects hit by the rays of the tile, sorted
+        std::vector<RayBeam_t>      beams;              //shadow and reflection rays of the tile
+        bool                        complete;           //false if the tile hit too many objects to record them
+    } TileDependencies_t;
+
+    ///
+    /// \brief The RenderRecord_t struct is what mainRendering() leaves for rerenderEdits().
+    ///
+    typedef struct
+    {
+        RenderSettings_t                settings;
+        SceneCamera::View               view;
+        int                             tileSize;
+        std::vector<TileDependencies_t> tiles;          //empty if there is no rendering to render again
+        std::vector<bool>               dirtyTiles;
+    } RenderRecord_t;
+
+    /// \brief renderTile renders tile i of the camera as mainRendering() does, and records its dependencies.
+    void renderTile(int i, const RenderSettings_t& settings);
+
+    ///
+    /// \brief renderPixel renders the camera ray of pixel (x,y) of the tile being rendered.
+    ///
+    glm::vec3 renderPixel(int x, int y, const RenderSettings_t& settings, SceneObject::RayHitProperties *primaryHit=NULL);
+
+    ///
+    /// \brief castPrimaryRay finds what the camera ray of pixel (x,y) of the tile being rendered hits first,
+    /// through the visibility buffer if the primary visibility is rasterized.
+    ///
+    void castPrimaryRay(int x, int y, Ray& ray, SceneObject::RayHitProperties& hit);
+
+    ///
+    /// \brief The ShadingPoint_t struct is a point hit by a camera or a reflection ray, to be lit by a wave of shadow rays.
+    ///
+    typedef struct
+    {
+        size_t                      pixel;              //in the tile
+        const MaterialProp          *material;
+        glm::vec3                   position;
+        glm::vec3                   normal;
+        glm::vec3                   vToEye;
+        float                       weight;             //of its light in the color of the pixel
+        const SceneObject           *object;            //hit, which its reflection rays don't hit again
+        unsigned int                primitive;
+        const SceneObject           *instance;          //see SceneObject::RayHitProperties::instanceHit
+    } ShadingPoint_t;
+
+    ///
+    /// \brief renderWavefront renders the camera rays of a tile by waves (see setShadingOrder()).
+    /// \param colors receives the color of each pixel of the tile, row after row
+    /// \param primaryHits if not NULL, receives what the camera ray of each pixel hit first
+    ///
+    void renderWavefront(const SceneCamera::RenderTile& tile, const RenderSettings_t& settings,
+                         std::vector<glm::vec3>& colors, std::vector<SceneObject::RayHitProperties> *primaryHits);
+
+    ///
+    /// \brief sampleDirections computes the normalized directions from a point to count light samples, from the first one,
+    /// with the inverse square root of Math.
+    ///
+    template<class Math>
+    static void sampleDirections(const SceneObject::LightSamples& samples, size_t first, size_t count, const glm::vec3& from,
+                                 float *x, float *y, float *z);
+
+    ///
+    /// \brief lightPoints lights shading points with a wave of shadow rays, as lightenMaterialProp() does.
+    /// \param lit receives the light of each point, clamped, before its weight
+    ///
+    void lightPoints(const ShadingPoint_t *points, size_t count, const RenderSettings_t& settings, std::vector<glm::vec3>& lit);
+
+    /// \brief traceWave traces a wave of rays, sorted first if the shading order says so.
+    void traceWave(const std::vector<Ray>& rays, const std::vector<const SceneObject*>& ignored,
+                   std::vector<SceneObject::RayHitProperties>& hits);
+
+    ///
+    /// \brief The PixelHit_t struct is what the camera ray of a pixel hit, to find the edges (see setAntialiasing()).
+    ///
+    typedef struct
+    {
+        const SceneObject   *object;        //NULL if nothing was hit
+        glm::vec3           normal;
+        float               distance;
+        bool                inImage;        //false for the pixels around the image
+    } PixelHit_t;
+
+    /// \brief onEdge tells if two neighbour pixels see an edge between them.
+    static bool onEdge(const PixelHit_t& a, const PixelHit_t& b);
+
+    /// \brief invalidateTiles marks the tiles an object may have changed, from oldBounds to newBounds (empty if none).
+    void invalidateTiles(const SceneObject *object, const AABB& oldBounds, const AABB& newBounds);
+
+    /// \brief invalidateProjectedTiles marks the tiles a box is seen in, or only the incomplete ones.
+    void invalidateProjectedTiles(const AABB& box, bool incompleteOnly);
+
+    /// \brief recordObject and recordRay add to the dependencies of the tile rendered by this thread, if any.
+    static void recordObject(unsigned int id);
+    static void recordRay(unsigned int key, const glm::vec3& from, const glm::vec3& to);
+
+    /// \brief beamOverlaps tells if a ray of the beam may go through the box.
+    static bool beamOverlaps(const RayBeam_t& beam, const AABB& box);
+
     std::map<unsigned int, SceneObject*> m_objects;
 
+    /// top-level acceleration structure, over the objects of m_bvhObjects (removed objects are NULL)
+    BVH                             m_bvh;
+    std::vector<SceneObject*>       m_bvhObjects;
+    std::vector<AABB>               m_bvhBounds;
+    std::map<unsigned int, unsigned int> m_bvhIndices;      //index in m_bvhObjects of each object
+    std::vector<unsigned int>       m_bvhMoved;             //objects to refit before the next rendering
+    std::future<BVH>                m_bvhRebuild;           //full rebuild running in the background
+    bool                            m_bvhDirty;
+
+    QReadWriteLock                  m_renderLock;
+
+    AccelerationBackend_t           m_accelerationBackend;
+    BVH4                            m_bvh4;                 //collapsed from m_bvh when the backend is WIDE_BVH
+
+    PrimaryVisibility_t             m_primaryVisibility;
+    VisibilityBuffer                m_visibilityBuffer;     //of the last mainRendering(), if the primary visibility is rasterized
+
     SceneCamera                     m_camera;
 
     /// OpenGL objects
@@ -127,6 +599,37 @@ private:
 
     GLsizeiptr                      m_VBOPositionCapacity;
     GLsizeiptr                      m_EBOCapacity;
+
+    RenderRecord_t                  m_renderRecord;
+
+    bool                            m_specializedShading;
+    bool                            m_fastMath;
+    ShadingKernel_t                 m_shadingKernel;        //of the rendering, NULL outside of renderings
+    std::vector<Light_t>            m_lights;
+
+    ShadingOrder_t                  m_shadingOrder;
+    RaySorter                       m_raySorter;
+    std::vector<unsigned int>       m_waveOrder;
+    WavefrontReport_t               m_wavefrontReport;
+    static const size_t             ms_wavePoints=1024;     //shading points lit by a wave of shadow rays at most
+
+    unsigned int                    m_antialiasing;
+    size_t                          m_antialiasedPixels;
+    bool                            m_costMapEnabled;
+    CostMap                         m_costMap;
+    static const float              ms_edgeCosAngle;        //neighbour normals further apart are on an edge
+    static const float              ms_edgeDepthRatio;      //and so are relative depth differences above this
+    static const float              ms_edgeContrast;        //and color differences above this, on any channel
+    static thread_local TileDependencies_t *ms_recordedTile;        //set while mainRendering() renders a tile
+    static thread_local SceneObject::LightSamples ms_lightSamples;  //samples of the light being integrated
+    static thread_local std::vector<glm::vec3> ms_reflectionDirections; //of the reflection cone of the point being shaded
+    static const size_t             ms_sampleChunk=16;              //light samples whose directions are computed together
+    static const size_t             ms_maxTileDependencies=256;     //objects a tile records at most
+    static const unsigned int       ms_reflectionBeam=~0u;
+    static const int                ms_beamSlices=8;                //boxes a beam is tested with
+
+    static const size_t             ms_pilotPixels=1024;    //pixels of the pilot pass of budgetedRendering()
+    static const unsigned int       ms_minimumPasses=4;     //passes a budgeted rendering leaves time for
 };
 
 #endif // SCENEMANAGER_H
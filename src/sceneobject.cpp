@@ -1,10 +1,78 @@
 #include "sceneobject.h"
+#include <algorithm>
 
 unsigned int SceneObject::ms_currentId=0;
 GLuint SceneObject::ms_uniformColorLocation=0;
+GLuint SceneObject::ms_vboInstanceId=0;
+GLint SceneObject::ms_attribInstanceMatrixLocation=-1;
+const size_t SceneObject::LightSamples::ms_alignment;
 
 SceneObject::SceneObject() :
     m_id(ms_currentId++),
+    m_moved(false),
     m_color(0,0,0)
 {
 }
+
+SceneObject::LightSamples::LightSamples() :
+    m_storage(),
+    m_arrays(NULL),
+    m_size(0),
+    m_stride(0)
+{}
+
+SceneObject::LightSamples::LightSamples(const LightSamples& other) :
+    m_storage(),
+    m_arrays(NULL),
+    m_size(0),
+    m_stride(0)
+{
+    *this=other;
+}
+
+SceneObject::LightSamples& SceneObject::LightSamples::operator=(const LightSamples& other)
+{
+    if(this!=&other)
+    {
+        //the copied storage wouldn't be aligned the same way
+        resize(other.m_size);
+        for(int array=0; array<4; ++array)
+            std::copy(other.m_arrays+array*other.m_stride, other.m_arrays+array*other.m_stride+m_size, m_arrays+array*m_stride);
+    }
+    return *this;
+}
+
+void SceneObject::LightSamples::resize(size_t count)
+{
+    const size_t alignment=ms_alignment/sizeof(float);
+    m_size=count;
+    m_stride=(count+alignment-1)/alignment*alignment;
+    if(m_storage.size()<4*m_stride+alignment)
+        m_storage.resize(4*m_stride+alignment);
+    size_t misalignment=((size_t)m_storage.data()/sizeof(float))%alignment;
+    m_arrays=m_storage.data() + (misalignment==0 ? 0 : alignment-misalignment);
+}
+
+void SceneObject::sampleSurface(size_t N, Integral::Type_t type, LightSamples& samples) const
+{
+    Integral last=endIntegral(N, type);
+    samples.resize(last.index);
+    size_t i=0;
+    for(Integral ui=beginIntegral(N, type); ui!=last && i<samples.size(); nextIntegral(ui))
+        samples.set(i++, ui.value, 0.0f);
+}
+
+void SceneObject::resetInstanceMatrix()
+{
+    if(ms_attribInstanceMatrixLocation<0)
+        return;
+
+    //when its array is disabled, the attribute takes a constant value: one identity column per location
+    for(GLuint i=0; i<4; ++i)
+    {
+        GLuint location=ms_attribInstanceMatrixLocation+i;
+        glVertexAttribDivisor(location, 0);
+        glDisableVertexAttribArray(location);
+        glVertexAttrib4f(location, i==0 ? 1.0f : 0.0f, i==1 ? 1.0f : 0.0f, i==2 ? 1.0f : 0.0f, i==3 ? 1.0f : 0.0f);
+    }
+}
@@ -2,7 +2,9 @@
 #define SCENEOBJECT_H
 
 #include "ray.h"
+#include "aabb.h"
 #include <GL/glew.h>
+#include <vector>
 
 ///
 /// \brief The SceneObject class is an abstract representation for a scene object
@@ -19,17 +21,29 @@ public:
     {
     public:
         RayHitProperties() :
-            occuredHit(false)
+            occuredHit(false),
+            primitiveHit(0),
+            instanceHit(NULL)
         {}
 
+        ///
+        /// \brief sameSurface tells if both hits are on the same primitive of the same object, seen through the same
+        /// instance: copies of a group can see each other, a surface can't see itself.
+        ///
+        inline bool sameSurface(const RayHitProperties& other) const
+            {return objectHit==other.objectHit && primitiveHit==other.primitiveHit && instanceHit==other.instanceHit;}
+
         bool            occuredHit;
         SceneObject     *objectHit;
+        unsigned int    primitiveHit;   //index of the primitive hit, for objects made of several primitives
+        const SceneObject *instanceHit; //instance the object hit was seen through (objectHit is then in its group), NULL if none
         glm::vec3       positionHit;
         glm::vec3       normalHit;
         float           distanceHit;
     };
 
     SceneObject();
+    virtual ~SceneObject() {}
 
     ///
     /// \brief intersectsRay computes the intersection properties between the ray and this object.
@@ -39,6 +53,13 @@ public:
     ///
     virtual void intersectsRay(const Ray &ray, RayHitProperties& properties) =0;
 
+    ///
+    /// \brief bounds
+    /// \return the box bounding the object in world space, used by the acceleration structures.
+    /// Objects which can't be hit by a ray return an empty box.
+    ///
+    virtual AABB bounds() const =0;
+
     //uniform integral simulation on the surface, iterator style
 
     class Integral
@@ -70,6 +91,55 @@ public:
     virtual void nextIntegral(Integral& integral) const=0;
     virtual Integral endIntegral(size_t N=0, Integral::Type_t type=Integral::SINGLE_MEAN) const=0;
 
+    //the same integral, all the samples at once
+
+    ///
+    /// \brief The LightSamples class is a batch of points on the surface of an object, with their density.
+    /// The coordinates are stored by arrays (x, then y, then z, then the densities), each aligned on ms_alignment bytes,
+    /// so that the loops going through the samples vectorize.
+    ///
+    class LightSamples
+    {
+    public:
+        LightSamples();
+        LightSamples(const LightSamples& other);
+        LightSamples& operator=(const LightSamples& other);
+
+        /// \brief resize makes room for count samples, whose values are undefined until set.
+        void resize(size_t count);
+        inline size_t size() const                                  {return m_size;}
+
+        inline float *x()                                           {return m_arrays;}
+        inline float *y()                                           {return m_arrays+m_stride;}
+        inline float *z()                                           {return m_arrays+2*m_stride;}
+        inline float *pdf()                                         {return m_arrays+3*m_stride;}
+        inline const float *x() const                               {return m_arrays;}
+        inline const float *y() const                               {return m_arrays+m_stride;}
+        inline const float *z() const                               {return m_arrays+2*m_stride;}
+        inline const float *pdf() const                             {return m_arrays+3*m_stride;}
+
+        inline glm::vec3 position(size_t i) const                   {return glm::vec3(m_arrays[i], m_arrays[m_stride+i], m_arrays[2*m_stride+i]);}
+        inline void set(size_t i, const glm::vec3& position, float density)
+            {m_arrays[i]=position.x; m_arrays[m_stride+i]=position.y; m_arrays[2*m_stride+i]=position.z; m_arrays[3*m_stride+i]=density;}
+
+        static const size_t         ms_alignment=32;        //bytes, an AVX register
+
+    private:
+        std::vector<float>          m_storage;
+        float                       *m_arrays;              //first aligned float of m_storage
+        size_t                      m_size;
+        size_t                      m_stride;               //floats from an array to the next one
+    };
+
+    ///
+    /// \brief sampleSurface fills samples with the points of the integral of type over the surface, in one call.
+    /// They are the points beginIntegral() to endIntegral() go through, in the same order, and their mean
+    /// is what the integral computes. The density of each sample is given per unit of area: 1/area for the current
+    /// integrals, which all spread their samples uniformly, and 0 for objects whose area isn't known.
+    /// This generic version goes through the iterator.
+    ///
+    virtual void sampleSurface(size_t N, Integral::Type_t type, LightSamples& samples) const;
+
     //OpenGL indexes
 
     inline void setFirstVBOPosition(GLintptr first)     {m_firstVBOPosition=first;}
@@ -105,19 +175,43 @@ public:
 
     virtual void draw() const=0;
 
+    ///
+    /// \brief drawInstanced draws instanceCount copies of the object in a single call,
+    /// each copy being transformed by the matrix found in the instance VBO.
+    ///
+    virtual void drawInstanced(GLsizei instanceCount) const=0;
+
     //properties
 
     inline unsigned int id() const {return m_id;}
 
+    ///
+    /// \brief takeMoved tells if the object moved itself (e.g. an instance given a new transform) since the last call,
+    /// and clears it. SceneManager::updateAccelerationStructure() collects these moves, as if objectMoved() was called.
+    ///
+    inline bool takeMoved() {bool moved=m_moved; m_moved=false; return moved;}
+
     inline void setColor(const glm::vec3 &color) {m_color=color;}
     inline const glm::vec3& color() {return m_color;}
 
     inline static void setColorLocation(GLuint uniformColorLocation) {ms_uniformColorLocation=uniformColorLocation;}
+    inline static void setInstanceLocations(GLuint vboInstanceId, GLint instanceMatrixLocation)
+        {ms_vboInstanceId=vboInstanceId; ms_attribInstanceMatrixLocation=instanceMatrixLocation;}
+
+    ///
+    /// \brief resetInstanceMatrix sets the instance matrix attribute back to the identity,
+    /// the value seen by the shaders for non-instanced draws.
+    ///
+    static void resetInstanceMatrix();
 
 
 protected:
 
+    /// \brief setMoved is called by the objects whose position or shape changed.
+    inline void setMoved() {m_moved=true;}
+
     unsigned int m_id;
+    bool         m_moved;
 
     GLintptr                    m_firstVBOPosition;    //first index of the VBO datas, used by the manager
     GLintptr                    m_firstEBO;            //first index of the EBO datas, used by the manager
@@ -126,6 +220,8 @@ protected:
     glm::vec3                   m_color;
 
     static GLuint       ms_uniformColorLocation;
+    static GLuint       ms_vboInstanceId;                   //VBO holding the per-instance matrices of instanced draws
+    static GLint        ms_attribInstanceMatrixLocation;    //first of the 4 locations of the instance matrix attribute
     static unsigned int ms_currentId;
 };
 
@@ -0,0 +1,621 @@
+#include "sceneprimitives.h"
+#include "renderstats.h"
+#include <algorithm>
+
+const unsigned int ScenePrimitives::ms_typeShift;
+const unsigned int ScenePrimitives::ms_indexMask;
+const unsigned int ScenePrimitives::ms_diskSegments;
+const unsigned int ScenePrimitives::ms_sphereRings;
+const unsigned int ScenePrimitives::ms_sphereSegments;
+
+//Sphere
+
+ScenePrimitives::Sphere::Sphere(const glm::vec3& c, float r) :
+    center(c),
+    radius(r)
+{
+    if(r<=0)
+        ERROR("ScenePrimitives: forbidden to have spheres with a radius lower or equal to 0");
+}
+
+AABB ScenePrimitives::Sphere::bounds() const
+{
+    AABB box;
+    box.pMin=center-glm::vec3(radius);
+    box.pMax=center+glm::vec3(radius);
+    return box;
+}
+
+float ScenePrimitives::Sphere::area() const
+{
+    return 4.0f*float(M_PI)*radius*radius;
+}
+
+glm::vec3 ScenePrimitives::Sphere::sample(float u, float v) const
+{
+    float z=1.0f-2.0f*u;
+    float r=std::sqrt(std::max(0.0f, 1.0f-z*z));
+    float phi=2.0f*float(M_PI)*v;
+    return center+radius*glm::vec3(r*std::cos(phi), r*std::sin(phi), z);
+}
+
+//Disk
+
+ScenePrimitives::Disk::Disk(const glm::vec3& c, const glm::vec3& n, float r) :
+    center(c),
+    radius(r)
+{
+    if(r<=0)
+        ERROR("ScenePrimitives: forbidden to have disks with a radius lower or equal to 0");
+    if(glm::length(n)<=EPSILON)
+        ERROR("ScenePrimitives: the normal of a disk is too small (disk generation not deterministic)");
+
+    normal=glm::normalize(n);
+    //any vector which isn't colinear to the normal gives the plane of the disk
+    glm::vec3 helper=std::abs(normal.x)<0.9f ? glm::vec3(1,0,0) : glm::vec3(0,1,0);
+    axisU=glm::normalize(glm::cross(helper, normal));
+    axisV=glm::cross(normal, axisU);
+}
+
+AABB ScenePrimitives::Disk::bounds() const
+{
+    //extent of the circle along each world axis, and some thickness so that the box is never degenerated
+    glm::vec3 extent=radius*glm::sqrt(glm::max(glm::vec3(0.0f), glm::vec3(1.0f)-normal*normal)) + glm::vec3(EPSILON);
+    AABB box;
+    box.pMin=center-extent;
+    box.pMax=center+extent;
+    return box;
+}
+
+float ScenePrimitives::Disk::area() const
+{
+    return float(M_PI)*radius*radius;
+}
+
+glm::vec3 ScenePrimitives::Disk::sample(float u, float v) const
+{
+    float r=radius*std::sqrt(u);
+    float phi=2.0f*float(M_PI)*v;
+    return center + axisU*(r*std::cos(phi)) + axisV*(r*std::sin(phi));
+}
+
+//Triangle
+
+ScenePrimitives::Triangle::Triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    if(!set(a, b, c))
+        ERROR("ScenePrimitives: the points of a triangle are colinear (triangle generation not deterministic)");
+}
+
+bool ScenePrimitives::Triangle::set(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    p0=a;
+    edge1=b-a;
+    edge2=c-a;
+    glm::vec3 n=glm::cross(edge1, edge2);
+    float length=glm::length(n);
+    normal= length>0 ? n/length : glm::vec3(0,0,0);
+    return length>0;
+}
+
+AABB ScenePrimitives::Triangle::bounds() const
+{
+    AABB box;
+    box.extend(p0);
+    box.extend(p0+edge1);
+    box.extend(p0+edge2);
+    box.pMin-=glm::vec3(EPSILON);
+    box.pMax+=glm::vec3(EPSILON);
+    return box;
+}
+
+float ScenePrimitives::Triangle::area() const
+{
+    return 0.5f*glm::length(glm::cross(edge1, edge2));
+}
+
+glm::vec3 ScenePrimitives::Triangle::sample(float u, float v) const
+{
+    //folding the square on the triangle would not be uniform, the square root spreads the points evenly
+    float su=std::sqrt(u);
+    return p0 + edge1*(su*(1.0f-v)) + edge2*(su*v);
+}
+
+//Quad
+
+ScenePrimitives::Quad::Quad(const glm::vec3& bottomLeftPos, const glm::vec3& directionW, const glm::vec3& directionH, float w, float h) :
+    p0(bottomLeftPos),
+    width(w),
+    height(h)
+{
+    if(w==0 || h==0)
+        ERROR("ScenePrimitives: forbidden to have quads with width or height equal to 0");
+
+    //same frame as SceneFace
+    glm::vec3 n=glm::cross(directionW, directionH);
+    if(glm::length(n)<=0)
+        ERROR("ScenePrimitives: directions of a quad are colinear (quad generation not deterministic)");
+    normal=glm::normalize(n);
+    axisW=glm::normalize(directionW);
+    axisH=glm::normalize(glm::cross(normal, directionW));
+}
+
+AABB ScenePrimitives::Quad::bounds() const
+{
+    AABB box;
+    box.extend(p0);
+    box.extend(p0+axisW*width);
+    box.extend(p0+axisH*height);
+    box.extend(p0+axisW*width+axisH*height);
+    box.pMin-=glm::vec3(EPSILON);
+    box.pMax+=glm::vec3(EPSILON);
+    return box;
+}
+
+float ScenePrimitives::Quad::area() const
+{
+    return width*height;
+}
+
+glm::vec3 ScenePrimitives::Quad::sample(float u, float v) const
+{
+    return p0 + axisW*(u*width) + axisH*(v*height);
+}
+
+//ScenePrimitives
+
+ScenePrimitives::ScenePrimitives() :
+    SceneObject(),
+    m_spheres(),
+    m_disks(),
+    m_triangles(),
+    m_quads(),
+    m_references(),
+    m_areas(),
+    m_bvh(),
+    m_bounds(),
+    m_built(false)
+{
+}
+
+void ScenePrimitives::appendReference(PrimitiveType_t type, size_t index)
+{
+    if(index>ms_indexMask)
+        ERROR("ScenePrimitives: too many primitives of the same type in a single registry");
+    m_references.push_back(((unsigned int)type<<ms_typeShift) | (unsigned int)index);
+    m_built=false;
+}
+
+void ScenePrimitives::append(const Sphere& sphere)
+{
+    m_spheres.push_back(sphere);
+    appendReference(SPHERE, m_spheres.size()-1);
+}
+
+void ScenePrimitives::append(const Disk& disk)
+{
+    m_disks.push_back(disk);
+    appendReference(DISK, m_disks.size()-1);
+}
+
+void ScenePrimitives::append(const Triangle& triangle)
+{
+    m_triangles.push_back(triangle);
+    appendReference(TRIANGLE, m_triangles.size()-1);
+}
+
+void ScenePrimitives::append(const Quad& quad)
+{
+    m_quads.push_back(quad);
+    appendReference(QUAD, m_quads.size()-1);
+}
+
+ScenePrimitives::Triangle* ScenePrimitives::allocateTriangles(size_t count)
+{
+    size_t first=m_triangles.size();
+    m_triangles.resize(first+count);
+    m_references.reserve(m_references.size()+count);
+    for(size_t i=first; i<first+count; ++i)
+        appendReference(TRIANGLE, i);
+    m_built=false;
+    return count>0 ? &m_triangles.mutableAt(first) : NULL;
+}
+
+void ScenePrimitives::clear()
+{
+    m_spheres.clear();
+    m_disks.clear();
+    m_triangles.clear();
+    m_quads.clear();
+    m_references.clear();
+    m_areas.clear();
+    m_bvh.clear();
+    m_bounds=AABB();
+    m_built=false;
+}
+
+void ScenePrimitives::build()
+{
+    std::vector<AABB> primitivesBounds;
+    primitivesBounds.reserve(m_references.size());
+    m_areas.clear();
+    m_areas.reserve(m_references.size());
+    m_bounds=AABB();
+
+    double totalArea=0.0;
+    for(unsigned int i=0; i<m_references.size(); ++i)
+    {
+        unsigned int index=primitiveIndex(i);
+        AABB box;
+        float area=0.0f;
+        switch(primitiveType(i))
+        {
+        case SPHERE:
+            box=m_spheres[index].bounds();
+            area=m_spheres[index].area();
+            break;
+        case DISK:
+            box=m_disks[index].bounds();
+            area=m_disks[index].area();
+            break;
+        case TRIANGLE:
+            box=m_triangles[index].bounds();
+            area=m_triangles[index].area();
+            break;
+        default: //quad
+            box=m_quads[index].bounds();
+            area=m_quads[index].area();
+        }
+        primitivesBounds.push_back(box);
+        m_bounds.extend(box);
+        totalArea+=area;
+        m_areas.push_back(totalArea);
+    }
+    m_bvh.build(primitivesBounds);
+    m_built=true;
+}
+
+glm::vec3 ScenePrimitives::samplePosition(float u, float v) const
+{
+    if(m_areas.empty())
+        return glm::vec3(0,0,0);
+
+    //pick the primitive, then rescale u to [0,1[ on it
+    double target=u*m_areas.back();
+    unsigned int i=std::upper_bound(m_areas.begin(), m_areas.end(), target)-m_areas.begin();
+    i=std::min(i, (unsigned int)m_areas.size()-1);
+    double previous= i>0 ? m_areas[i-1] : 0.0;
+    double area=m_areas[i]-previous;
+    float w= area>0 ? (float)std::min((target-previous)/area, 1.0) : 0.0f;
+
+    unsigned int index=primitiveIndex(i);
+    switch(primitiveType(i))
+    {
+    case SPHERE:
+        return m_spheres[index].sample(w, v);
+    case DISK:
+        return m_disks[index].sample(w, v);
+    case TRIANGLE:
+        return m_triangles[index].sample(w, v);
+    default: //quad
+        return m_quads[index].sample(w, v);
+    }
+}
+
+void ScenePrimitives::intersectsRay(const Ray &ray, RayHitProperties& properties)
+{
+    if(!m_built)
+        ERROR("ScenePrimitives: build() not called before casting rays against the primitives!");
+
+    ScenePrimitives *registry=this;     //its arrays are only read, through the const accessors: they may be mapped, and other threads trace rays too
+    m_bvh.intersectsRay(ray, properties, [registry](unsigned int i, const Ray& r, RayHitProperties& p)
+    {
+        float tMax = p.occuredHit ? p.distanceHit : std::numeric_limits<float>::max();
+        float t;
+        glm::vec3 normal;
+        unsigned int index=registry->primitiveIndex(i);
+        bool hit;
+        RENDER_STATS_ADD(intersectionTests, 1);
+        //the primitives of a leaf are tested with the kernel of their type, no virtual call involved
+        switch(registry->primitiveType(i))
+        {
+        case SPHERE:
+            hit=registry->spheres()[index].intersectsRay(r, tMax, t, normal);
+            break;
+        case DISK:
+            hit=registry->disks()[index].intersectsRay(r, tMax, t, normal);
+            break;
+        case TRIANGLE:
+            hit=registry->triangles()[index].intersectsRay(r, tMax, t, normal);
+            break;
+        default: //quad
+            hit=registry->quads()[index].intersectsRay(r, tMax, t, normal);
+        }
+        if(hit)
+        {
+            p.occuredHit    = true;
+            p.objectHit     = registry;
+            p.primitiveHit  = i;
+            p.instanceHit   = NULL;
+            p.positionHit   = r.origin() + r.direction()*t;
+            p.normalHit     = normal;
+            p.distanceHit   = t;
+        }
+    });
+}
+
+AABB ScenePrimitives::bounds() const
+{
+    return m_bounds;
+}
+
+//Uniform integration
+
+SceneObject::Integral ScenePrimitives::beginIntegral(size_t N, Integral::Type_t type) const
+{
+    Integral ui;
+    ui.type = type;
+    ui.index=0;
+
+    switch(ui.type)
+    {
+    case Integral::UNIFORM:
+        ui.size=N;
+        ui.actualSize=N*N;
+        //center of the first cell of the grid
+        ui.value=samplePosition(0.5f/N, 0.5f/N);
+        break;
+
+    case Integral::UNIFORM_RANDOM:
+    {
+        std::uniform_real_distribution<float> randomGen(0.0f, 1.0f);
+        ui.size=N;
+        ui.actualSize=N*N;
+        ui.value=samplePosition(randomGen(Random::genMt19937), randomGen(Random::genMt19937));
+        break;
+    }
+    default: //single_mean or invalid
+    {
+        ui.size=1;
+        ui.actualSize=1;
+        //mean of the surface, weighted by the area of each primitive
+        glm::vec3 mean(0,0,0);
+        for(unsigned int i=0; i<m_references.size(); ++i)
+        {
+            unsigned int index=primitiveIndex(i);
+            float area=(float)(m_areas[i] - (i>0 ? m_areas[i-1] : 0.0));
+            glm::vec3 center;
+            switch(primitiveType(i))
+            {
+            case SPHERE:
+                center=m_spheres[index].center;
+                break;
+            case DISK:
+                center=m_disks[index].center;
+                break;
+            case TRIANGLE:
+                center=m_triangles[index].sample(4.0f/9.0f, 0.5f);
+                break;
+            default: //quad
+                center=m_quads[index].sample(0.5f, 0.5f);
+            }
+            mean+=center*area;
+        }
+        ui.value= area()>0 ? mean/area() : mean;
+    }
+    }
+
+    return ui;
+}
+
+void ScenePrimitives::nextIntegral(Integral& integral) const
+{
+    ++integral.index;
+
+    switch(integral.type)
+    {
+    case Integral::UNIFORM:
+    {
+        //stratified over the whole surface, one sample in the center of each cell
+        size_t i=integral.index%integral.size;
+        size_t j=integral.index/integral.size;
+        integral.value=samplePosition((i+0.5f)/integral.size, (j+0.5f)/integral.size);
+        break;
+    }
+    case Integral::UNIFORM_RANDOM:
+    {
+        std::uniform_real_distribution<float> randomGen(0.0f, 1.0f);
+        integral.value=samplePosition(randomGen(Random::genMt19937), randomGen(Random::genMt19937));
+        break;
+    }
+    default: //single_mean or invalid
+        ;
+    }
+}
+
+SceneObject::Integral ScenePrimitives::endIntegral(size_t N, Integral::Type_t type) const
+{
+    Integral ui;
+
+    switch(type)
+    {
+    case Integral::UNIFORM:
+    case Integral::UNIFORM_RANDOM:
+        ui.index=N*N;
+        break;
+
+    default: //single_mean or invalid
+        ui.index=1;
+    }
+
+    return ui;
+}
+
+void ScenePrimitives::sampleSurface(size_t N, Integral::Type_t type, LightSamples& samples) const
+{
+    float density = area()>0 ? 1.0f/area() : 0.0f;
+    switch(type)
+    {
+    case Integral::UNIFORM:
+        samples.resize(N*N);
+        for(size_t j=0; j<N; ++j)
+        {
+            for(size_t i=0; i<N; ++i)
+                samples.set(j*N+i, samplePosition((i+0.5f)/N, (j+0.5f)/N), density);
+        }
+        break;
+
+    case Integral::UNIFORM_RANDOM:
+    {
+        std::uniform_real_distribution<float> randomGen(0.0f, 1.0f);
+        samples.resize(N*N);
+        for(size_t i=0; i<N*N; ++i)
+        {
+            float u=randomGen(Random::genMt19937);
+            samples.set(i, samplePosition(u, randomGen(Random::genMt19937)), density);
+        }
+        break;
+    }
+    default: //single_mean or invalid: the weighted mean computed by beginIntegral()
+        samples.resize(1);
+        samples.set(0, beginIntegral(N, type).value, density);
+    }
+}
+
+//OpenGL sizes
+
+GLint ScenePrimitives::numberAttributes() const
+{
+    return m_spheres.size()*(ms_sphereRings+1)*(ms_sphereSegments+1)
+            + m_disks.size()*(ms_diskSegments+1)
+            + m_triangles.size()*3
+            + m_quads.size()*4;
+}
+
+GLsizeiptr ScenePrimitives::sizeVBOPosition() const
+{
+    return numberAttributes() * 3 * sizeof(GLfloat);
+}
+
+GLsizeiptr ScenePrimitives::sizeEBO() const
+{
+    size_t count=m_spheres.size()*ms_sphereRings*ms_sphereSegments*6
+            + m_disks.size()*ms_diskSegments*3
+            + m_triangles.size()*3
+            + m_quads.size()*6;
+    return count * sizeof(unsigned int);
+}
+
+void ScenePrimitives::tessellate(std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices) const
+{
+    vertices.clear();
+    indices.clear();
+    vertices.reserve(numberAttributes());
+    indices.reserve(sizeEBO()/sizeof(unsigned int));
+
+    for(MappedArray<Sphere>::const_iterator it=m_spheres.begin(); it!=m_spheres.end(); ++it)
+    {
+        unsigned int first=vertices.size();
+        for(unsigned int r=0; r<=ms_sphereRings; ++r)
+        {
+            float theta=float(M_PI)*r/ms_sphereRings;
+            for(unsigned int s=0; s<=ms_sphereSegments; ++s)
+            {
+                float phi=2.0f*float(M_PI)*s/ms_sphereSegments;
+                vertices.push_back((*it).center + (*it).radius*glm::vec3(std::sin(theta)*std::cos(phi),
+                                                                         std::sin(theta)*std::sin(phi),
+                                                                         std::cos(theta)));
+            }
+        }
+        for(unsigned int r=0; r<ms_sphereRings; ++r)
+        {
+            for(unsigned int s=0; s<ms_sphereSegments; ++s)
+            {
+                unsigned int a=first + r*(ms_sphereSegments+1) + s;
+                unsigned int b=a + ms_sphereSegments+1;
+                unsigned int quad[6]={a, b, a+1, a+1, b, b+1};
+                indices.insert(indices.end(), quad, quad+6);
+            }
+        }
+    }
+
+    for(MappedArray<Disk>::const_iterator it=m_disks.begin(); it!=m_disks.end(); ++it)
+    {
+        unsigned int first=vertices.size();
+        vertices.push_back((*it).center);
+        for(unsigned int s=0; s<ms_diskSegments; ++s)
+        {
+            float phi=2.0f*float(M_PI)*s/ms_diskSegments;
+            vertices.push_back((*it).center + (*it).radius*((*it).axisU*std::cos(phi) + (*it).axisV*std::sin(phi)));
+        }
+        for(unsigned int s=0; s<ms_diskSegments; ++s)
+        {
+            unsigned int triangle[3]={first, first+1+s, first+1+(s+1)%ms_diskSegments};
+            indices.insert(indices.end(), triangle, triangle+3);
+        }
+    }
+
+    for(MappedArray<Triangle>::const_iterator it=m_triangles.begin(); it!=m_triangles.end(); ++it)
+    {
+        unsigned int first=vertices.size();
+        vertices.push_back((*it).p0);
+        vertices.push_back((*it).p0+(*it).edge1);
+        vertices.push_back((*it).p0+(*it).edge2);
+        unsigned int triangle[3]={first, first+1, first+2};
+        indices.insert(indices.end(), triangle, triangle+3);
+    }
+
+    for(MappedArray<Quad>::const_iterator it=m_quads.begin(); it!=m_quads.end(); ++it)
+    {
+        unsigned int first=vertices.size();
+        vertices.push_back((*it).sample(0,0));
+        vertices.push_back((*it).sample(1,0));
+        vertices.push_back((*it).sample(1,1));
+        vertices.push_back((*it).sample(0,1));
+        unsigned int quad[6]={first, first+1, first+2, first, first+2, first+3};
+        indices.insert(indices.end(), quad, quad+6);
+    }
+}
+
+//OpenGL fill given VBO and EBO segment
+
+void ScenePrimitives::makeVBOPosition(GLint vboId) const
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+    tessellate(vertices, indices);
+    if(vertices.empty())
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vboId);
+    glBufferSubData(GL_ARRAY_BUFFER, m_firstVBOPosition, sizeVBOPosition(), &vertices[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ScenePrimitives::makeEBO(GLint eboId) const
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+    tessellate(vertices, indices);
+    if(indices.empty())
+        return;
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboId);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, m_firstEBO, sizeEBO(), &indices[0]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+//OpenGL draw with given VBO and EBO segments
+
+void ScenePrimitives::draw() const
+{
+    glUniform3fv(ms_uniformColorLocation, 1, &m_color[0]);
+    glDrawElementsBaseVertex(GL_TRIANGLES, sizeEBO()/sizeof(unsigned int), GL_UNSIGNED_INT, (GLvoid*)(m_firstEBO), m_baseVertexEBO);
+}
+
+void ScenePrimitives::drawInstanced(GLsizei instanceCount) const
+{
+    glUniform3fv(ms_uniformColorLocation, 1, &m_color[0]);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, sizeEBO()/sizeof(unsigned int), GL_UNSIGNED_INT, (GLvoid*)(m_firstEBO),
+                                      instanceCount, m_baseVertexEBO);
+}
@@ -0,0 +1,318 @@
+#ifndef SCENEPRIMITIVES_H
+#define SCENEPRIMITIVES_H
+
+#include "sceneobject.h"
+#include "material.h"
+#include "bvh.h"
+#include <vector>
+
+///
+/// \brief The ScenePrimitives class is a registry of analytic primitives (spheres, disks, triangles and quads)
+/// sharing the same material or light properties.
+/// Each type of primitive is stored in its own compact array, and the registry is one scene object with its own BVH:
+/// a ray only pays one virtual call to reach the registry, and the leaves of the BVH are intersected
+/// with the kernel of their type, which are small non-virtual functions.
+/// The primitives also give their bounds and can be sampled uniformly on their surface, so a registry can be a light source.
+///
+class ScenePrimitives : public SceneObject
+{
+public:
+
+    typedef enum {SPHERE=0, DISK, TRIANGLE, QUAD} PrimitiveType_t;
+
+    class Sphere
+    {
+    public:
+        Sphere(const glm::vec3& center, float radius);
+
+        inline bool intersectsRay(const Ray& ray, float tMax, float& t, glm::vec3& normal) const;
+        AABB bounds() const;
+        float area() const;
+        glm::vec3 sample(float u, float v) const;
+
+        glm::vec3   center;
+        float       radius;
+    };
+
+    class Disk
+    {
+    public:
+        Disk(const glm::vec3& center, const glm::vec3& normal, float radius);
+
+        inline bool intersectsRay(const Ray& ray, float tMax, float& t, glm::vec3& normal) const;
+        AABB bounds() const;
+        float area() const;
+        glm::vec3 sample(float u, float v) const;
+
+        glm::vec3   center;
+        glm::vec3   normal;
+        glm::vec3   axisU;      //orthonormal basis of the plane of the disk
+        glm::vec3   axisV;
+        float       radius;
+    };
+
+    class Triangle
+    {
+    public:
+        Triangle() {}
+        Triangle(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2);
+
+        ///
+        /// \brief set same as the constructor, without failing on degenerated triangles (as found in meshes),
+        /// which are kept with a null normal and area: they are never hit nor sampled.
+        /// \return false if the triangle is degenerated
+        ///
+        bool set(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2);
+
+        inline bool intersectsRay(const Ray& ray, float tMax, float& t, glm::vec3& normal) const;
+        AABB bounds() const;
+        float area() const;
+        glm::vec3 sample(float u, float v) const;
+
+        glm::vec3   p0;
+        glm::vec3   edge1;      //p1-p0
+        glm::vec3   edge2;      //p2-p0
+        glm::vec3   normal;
+    };
+
+    ///
+    /// \brief The Quad class is the same rectangle as SceneFace, built from the same parameters.
+    ///
+    class Quad
+    {
+    public:
+        Quad(const glm::vec3& p0, const glm::vec3& directionW, const glm::vec3& directionH, float w, float h);
+
+        inline bool intersectsRay(const Ray& ray, float tMax, float& t, glm::vec3& normal) const;
+        AABB bounds() const;
+        float area() const;
+        glm::vec3 sample(float u, float v) const;
+
+        glm::vec3   p0;
+        glm::vec3   axisW;
+        glm::vec3   axisH;
+        glm::vec3   normal;
+        float       width;
+        float       height;
+    };
+
+    ScenePrimitives();
+
+    //the primitives are given in the space of the registry. build() must be called again before any ray is cast,
+    //and before the registry is given to a SceneManager or a SceneGroup, which need its bounds.
+
+    void append(const Sphere& sphere);
+    void append(const Disk& disk);
+    void append(const Triangle& triangle);
+    void append(const Quad& quad);
+
+    ///
+    /// \brief allocateTriangles appends count triangles at once, to be set by the caller (possibly from several threads).
+    /// \return the first of the new triangles, valid until the next append
+    ///
+    Triangle* allocateTriangles(size_t count);
+
+    void clear();
+
+    ///
+    /// \brief build (re)builds the BVH over every primitive, and the distribution used to sample the surface.
+    ///
+    void build();
+    inline bool isBuilt() const                             {return m_built;}
+
+    inline const MappedArray<Sphere>& spheres() const       {return m_spheres;}
+    inline const MappedArray<Disk>& disks() const           {return m_disks;}
+    inline const MappedArray<Triangle>& triangles() const   {return m_triangles;}
+    inline const MappedArray<Quad>& quads() const           {return m_quads;}
+
+    /// \brief total number of primitives, the indices given in RayHitProperties::primitiveHit are below this number.
+    inline size_t size() const                              {return m_references.size();}
+
+    /// \brief the type of a primitive and its index inside the array of this type.
+    inline PrimitiveType_t primitiveType(unsigned int primitive) const      {return (PrimitiveType_t)(m_references[primitive]>>ms_typeShift);}
+    inline unsigned int primitiveIndex(unsigned int primitive) const        {return m_references[primitive] & ms_indexMask;}
+
+    ///
+    /// \brief samplePosition maps (u,v) from [0,1[x[0,1[ to a point of the registry, so that uniform samples
+    /// give uniform points on the whole surface: u first picks a primitive according to its area, then is reused on it.
+    ///
+    glm::vec3 samplePosition(float u, float v) const;
+
+    inline float area() const                               {return m_areas.empty() ? 0.0f : (float)m_areas.back();}
+
+    void intersectsRay(const Ray &ray, RayHitProperties& properties);
+
+    AABB bounds() const;
+
+    //Uniform integration
+
+    Integral beginIntegral(size_t N=0, Integral::Type_t type=Integral::SINGLE_MEAN) const;
+    void nextIntegral(Integral& integral) const;
+    Integral endIntegral(size_t N=0, Integral::Type_t type=Integral::SINGLE_MEAN) const;
+    void sampleSurface(size_t N, Integral::Type_t type, LightSamples& samples) const;
+
+    //OpenGL sizes (spheres and disks are tessellated)
+
+    GLint numberAttributes() const;
+
+    GLsizeiptr sizeVBOPosition() const;
+    GLsizeiptr sizeEBO() const;
+
+    //OpenGL fill given VBO and EBO segment
+
+    void makeVBOPosition(GLint vboId) const;
+    void makeEBO(GLint eboId) const;
+
+    //OpenGL draw with given VBO and EBO segments
+
+    void draw() const;
+    void drawInstanced(GLsizei instanceCount) const;
+
+private:
+
+    friend class SceneCache;
+
+    void appendReference(PrimitiveType_t type, size_t index);
+
+    /// \brief fills the triangles drawn by OpenGL, as vertices and indices starting at 0.
+    void tessellate(std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices) const;
+
+    MappedArray<Sphere>         m_spheres;
+    MappedArray<Disk>           m_disks;
+    MappedArray<Triangle>       m_triangles;
+    MappedArray<Quad>           m_quads;
+
+    MappedArray<unsigned int>   m_references;   //type and index of every primitive, in the order of the BVH primitives
+    MappedArray<double>         m_areas;        //cumulated areas of the primitives, to sample the surface (double, since meshes have millions of tiny triangles)
+    BVH                         m_bvh;
+    AABB                        m_bounds;
+    bool                        m_built;
+
+    static const unsigned int   ms_typeShift=30;
+    static const unsigned int   ms_indexMask=(1u<<ms_typeShift)-1;
+
+    static const unsigned int   ms_diskSegments=24;     //tessellation of the OpenGL view
+    static const unsigned int   ms_sphereRings=12;
+    static const unsigned int   ms_sphereSegments=24;
+};
+
+///
+/// \brief The ScenePrimitives_Prop class is a registry of primitives with phong material properties for advanced rendering.
+///
+class ScenePrimitives_Prop : public ScenePrimitives, public MaterialProp
+{
+public:
+    ScenePrimitives_Prop() :
+        ScenePrimitives()
+    {}
+};
+
+///
+/// \brief The ScenePrimitives_Light class is a registry of primitives with phong light properties for advanced rendering.
+/// The light is sampled uniformly over the surface of all its primitives.
+///
+class ScenePrimitives_Light : public ScenePrimitives, public LightSource
+{
+public:
+    ScenePrimitives_Light() :
+        ScenePrimitives()
+    {}
+};
+
+//intersection kernels
+
+bool ScenePrimitives::Sphere::intersectsRay(const Ray& ray, float tMax, float& t, glm::vec3& n) const
+{
+    //the direction of the ray isn't always normalized (see SceneInstance), so the quadratic is solved in full
+    glm::vec3 oc=ray.origin()-center;
+    float a=glm::dot(ray.direction(), ray.direction());
+    float halfB=glm::dot(oc, ray.direction());
+    float c=glm::dot(oc, oc)-radius*radius;
+    float discriminant=halfB*halfB-a*c;
+    if(discriminant<0)
+        return false;
+
+    float root=std::sqrt(discriminant);
+    float tHit=(-halfB-root)/a;
+    if(tHit<=EPSILON)
+        tHit=(-halfB+root)/a;   //the ray starts inside the sphere
+    if(tHit<=EPSILON || tHit>=tMax)
+        return false;
+
+    t=tHit;
+    n=(ray.origin()+ray.direction()*t-center)/radius;
+    if(glm::dot(n, ray.direction())>0)
+        n=-n;
+    return true;
+}
+
+bool ScenePrimitives::Disk::intersectsRay(const Ray& ray, float tMax, float& t, glm::vec3& n) const
+{
+    float NdotrD=glm::dot(normal, ray.direction());
+    if(std::abs(NdotrD)<=EPSILON)
+        return false;
+
+    float tHit=glm::dot(normal, center-ray.origin())/NdotrD;
+    if(tHit<=0 || tHit>=tMax)
+        return false;
+
+    glm::vec3 d=ray.origin()+ray.direction()*tHit-center;
+    if(glm::dot(d, d)>radius*radius)
+        return false;
+
+    t=tHit;
+    n=NdotrD>0 ? -normal : normal;
+    return true;
+}
+
+bool ScenePrimitives::Triangle::intersectsRay(const Ray& ray, float tMax, float& t, glm::vec3& n) const
+{
+    //Möller-Trumbore
+    glm::vec3 p=glm::cross(ray.direction(), edge2);
+    float determinant=glm::dot(edge1, p);
+    if(std::abs(determinant)<=EPSILON*EPSILON)
+        return false;
+
+    float invDeterminant=1.0f/determinant;
+    glm::vec3 s=ray.origin()-p0;
+    float u=glm::dot(s, p)*invDeterminant;
+    if(u<0 || u>1)
+        return false;
+
+    glm::vec3 q=glm::cross(s, edge1);
+    float v=glm::dot(ray.direction(), q)*invDeterminant;
+    if(v<0 || u+v>1)
+        return false;
+
+    float tHit=glm::dot(edge2, q)*invDeterminant;
+    if(tHit<=0 || tHit>=tMax)
+        return false;
+
+    t=tHit;
+    n=glm::dot(normal, ray.direction())>0 ? -normal : normal;
+    return true;
+}
+
+bool ScenePrimitives::Quad::intersectsRay(const Ray& ray, float tMax, float& t, glm::vec3& n) const
+{
+    float NdotrD=glm::dot(normal, ray.direction());
+    if(std::abs(NdotrD)<=EPSILON)
+        return false;
+
+    float tHit=glm::dot(normal, p0-ray.origin())/NdotrD;
+    if(tHit<=0 || tHit>=tMax)
+        return false;
+
+    //coordinates of the hit point in the frame of the quad
+    glm::vec3 d=ray.origin()+ray.direction()*tHit-p0;
+    float u=glm::dot(d, axisW);
+    float v=glm::dot(d, axisH);
+    if(u<=EPSILON || u>=width-EPSILON || v<=EPSILON || v>=height-EPSILON)
+        return false;
+
+    t=tHit;
+    n=NdotrD>0 ? -normal : normal;
+    return true;
+}
+
+#endif // SCENEPRIMITIVES_H
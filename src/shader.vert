@@ -1,14 +1,15 @@
 #version 330
 
-//Every given coordinate is already in World coordinate.
-//The program is too simple to be bothered by Object matrixes.
+//Every given coordinate is already in World coordinate, except for instanced objects
+//which are brought into World coordinate by their instance matrix (identity otherwise).
 
 in vec3 vtx_position;
+in mat4 vtx_instanceMatrix;
 
 uniform mat4 u_mtxProjection;
 uniform mat4 u_mtxView;
 
 void main()
 {
-        gl_Position = u_mtxProjection * u_mtxView * vec4(vtx_position, 1.0); //this is in View
+        gl_Position = u_mtxProjection * u_mtxView * vtx_instanceMatrix * vec4(vtx_position, 1.0); //this is in View
 }
@@ -0,0 +1,113 @@
+#include "taskpool.h"
+#include "trace.h"
+#include <algorithm>
+
+TaskPool::TaskPool(unsigned int threadCount) :
+    m_workers(),
+    m_tasks(),
+    m_mutex(),
+    m_condition(),
+    m_stopping(false)
+{
+    for(unsigned int i=0; i<threadCount; ++i)
+        m_workers.push_back(std::thread(&TaskPool::workerLoop, this));
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping=true;
+    }
+    m_condition.notify_all();
+    for(std::vector<std::thread>::iterator it=m_workers.begin(); it!=m_workers.end(); ++it)
+        (*it).join();
+}
+
+TaskPool& TaskPool::globalInstance()
+{
+    static TaskPool pool;
+    return pool;
+}
+
+unsigned int TaskPool::defaultThreadCount()
+{
+    unsigned int cores=std::thread::hardware_concurrency();
+    return cores>1 ? cores-1 : 0;
+}
+
+void TaskPool::run(Group& group, const std::function<void()>& task)
+{
+    ++group.pending;
+    if(m_workers.empty())
+    {
+        //nobody to give the task to
+        task();
+        --group.pending;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Task t;
+        t.function=task;
+        t.group=&group;
+        m_tasks.push_back(t);
+    }
+    m_condition.notify_one();
+}
+
+void TaskPool::wait(Group& group)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(group.pending>0)
+    {
+        if(!runPendingTask(lock))
+            m_condition.wait(lock, [this, &group]() {return group.pending==0 || !m_tasks.empty();});
+    }
+}
+
+void TaskPool::parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& body)
+{
+    grainSize=std::max(grainSize, (size_t)1);
+    Group group;
+    for(size_t first=begin; first<end; first+=grainSize)
+    {
+        size_t last=std::min(first+grainSize, end);
+        run(group, [&body, first, last]() {body(first, last);});
+    }
+    wait(group);
+}
+
+void TaskPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!m_stopping)
+    {
+        if(!runPendingTask(lock))
+            m_condition.wait(lock, [this]() {return m_stopping || !m_tasks.empty();});
+    }
+}
+
+bool TaskPool::runPendingTask(std::unique_lock<std::mutex>& lock)
+{
+    if(m_tasks.empty())
+        return false;
+
+    //the latest tasks are the smallest ones in recursive algorithms, and the most likely to be in cache
+    Task task=m_tasks.back();
+    m_tasks.pop_back();
+
+    lock.unlock();
+    {
+        TRACE_SCOPE("TaskPool task");
+        task.function();
+    }
+    bool groupDone = --task.group->pending == 0;
+    lock.lock();
+
+    //someone may be waiting for this group
+    if(groupDone)
+        m_condition.notify_all();
+    return true;
+}
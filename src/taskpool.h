@@ -0,0 +1,86 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+///
+/// \brief The TaskPool class runs small tasks on a fixed set of worker threads.
+/// Tasks are gathered in groups the caller can wait for. A thread waiting for a group runs pending tasks
+/// in the meantime, so tasks may themselves spawn and wait for other tasks (e.g. recursive builds) without deadlocking.
+///
+class TaskPool
+{
+public:
+
+    class Group
+    {
+    public:
+        Group() : pending(0) {}
+
+    private:
+        friend class TaskPool;
+        std::atomic<unsigned int>   pending;
+    };
+
+    ///
+    /// \param threadCount number of worker threads. The thread calling wait() also takes part in the work,
+    /// so the default uses one worker less than the number of cores.
+    ///
+    explicit TaskPool(unsigned int threadCount=defaultThreadCount());
+    ~TaskPool();
+
+    ///
+    /// \brief globalInstance
+    /// \return the pool shared by the whole application
+    ///
+    static TaskPool& globalInstance();
+
+    ///
+    /// \brief run queues a task, which will be done by the time wait(group) returns.
+    ///
+    void run(Group& group, const std::function<void()>& task);
+
+    ///
+    /// \brief wait returns once every task of the group is done, running pending tasks while waiting.
+    ///
+    void wait(Group& group);
+
+    ///
+    /// \brief parallelFor calls body(first, last) on chunks of at most grainSize elements covering [begin, end),
+    /// and returns once all of them are done.
+    ///
+    void parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& body);
+
+    /// \brief number of threads working on the tasks, the calling thread included.
+    inline unsigned int concurrency() const         {return m_workers.size()+1;}
+
+    static unsigned int defaultThreadCount();
+
+private:
+
+    class Task
+    {
+    public:
+        std::function<void()>   function;
+        Group                   *group;
+    };
+
+    void workerLoop();
+
+    /// \brief pops a task if there is one, and runs it. The lock must be held, it is released while the task runs.
+    bool runPendingTask(std::unique_lock<std::mutex>& lock);
+
+    std::vector<std::thread>    m_workers;
+    std::deque<Task>            m_tasks;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_condition;
+    bool                        m_stopping;
+};
+
+#endif // TASKPOOL_H
@@ -0,0 +1,80 @@
+#include "tiledimagewriter.h"
+#include <QByteArray>
+#include <algorithm>
+
+TiledImageWriter::TiledImageWriter() :
+    m_file(),
+    m_path(),
+    m_width(0),
+    m_height(0),
+    m_headerSize(0),
+    m_failed(false)
+{}
+
+TiledImageWriter::~TiledImageWriter()
+{
+    close();
+}
+
+bool TiledImageWriter::open(const QString& path, int width, int height)
+{
+    close();
+    m_path=path;
+    m_width=width;
+    m_height=height;
+    m_failed=false;
+
+    m_file.setFileName(path);
+    if(!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("TiledImageWriter: couldn't create %s", qPrintable(path));
+        return false;
+    }
+
+    QByteArray header=QByteArray("P6\n")+QByteArray::number(width)+" "+QByteArray::number(height)+"\n255\n";
+    m_headerSize=header.size();
+    //the pixels are allocated at once (most file systems don't even write them), so that tiles can go anywhere
+    if(m_file.write(header)!=m_headerSize || !m_file.resize(m_headerSize+(qint64)width*height*3))
+    {
+        qWarning("TiledImageWriter: couldn't allocate %s (%dx%d)", qPrintable(path), width, height);
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+bool TiledImageWriter::writeTile(int x, int y, int width, int height, const unsigned char *rgb)
+{
+    int xBegin=std::max(x, 0), xEnd=std::min(x+width, m_width);
+    int yBegin=std::max(y, 0), yEnd=std::min(y+height, m_height);
+    if(xBegin>=xEnd || yBegin>=yEnd)
+        return true;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_file.isOpen())
+        return false;
+
+    qint64 rowSize=(qint64)(xEnd-xBegin)*3;
+    for(int row=yBegin; row<yEnd; ++row)
+    {
+        const char *source=(const char*)rgb+((qint64)(row-y)*width+(xBegin-x))*3;
+        if(!m_file.seek(m_headerSize+((qint64)row*m_width+xBegin)*3) || m_file.write(source, rowSize)!=rowSize)
+        {
+            if(!m_failed)
+                qWarning("TiledImageWriter: couldn't write in %s", qPrintable(m_path));
+            m_failed=true;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TiledImageWriter::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_file.isOpen())
+        return false;
+    bool written=m_file.flush() && !m_failed;
+    m_file.close();
+    return written;
+}
@@ -0,0 +1,49 @@
+#ifndef TILEDIMAGEWRITER_H
+#define TILEDIMAGEWRITER_H
+
+#include <QFile>
+#include <QString>
+#include <mutex>
+
+///
+/// \brief The TiledImageWriter class writes an image to a binary PPM file (P6, 8 bits RGB) one tile at a time.
+/// The file is created with its final size, and every tile is written straight at its place:
+/// the image is never held in memory, and tiles can be written in any order, from several threads.
+///
+class TiledImageWriter
+{
+public:
+    TiledImageWriter();
+    ~TiledImageWriter();
+
+    ///
+    /// \brief open creates (or replaces) the file, filled with black pixels.
+    /// \return false if the file couldn't be created, in which case a warning tells why.
+    ///
+    bool open(const QString& path, int width, int height);
+
+    ///
+    /// \brief writeTile writes width*height RGB pixels at (x,y). Pixels outside the image are ignored.
+    /// \param rgb rows of 3*width bytes, from top to bottom
+    ///
+    bool writeTile(int x, int y, int width, int height, const unsigned char *rgb);
+
+    /// \brief close flushes and closes the file.
+    bool close();
+
+    inline bool isOpen() const          {return m_file.isOpen();}
+    inline int width() const            {return m_width;}
+    inline int height() const           {return m_height;}
+    inline const QString& path() const  {return m_path;}
+
+private:
+    QFile       m_file;
+    QString     m_path;
+    int         m_width;
+    int         m_height;
+    qint64      m_headerSize;
+    bool        m_failed;       //a write failed since the file was opened
+    std::mutex  m_mutex;        //seek and write aren't atomic
+};
+
+#endif // TILEDIMAGEWRITER_H
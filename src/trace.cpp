@@ -0,0 +1,115 @@
+#include "trace.h"
+#include <QFile>
+#include <QByteArray>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+
+std::atomic<bool> Trace::ms_enabled(false);
+std::atomic<int64_t> Trace::ms_epoch(0);
+std::mutex Trace::ms_mutex;
+Trace::ThreadBuffer *Trace::ms_buffers=NULL;
+uint32_t Trace::ms_threadCount=0;
+thread_local Trace::ThreadHolder Trace::ms_holder;
+
+Trace::ThreadHolder::ThreadHolder() :
+    buffer(NULL),
+    thread(0)
+{
+    std::lock_guard<std::mutex> lock(ms_mutex);
+    thread=++ms_threadCount;
+    for(ThreadBuffer *b=ms_buffers; b!=NULL && buffer==NULL; b=b->next)
+        if(b->ended.load(std::memory_order_relaxed))
+        {
+            b->ended.store(false, std::memory_order_relaxed);
+            buffer=b;
+        }
+    if(buffer==NULL)
+    {
+        buffer=new ThreadBuffer;
+        buffer->written.store(0, std::memory_order_relaxed);
+        buffer->ended.store(false, std::memory_order_relaxed);
+        buffer->next=ms_buffers;
+        ms_buffers=buffer;
+    }
+}
+
+Trace::ThreadHolder::~ThreadHolder()
+{
+    std::lock_guard<std::mutex> lock(ms_mutex);
+    buffer->ended.store(true, std::memory_order_relaxed);
+}
+
+void Trace::setEnabled(bool enabled)
+{
+    if(enabled)
+    {
+        int64_t epoch=0;
+        ms_epoch.compare_exchange_strong(epoch, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+    ms_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t Trace::now()
+{
+    int64_t time=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    return (uint64_t)(time-ms_epoch.load(std::memory_order_relaxed))+1;
+}
+
+void Trace::record(const char *name, uint64_t start, uint64_t end)
+{
+    ThreadHolder& holder=ms_holder;
+    ThreadBuffer *buffer=holder.buffer;
+    uint64_t written=buffer->written.load(std::memory_order_relaxed);
+    Event_t& event=buffer->events[written%ms_capacity];
+    event.name=name;
+    event.start=start;
+    event.end=end;
+    event.thread=holder.thread;
+    buffer->written.store(written+1, std::memory_order_release);
+}
+
+void Trace::clear()
+{
+    std::lock_guard<std::mutex> lock(ms_mutex);
+    for(ThreadBuffer *buffer=ms_buffers; buffer!=NULL; buffer=buffer->next)
+        buffer->written.store(0, std::memory_order_relaxed);
+}
+
+bool Trace::write(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("Trace: couldn't create %s", qPrintable(path));
+        return false;
+    }
+
+    QByteArray header("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"), footer("\n]}\n");
+    bool written=file.write(header)==header.size();
+    bool first=true;
+    char line[256];
+    std::lock_guard<std::mutex> lock(ms_mutex);
+    for(ThreadBuffer *buffer=ms_buffers; buffer!=NULL && written; buffer=buffer->next)
+    {
+        uint64_t end=buffer->written.load(std::memory_order_acquire);
+        uint64_t begin=end>ms_capacity ? end-ms_capacity : 0;
+        for(uint64_t e=begin; e<end && written; ++e)
+        {
+            const Event_t& event=buffer->events[e%ms_capacity];
+            //times in microseconds, as the format wants them
+            int size=std::snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                                   first ? "" : ",\n", event.name, event.thread,
+                                   event.start*1e-3, (event.end-event.start)*1e-3);
+            size=std::min(size, (int)sizeof(line)-1);
+            written=file.write(line, size)==size;
+            first=false;
+        }
+    }
+    written=written && file.write(footer)==footer.size() && file.flush();
+    file.close();
+    if(!written)
+        qWarning("Trace: couldn't write in %s", qPrintable(path));
+    return written;
+}
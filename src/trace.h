@@ -0,0 +1,116 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+///
+/// \brief The Trace class records scoped markers of the phases of the application (renderings, tiles, uploads, frames,
+/// tasks of the TaskPool) and writes them as a Chrome trace (JSON), which chrome://tracing or Perfetto show as a
+/// timeline per thread, to see how busy the threads are and where they wait.
+/// Each thread writes its events to its own ring buffer, without any lock: only the first event of a thread takes one,
+/// to register its buffer. A full buffer overwrites its oldest events.
+/// Disabled (the default), a marker costs a relaxed atomic load and a test.
+///
+class Trace
+{
+public:
+
+    ///
+    /// \brief The Scope class records an event from its construction to its destruction, if tracing was enabled
+    /// when it started. Use TRACE_SCOPE.
+    ///
+    class Scope
+    {
+    public:
+        inline explicit Scope(const char *name) :
+            m_name(name),
+            m_start(enabled() ? now() : 0)
+        {}
+
+        inline ~Scope()
+        {
+            if(m_start!=0)
+                record(m_name, m_start, now());
+        }
+
+    private:
+        const char  *m_name;        //a string literal: only its address is kept
+        uint64_t    m_start;        //0 if tracing was disabled
+    };
+
+    static inline bool enabled() {return ms_enabled.load(std::memory_order_relaxed);}
+
+    /// \brief setEnabled starts or stops recording events. The times of the events start from the first call.
+    static void setEnabled(bool enabled);
+
+    ///
+    /// \brief write writes the events of every thread to a Chrome trace file.
+    /// It should be called while the traced threads are idle: the events they overwrite meanwhile may come out torn.
+    /// \return false if the file couldn't be written, in which case a warning tells why.
+    ///
+    static bool write(const QString& path);
+
+    /// \brief clear drops the events recorded so far.
+    static void clear();
+
+private:
+
+    typedef struct
+    {
+        const char  *name;
+        uint64_t    start;          //nanoseconds since the epoch of the trace
+        uint64_t    end;
+        uint32_t    thread;
+    } Event_t;
+
+    static const uint64_t ms_capacity=1<<14;        //events per thread
+
+    ///
+    /// \brief The ThreadBuffer struct is the ring of events of a thread. Only its thread writes to it; readers
+    /// get the events before written with an acquire load. Buffers are never freed: those of ended threads
+    /// keep their events, and are taken again by new threads.
+    ///
+    struct ThreadBuffer
+    {
+        Event_t                 events[ms_capacity];
+        std::atomic<uint64_t>   written;            //events written since the creation or the last clear()
+        std::atomic<bool>       ended;
+        ThreadBuffer            *next;
+    };
+
+    ///
+    /// \brief The ThreadHolder class gives the buffer of its thread back when the thread ends.
+    ///
+    class ThreadHolder
+    {
+    public:
+        ThreadHolder();
+        ~ThreadHolder();
+
+        ThreadBuffer    *buffer;
+        uint32_t        thread;
+    };
+
+    static void record(const char *name, uint64_t start, uint64_t end);
+
+    /// \brief now is the time in nanoseconds since the epoch of the trace, never 0.
+    static uint64_t now();
+
+    static std::atomic<bool>            ms_enabled;
+    static std::atomic<int64_t>         ms_epoch;               //steady clock, in nanoseconds
+    static std::mutex                   ms_mutex;               //of the list of buffers
+    static ThreadBuffer                 *ms_buffers;
+    static uint32_t                     ms_threadCount;
+    static thread_local ThreadHolder    ms_holder;
+};
+
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_(a, b)
+
+/// \brief TRACE_SCOPE records an event named after the string literal name, from here to the end of the scope.
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCATENATE(traceScope, __LINE__)(name)
+
+#endif // TRACE_H
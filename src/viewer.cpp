@@ -1,9 +1,21 @@
 #include "viewer.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <QKeyEvent>
+#include <QCoreApplication>
+#include <QPainter>
+#include "sceneloader.h"
+#include "trace.h"
 
 Viewer::Viewer(QWidget *parent) :
-    QGLViewer(parent)
+    QGLViewer(parent),
+    m_shaderProgram(NULL),
+    m_imageProgram(NULL),
+    m_manager(NULL),
+    m_renderQueue(NULL),
+    m_preview(NULL),
+    m_previewEnabled(false),
+    m_renderingShown(false),
+    m_textureImage(NULL)
 {}
 
 void Viewer::tp_init()
@@ -18,23 +30,56 @@ void Viewer::tp_init()
     m_shaderProgram->createVBO();
     m_shaderProgram->createVAOFromVBO();
 
+    m_imageProgram = new ShaderProgram_Image();
+    m_imageProgram->createTexture();
+
 #ifdef USE_QGLVIEWER
     m_manager = new SceneManager(*camera(),
                                  m_shaderProgram->vaoId,
                                  m_shaderProgram->vboPositionId,
                                  m_shaderProgram->eboId,
-                                 m_shaderProgram->idOfColor);
-
-    m_manager->setup();
+                                 m_shaderProgram->idOfColor,
+                                 m_shaderProgram->vboInstanceId,
+                                 m_shaderProgram->idOfInstanceMatrixAttribute);
+
+    //a scene (.json) or a mesh (.obj) can be given as first argument, the default scene is used otherwise
+    SceneLoader loader;
+    loader.setCacheEnabled(true);
+    QStringList arguments=QCoreApplication::arguments();
+    if(arguments.size()>1 && loader.load(arguments[1], *m_manager))
+        loader.setupCamera(*camera());
+    else
+        m_manager->setup();
     m_manager->remakeScene();
 
+    m_renderQueue = new RenderQueue(*m_manager);
+
+    //the preview follows the camera, and asks for a redraw whenever it has a new frame
+    m_preview = new PreviewRenderer(*m_manager);
+    m_preview->setFrameCallback([this]()
+    {
+        QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+    });
+    connect(camera()->frame(), &qglviewer::Frame::modified, this, [this]()
+    {
+        //a rendering doesn't match the scene anymore once the camera moved
+        m_renderingShown=false;
+        if(m_previewEnabled)
+            m_preview->setView(m_manager->sceneCamera().currentView());
+    });
+
 #endif
 }
 
 Viewer::~Viewer()
 {
+    //the renderings read the scene, they are stopped first
+    delete m_preview;
+    delete m_renderQueue;
     m_shaderProgram->destroyVAOAndVBO();
     delete m_shaderProgram;
+    m_imageProgram->destroyTexture();
+    delete m_imageProgram;
 }
 
 void Viewer::init()
@@ -64,6 +109,35 @@ void Viewer::init()
 
 void Viewer::draw()
 {
+    TRACE_SCOPE("Viewer::draw");
+    if(m_imageProgram != NULL && (m_previewEnabled || (m_renderingShown && !m_renderedImage.isNull())))
+    {
+        //the last rendering goes over the preview
+        const QImage *image;
+        std::vector<SceneCamera::RenderTile> *tiles;
+        if(m_renderingShown && !m_renderedImage.isNull())
+        {
+            image=&m_renderedImage;
+            tiles=&m_renderedTiles;
+        }
+        else
+        {
+            m_preview->takeFrame(m_previewFrame, m_previewTiles);
+            image=&m_previewFrame;
+            tiles=&m_previewTiles;
+        }
+
+        if(image!=m_textureImage)
+            m_imageProgram->uploadImage(*image);
+        else
+            m_imageProgram->uploadImage(*image, *tiles);
+        m_textureImage=image;
+        tiles->clear();
+
+        m_imageProgram->drawImage();
+        return;
+    }
+
     // recupere les matrices depuis l'interface
     glm::mat4 viewMatrix = getCurrentModelViewMatrix();
     glm::mat4 projectionMatrix = getCurrentProjectionMatrix();
@@ -92,21 +166,124 @@ void Viewer::keyPressEvent(QKeyEvent *e)
 {
 	updateGL();
 
+    //renderings run in the background, the viewer stays responsive while they do
+    SceneManager::RenderSettings_t settings;
+    settings.firstRendering=false;
+    settings.quality=12;
+    settings.typeIntegral=SceneObject::Integral::SINGLE_MEAN;
+    settings.reflectionAngle=M_PI;
+    settings.reflectionQuality=0;
+
     if(e->key()==Qt::Key_A)
-        m_manager->myFirstRendering();
+    {
+        settings.firstRendering=true;
+        startRendering(settings);
+    }
 
     else if(e->key()==Qt::Key_B)
-        m_manager->phongRendering(12);
+        startRendering(settings);
 
     else if(e->key()==Qt::Key_C)
-        m_manager->phongRendering(12, SceneObject::Integral::UNIFORM);
+    {
+        settings.typeIntegral=SceneObject::Integral::UNIFORM;
+        startRendering(settings);
+    }
 
     else if(e->key()==Qt::Key_D)
-        m_manager->phongRendering(12, SceneObject::Integral::UNIFORM_RANDOM);
+    {
+        settings.typeIntegral=SceneObject::Integral::UNIFORM_RANDOM;
+        startRendering(settings);
+    }
+
+    else if(e->key()==Qt::Key_P)
+        setPreviewEnabled(!m_previewEnabled);
+
+    else if(e->key()==Qt::Key_Escape && (m_renderJob || m_previewEnabled))
+    {
+        m_renderQueue->cancelAll();
+        m_renderingShown=false;
+        setPreviewEnabled(false);
+        return;
+    }
 
 	QGLViewer::keyPressEvent(e);
 }
 
+void Viewer::startRendering(const SceneManager::RenderSettings_t& settings)
+{
+    if(m_renderJob)
+        m_renderJob->cancel();
+    m_renderJob=submitRendering(settings, false);
+
+    //shown from its first tile on, until the camera moves
+    m_renderedImage=QImage();
+    m_renderedTiles.clear();
+    m_renderingShown=true;
+}
+
+void Viewer::setPreviewEnabled(bool enabled)
+{
+    m_previewEnabled=enabled;
+    if(m_previewEnabled)
+    {
+        //the preview doesn't build the acceleration structure itself, it only reads the scene
+        m_manager->updateAccelerationStructure();
+        m_preview->resume();
+        m_preview->setView(m_manager->sceneCamera().currentView());
+    }
+    else
+        m_preview->pause();
+    update();
+}
+
+std::shared_ptr<RenderJob> Viewer::submitRendering(const SceneManager::RenderSettings_t& settings, bool urgent)
+{
+    std::shared_ptr<RenderJob> job=std::make_shared<RenderJob>(settings, m_manager->sceneCamera().currentView());
+    std::weak_ptr<RenderJob> weakJob=job;
+
+    //the signals come from the thread of the queue: they are queued, and may arrive after the job was replaced
+    connect(job.get(), &RenderJob::tileRendered, this, [this, weakJob](const QImage& tile, int x, int y)
+    {
+        std::shared_ptr<RenderJob> job=weakJob.lock();
+        if(!job || job!=m_renderJob || job->isCancelled())
+            return;
+        if(m_renderedImage.width()!=job->view().width || m_renderedImage.height()!=job->view().height)
+        {
+            m_renderedImage=QImage(job->view().width, job->view().height, QImage::Format_RGB32);
+            m_renderedImage.fill(Qt::black);
+            m_textureImage=NULL;
+        }
+        QPainter painter(&m_renderedImage);
+        painter.drawImage(x, y, tile);
+        painter.end();
+
+        SceneCamera::RenderTile renderedTile;
+        renderedTile.x=x;
+        renderedTile.y=y;
+        renderedTile.width=tile.width();
+        renderedTile.height=tile.height();
+        m_renderedTiles.push_back(renderedTile);
+        update();
+    }, Qt::QueuedConnection);
+
+    connect(job.get(), &RenderJob::progress, this, [this, weakJob](int tilesDone, int tileCount)
+    {
+        std::shared_ptr<RenderJob> job=weakJob.lock();
+        if(job && job==m_renderJob)
+            displayMessage(QString("Rendering %1%").arg(100*tilesDone/tileCount));
+    }, Qt::QueuedConnection);
+
+    connect(job.get(), &RenderJob::finished, this, [this, weakJob](const QImage&, bool cancelled)
+    {
+        std::shared_ptr<RenderJob> job=weakJob.lock();
+        if(job && job==m_renderJob)
+            displayMessage(cancelled ? "Rendering cancelled" : "Rendering finished");
+    }, Qt::QueuedConnection);
+
+    m_renderQueue->submit(job, urgent);
+    return job;
+}
+
 void Viewer::mousePressEvent(QMouseEvent *e)
 {
     qglviewer::Vec origin, direction;
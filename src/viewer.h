@@ -6,7 +6,11 @@
 #include <glm/glm.hpp>
 #include <cstdlib>
 #include "ShaderProgram_RayTracer.h"
+#include "ShaderProgram_Image.h"
 #include "scenemanager.h"
+#include "renderjob.h"
+#include "previewrenderer.h"
+#include <memory>
 #include <iostream>
 #include "glm/gtx/string_cast.hpp"
 
@@ -55,9 +59,30 @@ protected:
     /// init specific au TP
     void tp_init();
 
+    /// renderings, which run in the background and are shown as their tiles arrive
+    void startRendering(const SceneManager::RenderSettings_t& settings);
+    std::shared_ptr<RenderJob> submitRendering(const SceneManager::RenderSettings_t& settings, bool urgent);
+
+    /// the interactive preview, drawn in place of the scene while it is enabled
+    void setPreviewEnabled(bool enabled);
+
     ShaderProgram_RayTracer* m_shaderProgram;
+    ShaderProgram_Image*     m_imageProgram;
 
     SceneManager *m_manager;
+
+    RenderQueue                 *m_renderQueue;
+    std::shared_ptr<RenderJob>  m_renderJob;        //last requested rendering
+    PreviewRenderer             *m_preview;         //follows the camera
+    bool                        m_previewEnabled;
+    QImage                      m_previewFrame;
+    std::vector<SceneCamera::RenderTile> m_previewTiles;
+
+    //the images are drawn in the viewport instead of the scene, and only their new tiles are sent to OpenGL
+    QImage                      m_renderedImage;    //tiles of m_renderJob, shown until the camera moves
+    std::vector<SceneCamera::RenderTile> m_renderedTiles;  //not sent to the texture yet
+    bool                        m_renderingShown;
+    const QImage                *m_textureImage;    //image the texture holds
 };
 
 #endif
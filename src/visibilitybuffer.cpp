@@ -0,0 +1,290 @@
+#include "visibilitybuffer.h"
+#include "taskpool.h"
+#include "renderstats.h"
+#include <algorithm>
+#include <limits>
+
+const float VisibilityBuffer::ms_margin=0.01f;
+const unsigned int VisibilityBuffer::ms_wholeObject;
+
+VisibilityBuffer::VisibilityBuffer() :
+    m_rays(),
+    m_tileSize(1),
+    m_columns(0),
+    m_primitives(),
+    m_binStarts(),
+    m_bins(),
+    m_tile(),
+    m_tileRays(),
+    m_tileHits(),
+    m_tileTraced()
+{}
+
+void VisibilityBuffer::build(const std::vector<SceneObject*>& objects, const SceneCamera::Rays& rays, int tileSize)
+{
+    clear();
+    m_rays=rays;
+    m_tileSize=std::max(tileSize, 1);
+    m_columns=(rays.width()+m_tileSize-1)/m_tileSize;
+    int tileCount=SceneCamera::tileCount(rays.width(), rays.height(), m_tileSize);
+
+    for(std::vector<SceneObject*>::const_iterator it=objects.begin(); it!=objects.end(); ++it)
+    {
+        SceneObject *object=*it;
+        if(object==NULL || object->bounds().isEmpty())
+            continue;
+        Primitive_t primitive;
+        primitive.object=object;
+        primitive.primitive=0;
+        ScenePrimitives *registry=dynamic_cast<ScenePrimitives*>(object);
+        if(registry!=NULL && registry->size()>coveredPixels(object->bounds()))
+        {
+            //a ray is cheaper than projecting several primitives, which would mostly fall between the rays
+            primitive.primitive=ms_wholeObject;
+            primitive.type=TRACED;
+            m_primitives.push_back(primitive);
+        }
+        else if(registry!=NULL)
+        {
+            for(unsigned int i=0; i<registry->size(); ++i)
+            {
+                primitive.primitive=i;
+                switch(registry->primitiveType(i))
+                {
+                case ScenePrimitives::TRIANGLE:
+                    primitive.type=TRIANGLE;
+                    break;
+                case ScenePrimitives::QUAD:
+                    primitive.type=QUAD;
+                    break;
+                default: //spheres and disks
+                    primitive.type=TRACED;
+                }
+                m_primitives.push_back(primitive);
+            }
+        }
+        else
+        {
+            primitive.type = dynamic_cast<SceneFace*>(object)!=NULL ? FACE : TRACED;
+            m_primitives.push_back(primitive);
+        }
+    }
+
+    //meshes have millions of triangles, the projection is what takes time
+    TaskPool::globalInstance().parallelFor(0, m_primitives.size(), ms_primitiveGrain, [this](size_t first, size_t last)
+    {
+        for(size_t i=first; i<last; ++i)
+            project(m_primitives[i]);
+    });
+
+    //counting sort of the primitives by tile, which keeps them in the order of the scene
+    m_binStarts.assign(tileCount+1, 0);
+    for(std::vector<Primitive_t>::const_iterator it=m_primitives.begin(); it!=m_primitives.end(); ++it)
+    {
+        if(it->x0>it->x1)
+            continue;
+        for(int row=it->y0/m_tileSize; row<=it->y1/m_tileSize; ++row)
+        {
+            for(int column=it->x0/m_tileSize; column<=it->x1/m_tileSize; ++column)
+                ++m_binStarts[row*m_columns+column+1];
+        }
+    }
+    for(int i=0; i<tileCount; ++i)
+        m_binStarts[i+1]+=m_binStarts[i];
+    m_bins.resize(m_binStarts.back());
+    std::vector<unsigned int> ends(m_binStarts.begin(), m_binStarts.end()-1);
+    for(size_t i=0; i<m_primitives.size(); ++i)
+    {
+        const Primitive_t& primitive=m_primitives[i];
+        if(primitive.x0>primitive.x1)
+            continue;
+        for(int row=primitive.y0/m_tileSize; row<=primitive.y1/m_tileSize; ++row)
+        {
+            for(int column=primitive.x0/m_tileSize; column<=primitive.x1/m_tileSize; ++column)
+                m_bins[ends[row*m_columns+column]++]=i;
+        }
+    }
+}
+
+void VisibilityBuffer::clear()
+{
+    m_primitives.clear();
+    m_binStarts.clear();
+    m_bins.clear();
+}
+
+void VisibilityBuffer::resolveTile(int i)
+{
+    if(!isBuilt())
+        ERROR("VisibilityBuffer: build() not called before resolveTile!");
+
+    m_tile=SceneCamera::tile(i, m_rays.width(), m_rays.height(), m_tileSize);
+    size_t pixelCount=(size_t)m_tile.width*m_tile.height;
+    m_tileRays.resize(pixelCount);
+    m_tileHits.assign(pixelCount, SceneObject::RayHitProperties());
+    m_tileTraced.assign(pixelCount, 0);
+
+    const unsigned int *bin=m_bins.data()+m_binStarts[i];
+    size_t binSize=m_binStarts[i+1]-m_binStarts[i];
+    TaskPool::globalInstance().parallelFor(m_tile.y, m_tile.y+m_tile.height, ms_rowGrain, [this, bin, binSize](size_t first, size_t last)
+    {
+        int firstRow=(int)first, lastRow=(int)last-1;
+        for(int y=firstRow; y<=lastRow; ++y)
+        {
+            for(int x=m_tile.x; x<m_tile.x+m_tile.width; ++x)
+                m_tileRays[pixel(x, y)]=m_rays.castRay((float)x+0.5f, (float)y+0.5f);
+        }
+
+        for(size_t k=0; k<binSize; ++k)
+        {
+            const Primitive_t& primitive=m_primitives[bin[k]];
+            int x0=std::max(primitive.x0, m_tile.x), x1=std::min(primitive.x1, m_tile.x+m_tile.width-1);
+            int y0=std::max(primitive.y0, firstRow), y1=std::min(primitive.y1, lastRow);
+            for(int y=y0; y<=y1; ++y)
+            {
+                for(int x=x0; x<=x1; ++x)
+                {
+                    size_t p=pixel(x, y);
+                    if(primitive.type==TRACED)
+                        m_tileTraced[p]=1;
+                    else
+                        intersects(primitive, m_tileRays[p], m_tileHits[p]);
+                }
+            }
+        }
+    });
+}
+
+void VisibilityBuffer::projectPoints(const glm::vec3 *points, int count, Primitive_t& primitive) const
+{
+    float minX=std::numeric_limits<float>::max(), minY=minX;
+    float maxX=-minX, maxY=-minX;
+    bool inFront=true;
+    for(int i=0; i<count && inFront; ++i)
+    {
+        float x, y;
+        inFront=m_rays.project(points[i], x, y);
+        minX=std::min(minX, x);
+        minY=std::min(minY, y);
+        maxX=std::max(maxX, x);
+        maxY=std::max(maxY, y);
+    }
+
+    if(!inFront)
+    {
+        //the rays of every pixel may hit a primitive going behind the camera
+        primitive.x0=0;
+        primitive.y0=0;
+        primitive.x1=m_rays.width()-1;
+        primitive.y1=m_rays.height()-1;
+        return;
+    }
+    //the ray of pixel i goes through i+0.5: primitives of a mesh are often smaller than a pixel, and cover no ray at all.
+    //Points close to the plane of the camera project far away, they are brought back before the conversion.
+    float width=(float)m_rays.width(), height=(float)m_rays.height();
+    primitive.x0=(int)std::ceil(glm::clamp(minX, -1.0f, width+1.0f)-0.5f-ms_margin);
+    primitive.y0=(int)std::ceil(glm::clamp(minY, -1.0f, height+1.0f)-0.5f-ms_margin);
+    primitive.x1=(int)std::floor(glm::clamp(maxX, -1.0f, width+1.0f)-0.5f+ms_margin);
+    primitive.y1=(int)std::floor(glm::clamp(maxY, -1.0f, height+1.0f)-0.5f+ms_margin);
+    primitive.x0=std::max(primitive.x0, 0);
+    primitive.y0=std::max(primitive.y0, 0);
+    primitive.x1=std::min(primitive.x1, m_rays.width()-1);
+    primitive.y1=std::min(primitive.y1, m_rays.height()-1);
+    if(primitive.y0>primitive.y1)
+        primitive.x1=primitive.x0-1;
+}
+
+void VisibilityBuffer::projectBox(const AABB& box, Primitive_t& primitive) const
+{
+    glm::vec3 corners[8];
+    for(int i=0; i<8; ++i)
+        corners[i]=glm::vec3(i&1 ? box.pMax.x : box.pMin.x, i&2 ? box.pMax.y : box.pMin.y, i&4 ? box.pMax.z : box.pMin.z);
+    projectPoints(corners, 8, primitive);
+}
+
+size_t VisibilityBuffer::coveredPixels(const AABB& box) const
+{
+    Primitive_t primitive;
+    projectBox(box, primitive);
+    if(primitive.x0>primitive.x1)
+        return 0;
+    return (size_t)(primitive.x1-primitive.x0+1)*(primitive.y1-primitive.y0+1);
+}
+
+void VisibilityBuffer::project(Primitive_t& primitive) const
+{
+    glm::vec3 points[8];
+    if(primitive.type==FACE)
+    {
+        const SceneFace *face=static_cast<const SceneFace*>(primitive.object);
+        points[0]=face->bottomLeft();
+        points[1]=points[0]+face->axisW()*face->width();
+        points[2]=points[1]+face->axisH()*face->height();
+        points[3]=points[0]+face->axisH()*face->height();
+        projectPoints(points, 4, primitive);
+        return;
+    }
+
+    AABB box;
+    if(primitive.type==TRACED)
+    {
+        const ScenePrimitives *registry=dynamic_cast<const ScenePrimitives*>(primitive.object);
+        if(registry==NULL || primitive.primitive==ms_wholeObject)
+            box=primitive.object->bounds();
+        else if(registry->primitiveType(primitive.primitive)==ScenePrimitives::SPHERE)
+            box=registry->spheres()[registry->primitiveIndex(primitive.primitive)].bounds();
+        else
+            box=registry->disks()[registry->primitiveIndex(primitive.primitive)].bounds();
+        projectBox(box, primitive);
+        return;
+    }
+
+    const ScenePrimitives *registry=static_cast<const ScenePrimitives*>(primitive.object);
+    unsigned int index=registry->primitiveIndex(primitive.primitive);
+    if(primitive.type==TRIANGLE)
+    {
+        const ScenePrimitives::Triangle& triangle=registry->triangles()[index];
+        points[0]=triangle.p0;
+        points[1]=triangle.p0+triangle.edge1;
+        points[2]=triangle.p0+triangle.edge2;
+        projectPoints(points, 3, primitive);
+    }
+    else
+    {
+        const ScenePrimitives::Quad& quad=registry->quads()[index];
+        points[0]=quad.p0;
+        points[1]=quad.p0+quad.axisW*quad.width;
+        points[2]=points[1]+quad.axisH*quad.height;
+        points[3]=quad.p0+quad.axisH*quad.height;
+        projectPoints(points, 4, primitive);
+    }
+}
+
+void VisibilityBuffer::intersects(const Primitive_t& primitive, const Ray& ray, SceneObject::RayHitProperties& hit)
+{
+    if(primitive.type==FACE)
+    {
+        static_cast<SceneFace*>(primitive.object)->SceneFace::intersectsRay(ray, hit);
+        return;
+    }
+
+    //same as ScenePrimitives::intersectsRay(), for a single primitive
+    ScenePrimitives *registry=static_cast<ScenePrimitives*>(primitive.object);
+    unsigned int index=registry->primitiveIndex(primitive.primitive);
+    float tMax = hit.occuredHit ? hit.distanceHit : std::numeric_limits<float>::max();
+    float t;
+    glm::vec3 normal;
+    RENDER_STATS_ADD(intersectionTests, 1);
+    bool intersection = primitive.type==TRIANGLE ? registry->triangles()[index].intersectsRay(ray, tMax, t, normal)
+                                                 : registry->quads()[index].intersectsRay(ray, tMax, t, normal);
+    if(intersection)
+    {
+        hit.occuredHit      = true;
+        hit.objectHit       = registry;
+        hit.primitiveHit    = primitive.primitive;
+        hit.instanceHit     = NULL;
+        hit.positionHit     = ray.origin() + ray.direction()*t;
+        hit.normalHit       = normal;
+        hit.distanceHit     = t;
+    }
+}
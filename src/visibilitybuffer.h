@@ -0,0 +1,98 @@
+#ifndef VISIBILITYBUFFER_H
+#define VISIBILITYBUFFER_H
+
+#include "sceneface.h"
+#include "sceneprimitives.h"
+#include "scenecamera.h"
+#include <vector>
+
+///
+/// \brief The VisibilityBuffer class finds what the camera rays of a rendering hit first, without traversing the scene.
+/// The quads of SceneFace objects and the triangles and quads of ScenePrimitives registries (meshes) are projected
+/// on the image and binned in the tiles of the rendering. Each tile then tests its pixels against the primitives
+/// of its bin only, keeping the closest hit and its depth. The coverage test of a pixel is the intersection kernel
+/// of the ray tracer, so that the hits are exactly those SceneManager::intersectsRay() would find.
+/// Other objects (spheres, disks, instances) aren't rasterized: the pixels their box covers are left to be traced.
+/// So are the registries with more primitives than pixels under their box, whose primitives mostly fall between
+/// the rays: the BVH of the registry finds their hits for less than projecting all of them.
+/// Both the binning and the tiles are spread over the TaskPool.
+///
+class VisibilityBuffer
+{
+public:
+    VisibilityBuffer();
+
+    ///
+    /// \brief build projects and bins the objects seen by the rays of a view.
+    /// \param objects objects of the scene in world space, NULL ones being skipped
+    /// \param tileSize size of the tiles, numbered as SceneCamera::tile() does
+    ///
+    void build(const std::vector<SceneObject*>& objects, const SceneCamera::Rays& rays, int tileSize);
+    void clear();
+
+    inline bool isBuilt() const                                                 {return !m_binStarts.empty();}
+
+    ///
+    /// \brief resolveTile finds the first hit of every pixel of tile i, read with ray(), hit() and traced() until the next call.
+    ///
+    void resolveTile(int i);
+
+    /// \brief ray is the camera ray of pixel (x,y) of the resolved tile, as SceneCamera::castRayFromPixel() casts it.
+    inline const Ray& ray(int x, int y) const                                   {return m_tileRays[pixel(x, y)];}
+    inline const SceneObject::RayHitProperties& hit(int x, int y) const         {return m_tileHits[pixel(x, y)];}
+
+    /// \brief traced tells if pixel (x,y) of the resolved tile may see an object which isn't rasterized: its hit must be traced.
+    inline bool traced(int x, int y) const                                      {return m_tileTraced[pixel(x, y)]!=0;}
+
+    /// \brief primitiveCount is the number of primitives projected by the last build.
+    inline size_t primitiveCount() const                                        {return m_primitives.size();}
+
+private:
+
+    typedef enum {FACE, TRIANGLE, QUAD, TRACED} PrimitiveType_t;
+
+    typedef struct
+    {
+        SceneObject         *object;
+        unsigned int        primitive;      //index of the primitive in its registry, ms_wholeObject for the whole registry
+        PrimitiveType_t     type;
+        int                 x0, y0, x1, y1; //pixels the primitive may cover, empty if x0>x1
+    } Primitive_t;
+
+    /// \brief projectPoints sets the pixels covered by the projection of some points (their convex hull).
+    void projectPoints(const glm::vec3 *points, int count, Primitive_t& primitive) const;
+
+    void projectBox(const AABB& box, Primitive_t& primitive) const;
+
+    /// \brief coveredPixels is the number of pixels a box may cover.
+    size_t coveredPixels(const AABB& box) const;
+
+    /// \brief project sets the pixels the primitive may cover.
+    void project(Primitive_t& primitive) const;
+
+    /// \brief intersects tests the ray of a pixel against a primitive, keeping the closest hit.
+    static void intersects(const Primitive_t& primitive, const Ray& ray, SceneObject::RayHitProperties& hit);
+
+    inline size_t pixel(int x, int y) const {return (size_t)(y-m_tile.y)*m_tile.width + (x-m_tile.x);}
+
+    SceneCamera::Rays                           m_rays;
+    int                                         m_tileSize;
+    int                                         m_columns;          //of tiles
+
+    std::vector<Primitive_t>                    m_primitives;
+    std::vector<unsigned int>                   m_binStarts;        //first primitive of each tile in m_bins, one more than the tiles
+    std::vector<unsigned int>                   m_bins;             //primitives of every tile, tile after tile
+
+    //resolved tile
+    SceneCamera::RenderTile                     m_tile;
+    std::vector<Ray>                            m_tileRays;
+    std::vector<SceneObject::RayHitProperties>  m_tileHits;
+    std::vector<unsigned char>                  m_tileTraced;
+
+    static const size_t                         ms_primitiveGrain=4096;     //primitives projected by a task
+    static const size_t                         ms_rowGrain=4;              //rows of a tile resolved by a task
+    static const unsigned int                   ms_wholeObject=~0u;
+    static const float                          ms_margin;                  //in pixels, added to the projections for rounding errors
+};
+
+#endif // VISIBILITYBUFFER_H